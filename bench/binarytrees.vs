@@ -0,0 +1,25 @@
+-- 二叉树的创建和遍历, 大量短命的小表, 主要压测gc
+-- 同时保留一棵长期存活的树
+
+let function bottomup(depth) {
+  if depth == 0 { return {} }
+  depth = depth - 1
+  return {bottomup(depth), bottomup(depth)}
+}
+
+let function check(tree) {
+  if tree[1] == nil { return 1 }
+  return 1 + check(tree[1]) + check(tree[2])
+}
+
+let mindepth = 4
+let maxdepth = 12
+let total = check(bottomup(maxdepth + 1))
+let longlived = bottomup(maxdepth)
+for depth = mindepth, maxdepth, 2 {
+  let iters = 1 << (maxdepth - depth + mindepth)
+  let c = 0
+  for i = 1, iters, 1 { c = c + check(bottomup(depth)) }
+  total = total + c
+}
+return total + check(longlived)
@@ -0,0 +1,28 @@
+-- 闭包的创建和上值的读写
+
+let function counter() {
+  let c = 0
+  return function() { c = c + 1; return c }
+}
+
+let function adder(x) {
+  return function(y) { return x + y }
+}
+
+let total = 0
+for i = 1, 200000, 1 {
+  let f = counter()
+  f()
+  total = total + f()
+}
+
+let add5 = adder(5)
+for i = 1, 2000000, 1 { total = add5(total) % 1000003 }
+
+let shared = 0
+let fs = {}
+for i = 1, 100, 1 { fs[i] = function() { shared = shared + i } }
+for r = 1, 10000, 1 {
+  for i = 1, 100, 1 { fs[i]() }
+}
+return total + shared
@@ -0,0 +1,23 @@
+#!/bin/sh
+# 用法: sh bench/dispatch.sh 解释器1 解释器2 ...
+# 每个解释器运行bench/dispatch.vs若干次, 输出最短的耗时(毫秒)
+
+SCRIPT=${SCRIPT:-bench/dispatch.vs}
+RUNS=${RUNS:-5}
+
+now_ms() {
+  echo $(( $(date +%s%N) / 1000000 ))
+}
+
+for vs in "$@"; do
+  best=
+  n=0
+  while [ $n -lt $RUNS ]; do
+    start=$(now_ms)
+    "$vs" "$SCRIPT" > /dev/null || exit 1
+    t=$(( $(now_ms) - start ))
+    if [ -z "$best" ] || [ $t -lt $best ]; then best=$t; fi
+    n=$((n + 1))
+  done
+  echo "$vs: best of $RUNS runs: ${best} ms"
+done
@@ -0,0 +1,41 @@
+-- 解释器分派开销的基准测试
+-- 以整数/浮点运算, 比较跳转和表的读写为主, 每条指令的工作量都很小
+-- 注意: 'for i = 1, n {' 会把'n {...}'识别为函数调用, 所以循环上限都显式写出步长
+
+let function fib(n) {
+  if n < 2 { return n }
+  return fib(n - 1) + fib(n - 2)
+}
+
+let function arith(n) {
+  let s, f = 0, 0.5
+  for i = 1, n, 1 {
+    s = s + i * 3 - (i // 7) + (i % 5)
+    f = f * 0.999 + i / 3
+    if s > 1000000 { s = s - 1000000 }
+  }
+  return s, f
+}
+
+let function tables(n) {
+  let t = {}
+  for i = 1, n, 1 { t[i] = i }
+  let sum = 0
+  for r = 1, 20 {
+    for i = 1, n, 1 { sum = sum + t[i]; t[i] = t[i] + 1 }
+  }
+  let h = {}
+  for i = 1, n, 1 { h["k" .. (i % 1000)] = i }
+  return sum
+}
+
+let function loops(n) {
+  let c, i = 0, 0
+  while i < n - 0 {
+    i = i + 1
+    if i % 3 == 0 { c = c + 1 } elseif i % 3 == 1 { c = c - 1 } else { c = c + 2 }
+  }
+  return c
+}
+
+print(fib(27), arith(3000000), tables(100000), loops(3000000))
@@ -0,0 +1,7 @@
+-- 递归函数调用: 朴素的斐波那契数列
+let function fib(n) {
+  if n < 2 { return n }
+  return fib(n - 1) + fib(n - 2)
+}
+
+return fib(30)
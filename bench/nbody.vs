@@ -0,0 +1,109 @@
+-- n体模拟, 以浮点运算和表字段读写为主
+-- 没有math库, 开方使用 x ^ 0.5
+
+let PI = 3.141592653589793
+let SOLAR_MASS = 4 * PI * PI
+let DAYS_PER_YEAR = 365.24
+
+let bodies = {
+  {x = 0, y = 0, z = 0, vx = 0, vy = 0, vz = 0, mass = SOLAR_MASS},
+  {  -- 木星
+    x = 4.84143144246472090e+00,
+    y = -1.16032004402742839e+00,
+    z = -1.03622044471123109e-01,
+    vx = 1.66007664274403694e-03 * DAYS_PER_YEAR,
+    vy = 7.69901118419740425e-03 * DAYS_PER_YEAR,
+    vz = -6.90460016972063023e-05 * DAYS_PER_YEAR,
+    mass = 9.54791938424326609e-04 * SOLAR_MASS
+  },
+  {  -- 土星
+    x = 8.34336671824457987e+00,
+    y = 4.12479856412430479e+00,
+    z = -4.03523417114321381e-01,
+    vx = -2.76742510726862411e-03 * DAYS_PER_YEAR,
+    vy = 4.99852801234917238e-03 * DAYS_PER_YEAR,
+    vz = 2.30417297573763929e-05 * DAYS_PER_YEAR,
+    mass = 2.85885980666130812e-04 * SOLAR_MASS
+  },
+  {  -- 天王星
+    x = 1.28943695621391310e+01,
+    y = -1.51111514016986312e+01,
+    z = -2.23307578892655734e-01,
+    vx = 2.96460137564761618e-03 * DAYS_PER_YEAR,
+    vy = 2.37847173959480950e-03 * DAYS_PER_YEAR,
+    vz = -2.96589568540237556e-05 * DAYS_PER_YEAR,
+    mass = 4.36624404335156298e-05 * SOLAR_MASS
+  },
+  {  -- 海王星
+    x = 1.53796971148509165e+01,
+    y = -2.59193146099879641e+01,
+    z = 1.79258772950371181e-01,
+    vx = 2.68067772490389322e-03 * DAYS_PER_YEAR,
+    vy = 1.62824170038242295e-03 * DAYS_PER_YEAR,
+    vz = -9.51592254519715870e-05 * DAYS_PER_YEAR,
+    mass = 5.15138902046611451e-05 * SOLAR_MASS
+  }
+}
+
+let function advance(bodies, nbody, dt) {
+  for i = 1, nbody, 1 {
+    let bi = bodies[i]
+    let bix, biy, biz, bimass = bi.x, bi.y, bi.z, bi.mass
+    let bivx, bivy, bivz = bi.vx, bi.vy, bi.vz
+    for j = i + 1, nbody, 1 {
+      let bj = bodies[j]
+      let dx, dy, dz = bix - bj.x, biy - bj.y, biz - bj.z
+      let d2 = dx * dx + dy * dy + dz * dz
+      let mag = dt / (d2 * d2 ^ 0.5)
+      let bm = bj.mass * mag
+      bivx = bivx - (dx * bm)
+      bivy = bivy - (dy * bm)
+      bivz = bivz - (dz * bm)
+      bm = bimass * mag
+      bj.vx = bj.vx + (dx * bm)
+      bj.vy = bj.vy + (dy * bm)
+      bj.vz = bj.vz + (dz * bm)
+    }
+    bi.vx = bivx
+    bi.vy = bivy
+    bi.vz = bivz
+    bi.x = bix + dt * bivx
+    bi.y = biy + dt * bivy
+    bi.z = biz + dt * bivz
+  }
+}
+
+let function energy(bodies, nbody) {
+  let e = 0
+  for i = 1, nbody, 1 {
+    let bi = bodies[i]
+    let vx, vy, vz, bim = bi.vx, bi.vy, bi.vz, bi.mass
+    e = e + (0.5 * bim * (vx * vx + vy * vy + vz * vz))
+    for j = i + 1, nbody, 1 {
+      let bj = bodies[j]
+      let dx, dy, dz = bi.x - bj.x, bi.y - bj.y, bi.z - bj.z
+      e = e - bim * bj.mass / (dx * dx + dy * dy + dz * dz) ^ 0.5
+    }
+  }
+  return e
+}
+
+let function offsetmomentum(b, nbody) {
+  let px, py, pz = 0, 0, 0
+  for i = 1, nbody, 1 {
+    let bi = b[i]
+    let bim = bi.mass
+    px = px + (bi.vx * bim)
+    py = py + (bi.vy * bim)
+    pz = pz + (bi.vz * bim)
+  }
+  b[1].vx = -px / SOLAR_MASS
+  b[1].vy = -py / SOLAR_MASS
+  b[1].vz = -pz / SOLAR_MASS
+}
+
+let nbody = #bodies
+offsetmomentum(bodies, nbody)
+let before = energy(bodies, nbody)
+for i = 1, 50000, 1 { advance(bodies, nbody, 0.01) }
+return tostring(before) .. " " .. tostring(energy(bodies, nbody))
@@ -0,0 +1,20 @@
+-- table.sort: 整数使用默认比较, 字符串使用vs比较函数
+
+let seed = 42
+let function rand() {
+  seed = (seed * 1103515245 + 12345) % 2147483648
+  return seed
+}
+
+let a = {}
+for i = 1, 100000, 1 { a[i] = rand() }
+table.sort(a)
+
+let b = {}
+for i = 1, 50000, 1 { b[i] = "s" .. (rand() % 100000) }
+table.sort(b, function(x, y) { return x > y })
+
+let bad = 0
+for i = 2, #a, 1 { bad = bad + (a[i - 1] > a[i] and 1 or 0) }
+for i = 2, #b, 1 { bad = bad + (b[i - 1] < b[i] and 1 or 0) }
+return a[1] + a[#a] + bad
@@ -0,0 +1,20 @@
+-- 字符串拼接和短字符串内部化
+
+let parts = {}
+for i = 1, 100000, 1 { parts[i] = "item" .. i }
+let joined = table.concat(parts, ",")
+
+let total = 0
+for r = 1, 50, 1 {
+  let acc = ""
+  for i = 1, 200, 1 { acc = acc .. "x" .. i }
+  total = total + #acc
+}
+
+-- 反复生成相同内容的短字符串, 每次都会命中字符串表
+let hits = 0
+for i = 1, 300000, 1 {
+  let k = "k" .. (i % 100)
+  if k == "k7" { hits = hits + 1 }
+}
+return #joined + total + hits
@@ -0,0 +1,14 @@
+-- 整数键的表插入和查找: 连续键走数组部分, 稀疏键走哈希部分
+
+let N = 100000
+let arr = {}
+for i = 1, N, 1 { arr[i] = i * 2 }
+let hash = {}
+for i = 1, N, 1 { hash[i * 7919 % 1000003] = i }
+
+let sum = 0
+for r = 1, 5, 1 {
+  for i = 1, N, 1 { sum = sum + arr[i] }
+  for i = 1, N, 1 { sum = sum + hash[i * 7919 % 1000003] }
+}
+return sum
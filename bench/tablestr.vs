@@ -0,0 +1,21 @@
+-- 字符串键的表插入和查找
+
+let N = 50000
+let keys = {}
+for i = 1, N, 1 { keys[i] = "key" .. i }
+let t = {}
+for i = 1, N, 1 { t[keys[i]] = i }
+
+let sum = 0
+for r = 1, 20, 1 {
+  for i = 1, N, 1 { sum = sum + t[keys[i]] }
+  for i = 1, N, 50 { t[keys[i]] = t[keys[i]] + 1 }
+}
+let rec = {}
+for i = 1, 300000, 1 {
+  rec.alpha = i
+  rec.beta = rec.alpha + 1
+  rec.gamma = rec.beta + rec.alpha
+  sum = sum + rec.gamma % 7
+}
+return sum
@@ -0,0 +1,192 @@
+/*
+** VS benchmark driver
+** Runs each script in a fresh vs_State several times and reports
+** timings, peak memory and GC cycles as JSON on stdout.
+*/
+
+#define vsbench_c
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "vauxlib.h"
+#include "vs.h"
+#include "vslib.h"
+
+#define PROGNAME "vs-bench" /* default program name */
+#define MAXRUNS 1000        /* maximum value for '-n' */
+
+static int runs = 5;                    /* runs per script */
+static int generational = 0;            /* use the generational collector? */
+static const char *progname = PROGNAME; /* actual program name */
+
+static void fatal(const char *message) {
+  fprintf(stderr, "%s: %s\n", progname, message);
+  exit(EXIT_FAILURE);
+}
+
+static void usage(const char *message) {
+  if (*message == '-')
+    fprintf(stderr, "%s: unrecognized option '%s'\n", progname, message);
+  else
+    fprintf(stderr, "%s: %s\n", progname, message);
+  fprintf(stderr,
+          "usage: %s [options] scripts\n"
+          "Available options are:\n"
+          "  -n runs  run each script 'runs' times (default %d)\n"
+          "  -g       use the generational garbage collector\n"
+          "  --       stop handling options\n",
+          progname, runs);
+  exit(EXIT_FAILURE);
+}
+
+static int doargs(int argc, char *argv[]) {
+  int i;
+  if (argv[0] != NULL && *argv[0] != 0) progname = argv[0];
+  for (i = 1; i < argc; i++) {
+    if (*argv[i] != '-') /* end of options; keep it */
+      break;
+    else if (!strcmp(argv[i], "--")) { /* end of options; skip it */
+      ++i;
+      break;
+    } else if (!strcmp(argv[i], "-n")) { /* runs per script */
+      if (++i >= argc) usage("'-n' needs argument");
+      runs = atoi(argv[i]);
+      if (runs < 1 || runs > MAXRUNS) usage("invalid number of runs");
+    } else if (!strcmp(argv[i], "-g")) /* generational mode */
+      generational = 1;
+    else /* unknown option */
+      usage(argv[i]);
+  }
+  if (i == argc) usage("no input files given");
+  return i;
+}
+
+/*
+** 统计内存的分配函数, ud指向Stats
+** ptr为NULL时osize是对象类型, 不是旧的大小
+*/
+typedef struct Stats {
+  size_t current; /* bytes in use */
+  size_t peak;    /* maximum value of 'current' */
+} Stats;
+
+static void *countalloc(void *ud, void *ptr, size_t osize, size_t nsize) {
+  Stats *st = (Stats *)ud;
+  void *res;
+  if (ptr == NULL) osize = 0;
+  if (nsize == 0) {
+    free(ptr);
+    st->current -= osize;
+    return NULL;
+  }
+  res = realloc(ptr, nsize);
+  if (res == NULL) return NULL;
+  st->current = st->current - osize + nsize;
+  if (st->current > st->peak) st->peak = st->current;
+  return res;
+}
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec * 1e3 + (double)ts.tv_nsec / 1e6;
+}
+
+/* 一次运行的结果 */
+typedef struct Run {
+  double ms;     /* elapsed time in milliseconds */
+  size_t peak;   /* peak memory in bytes */
+  size_t cycles; /* finished GC cycles */
+} Run;
+
+static int cmptime(const void *a, const void *b) {
+  double x = ((const Run *)a)->ms, y = ((const Run *)b)->ms;
+  return (x > y) - (x < y);
+}
+
+/*
+** 在新的vs_State中运行一次脚本, 脚本的返回值转换成字符串写入check
+** 只计算运行脚本的时间, 不包括创建状态和编译的时间
+*/
+static void runscript(const char *fname, Run *r, char *check, size_t sz) {
+  Stats st = {0, 0};
+  vs_GCStats gs;
+  vs_State *L = vs_newstate(countalloc, &st);
+  double start;
+  if (L == NULL) fatal("cannot create state: not enough memory");
+  vsL_openlibs(L);
+  if (generational) vs_gc(L, VS_GCGEN, 0, 0);
+  if (vsL_loadfile(L, fname) != VS_OK) fatal(vs_tostring(L, -1));
+  start = now();
+  if (vs_pcall(L, 0, 1, 0) != VS_OK) fatal(vs_tostring(L, -1));
+  r->ms = now() - start;
+  r->peak = st.peak;
+  vs_gc(L, VS_GCSTATS, &gs);
+  r->cycles = gs.cycles;
+  snprintf(check, sz, "%s", vsL_tolstring(L, -1, NULL));
+  vs_close(L);
+}
+
+/* 输出json字符串, 转义引号, 反斜杠和控制字符 */
+static void printstring(const char *s) {
+  putchar('"');
+  for (; *s; s++) {
+    unsigned char c = (unsigned char)*s;
+    if (c == '"' || c == '\\')
+      printf("\\%c", c);
+    else if (c < 0x20)
+      printf("\\u%04x", c);
+    else
+      putchar(c);
+  }
+  putchar('"');
+}
+
+/* 脚本名去掉目录和'.vs'后缀 */
+static void printname(const char *fname) {
+  char name[256];
+  const char *base = strrchr(fname, '/');
+  size_t l;
+  base = (base == NULL) ? fname : base + 1;
+  l = strlen(base);
+  if (l > 3 && !strcmp(base + l - 3, ".vs")) l -= 3;
+  if (l >= sizeof(name)) l = sizeof(name) - 1;
+  memcpy(name, base, l);
+  name[l] = '\0';
+  printstring(name);
+}
+
+static void bench(const char *fname, int last) {
+  Run r[MAXRUNS];
+  char check[128];
+  size_t peak = 0;
+  double median;
+  int i;
+  for (i = 0; i < runs; i++) {
+    runscript(fname, &r[i], check, sizeof(check));
+    if (r[i].peak > peak) peak = r[i].peak;
+  }
+  qsort(r, runs, sizeof(Run), cmptime);
+  median = (runs % 2) ? r[runs / 2].ms
+                      : (r[runs / 2 - 1].ms + r[runs / 2].ms) / 2;
+  printf("    {\"name\": ");
+  printname(fname);
+  printf(", \"min_ms\": %.3f, \"median_ms\": %.3f", r[0].ms, median);
+  printf(", \"peak_bytes\": %lu, \"gc_cycles\": %lu, \"check\": ",
+         (unsigned long)peak, (unsigned long)r[0].cycles);
+  printstring(check);
+  printf("}%s\n", last ? "" : ",");
+  fflush(stdout);
+}
+
+int main(int argc, char *argv[]) {
+  int i = doargs(argc, argv);
+  printf("{\n  \"runs\": %d,\n  \"gc\": \"%s\",\n  \"results\": [\n", runs,
+         generational ? "generational" : "incremental");
+  for (; i < argc; i++) bench(argv[i], i == argc - 1);
+  printf("  ]\n}\n");
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,50 @@
+-- 整数边界: VS_NANBOXING下整数只有47位, 超出范围的结果变成浮点数
+-- 以下断言在两种编译方式下都成立
+
+let lim = 70368744177663        -- 2^46 - 1
+let min = -lim - 1              -- -2^46
+
+-- 2^46附近的算术不能回绕
+assert(lim + 1 > lim)
+assert(lim + 1 == 70368744177664)
+assert(lim + 1 - 1 == lim)
+assert(lim * 4 == 281474976710652)
+assert(min - 1 < min)
+assert(min - 1 == -70368744177665)
+assert(min * 2 == -140737488355328)
+assert(-min == lim + 1)
+assert((lim + 1) // 1 == 70368744177664)
+
+-- 字面量和字符串转换
+assert(0x400000000000 == lim + 1)
+assert(0x800000000000 ~= 0)
+assert(0x800000000000 == 2 * (lim + 1))
+assert(tonumber("70368744177664") == lim + 1)
+assert(tonumber("0x800000000000") == 2 * (lim + 1))
+
+-- 低47位相同的常量不能合并
+let a = 0
+let b = 0x800000000000
+assert(a ~= b)
+
+-- 表的key
+let t = {}
+t[lim + 1] = "x"
+assert(t[70368744177664] == "x")
+t[0x800000000000] = "y"
+assert(t[0] == nil)
+assert(t[2 * (lim + 1)] == "y")
+
+-- math.maxinteger
+let big = 0x7FFFFFFFFFFFFFFF
+assert(big == 9223372036854775807)
+assert(big > lim)
+assert(big > 4611686018427387904.0)
+assert(big // 2 > lim)
+assert(-big - 1 < min)
+assert(big - big == 0)
+
+-- for循环走到边界
+let n = 0
+for i = lim - 2, lim, 1 { n = n + 1 }
+assert(n == 3)
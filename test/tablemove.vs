@@ -0,0 +1,26 @@
+-- 增量回收分块遍历大表时插入新key, 碰撞节点被移到空闲位置
+-- 空闲位置可能在已经遍历过的区域, 被移动的值不能漏标
+
+collectgarbage("incremental")
+collectgarbage("setpause", 100)
+collectgarbage("setstepmul", 200)
+
+let lost = 0
+for every = 4, 64, 4 {  -- 不同的回收节奏
+  let t = {}
+  -- 值是只被t引用的表, 新一轮回收开始时都是白色
+  for i = 1, 20000, 1 { t[i + 0.5] = {i} }
+  -- 新key和值都不需要屏障, 只有移动碰撞节点会改动已遍历的区域
+  for i = 20001, 32000, 1 {
+    t[i + 0.5] = true
+    if i % every == 0 { collectgarbage("step") }
+  }
+  while collectgarbage("step") == false { }  -- 完成这一轮回收
+  let junk = {}  -- 重用被错误释放的内存
+  for i = 1, 20000, 1 { junk[i] = {-i} }
+  for i = 1, 20000, 1 {
+    let v = t[i + 0.5]
+    if type(v) ~= "table" or v[1] ~= i + 0 { lost = lost + 1 }
+  }
+}
+assert(lost == 0, "lost values of moved nodes")
@@ -11,6 +11,7 @@
 #include "vgc.h"
 #include "vmem.h"
 #include "vobject.h"
+#include "vprof.h"
 #include "vstate.h"
 #include "vstring.h"
 #include "vtable.h"
@@ -392,6 +393,7 @@ VS_API size_t vs_rawlen (vs_State *L, int idx) {
     case VS_TLNGSTR: return tsvalue(o)->u.lnglen;
     case VS_TUSERDATA: return uvalue(o)->len;
     case VS_TTABLE: return vsH_getn(hvalue(o));
+    case VS_TARRAY: return arrvalue(o)->size;
     default: return 0;
   }
 }
@@ -416,6 +418,17 @@ VS_API void *vs_touserdata (vs_State *L, int idx) {
 }
 
 
+VS_API void *vs_toarray (vs_State *L, int idx, int *etype, size_t *n) {
+  StkId o = index2addr(L, idx);
+  TArray *a;
+  if (!ttisarray(o)) return NULL;  /* not a typed array */
+  a = arrvalue(o);
+  if (etype != NULL) *etype = a->etype;
+  if (n != NULL) *n = a->size;
+  return a->u.b;
+}
+
+
 VS_API vs_State *vs_tothread (vs_State *L, int idx) {
   StkId o = index2addr(L, idx);
   return (!ttisthread(o)) ? NULL : thvalue(o);
@@ -428,6 +441,7 @@ VS_API const void *vs_topointer (vs_State *L, int idx) {
   StkId o = index2addr(L, idx);
   switch (ttype(o)) {
     case VS_TTABLE: return hvalue(o);
+    case VS_TARRAY: return arrvalue(o);
     case VS_TLCL: return clLvalue(o);
     case VS_TCCL: return clCvalue(o);
     case VS_TLCF: return cast(void *, cast(size_t, fvalue(o)));
@@ -622,7 +636,11 @@ VS_API int vs_geti (vs_State *L, int idx, vs_Integer n) {
     setobj2s(L, L->top, slot);
     api_incr_top(L);
   }
-  else vsG_typeerror(L, t, "index");
+  else {
+    setivalue(L->top, n);
+    api_incr_top(L);
+    vsV_finishget(L, t, L->top - 1, L->top - 1);
+  }
 
   return ttnov(L->top - 1);
 }
@@ -653,6 +671,21 @@ VS_API void vs_createtable (vs_State *L, int narray, int nrec) {
 }
 
 
+VS_API void *vs_newarray (vs_State *L, int etype, size_t n) {
+  TArray *a;
+  api_check(L, etype == VS_AINT64 || etype == VS_ADOUBLE || etype == VS_ABYTE,
+            "invalid element type");
+  if (n > cast(size_t, MAX_INT))
+    vsM_toobig(L);
+  a = vsH_newarray(L, etype);
+  setarrvalue(L, L->top, a);
+  api_incr_top(L);
+  vsH_setlength(L, a, cast(unsigned int, n));
+  vsC_checkGC(L);
+  return a->u.b;
+}
+
+
 // 将idx位置用户数据压入栈顶
 VS_API int vs_getuservalue (vs_State *L, int idx) {
   StkId o;
@@ -849,6 +882,213 @@ VS_API int vs_dump (vs_State *L, vs_Writer writer, void *data, int strip) {
 }
 
 
+// 设置之后加载的函数是否经过窥孔优化, 返回之前的设置
+VS_API int vs_setpeephole (vs_State *L, int on) {
+  global_State *g = G(L);
+  int old = g->peephole;
+  g->peephole = (on != 0);
+  return old;
+}
+
+
+// 把堆的快照以json格式写出, 包括每种类型的对象数和字节数以及最大的ntop个表
+// flags包含VS_HEAPEDGES时还写出所有对象和它们之间的引用
+// 返回0或者writer返回的错误码
+VS_API int vs_heapdump (vs_State *L, vs_Writer writer, void *data,
+                        int ntop, int flags) {
+  return vsC_heapdump(L, writer, data, ntop, flags);
+}
+
+
+/* smallest 'gcstepmul' (the collector divides by it) */
+#define MINSTEPMUL	40
+
+/* 'v' limited to [1, max] */
+static int clampgcparam (int v, int max) {
+  return (v < 1) ? 1 : (v > max) ? max : v;
+}
+
+
+/*
+** Garbage-collection function
+*/
+// 切换gc模式,返回切换前的模式
+// VS_GCGEN的额外参数是minormul和majormul,VS_GCINC的额外参数是pause和stepmul
+// 参数为0表示不修改对应的值, 超出范围的值会被截断
+// VS_GCPARALLEL设置并行标记的辅助线程数,返回实际启动的线程数
+VS_API int vs_gc (vs_State *L, int what, ...) {
+  va_list argp;
+  int res = 0;
+  global_State *g = G(L);
+  va_start(argp, what);
+  switch (what) {
+    case VS_GCSTOP: {
+      g->gcrunning = 0;
+      break;
+    }
+    case VS_GCRESTART: {
+      vsE_setdebt(g, 0);
+      g->gcrunning = 1;
+      break;
+    }
+    case VS_GCCOLLECT: {
+      vsC_fullgc(L, 0);
+      break;
+    }
+    case VS_GCCOUNT: {
+      /* GC values are expressed in Kbytes: #bytes/2^10 */
+      res = cast_int(gettotalbytes(g) >> 10);
+      break;
+    }
+    case VS_GCCOUNTB: {
+      res = cast_int(gettotalbytes(g) & 0x3ff);
+      break;
+    }
+    case VS_GCSTEP: {
+      int data = va_arg(argp, int);
+      l_mem debt = 1;  /* =1 to signal that it did an actual step */
+      lu_byte oldrunning = g->gcrunning;
+      g->gcrunning = 1;  /* allow GC to run */
+      if (data == 0) {
+        vsE_setdebt(g, -GCSTEPSIZE);  /* to do a "small" step */
+        vsC_step(L);
+      }
+      else {  /* add 'data' to total debt */
+        debt = cast(l_mem, data) * 1024 + g->GCdebt;
+        vsE_setdebt(g, debt);
+        vsC_checkGC(L);
+      }
+      g->gcrunning = oldrunning;  /* restore previous state */
+      if (debt > 0 && g->gcstate == GCSpause)  /* end of cycle? */
+        res = 1;  /* signal it */
+      break;
+    }
+    case VS_GCSETPAUSE: {
+      int data = va_arg(argp, int);
+      res = g->gcpause;
+      g->gcpause = (data > 0) ? data : 0;
+      break;
+    }
+    case VS_GCSETSTEPMUL: {
+      int data = va_arg(argp, int);
+      res = g->gcstepmul;
+      if (data < MINSTEPMUL) data = MINSTEPMUL;  /* avoid low values (and 0) */
+      g->gcstepmul = data;
+      break;
+    }
+    case VS_GCSTEPTIME: {
+      int usec = va_arg(argp, int);
+      res = vsC_steptime(L, usec);
+      break;
+    }
+    case VS_GCSETSTEPTIME: {
+      int usec = va_arg(argp, int);
+      res = g->gcsteptime;
+      g->gcsteptime = (usec > 0) ? usec : 0;
+      break;
+    }
+    case VS_GCISRUNNING: {
+      res = g->gcrunning;
+      break;
+    }
+    case VS_GCGEN: {
+      int minormul = va_arg(argp, int);
+      int majormul = va_arg(argp, int);
+      res = (g->gckind == KGC_GEN) ? VS_GCGEN : VS_GCINC;
+      if (minormul != 0)
+        g->genminormul = cast_byte(clampgcparam(minormul, MAXGENMINORMUL));
+      if (majormul != 0)
+        setgcparam(g->genmajormul, clampgcparam(majormul, MAXGENMAJORMUL));
+      vsC_changemode(L, KGC_GEN);
+      break;
+    }
+    case VS_GCINC: {
+      int pause = va_arg(argp, int);
+      int stepmul = va_arg(argp, int);
+      res = (g->gckind == KGC_GEN) ? VS_GCGEN : VS_GCINC;
+      if (pause != 0)
+        g->gcpause = (pause > 0) ? pause : 0;
+      if (stepmul != 0)
+        g->gcstepmul = (stepmul > MINSTEPMUL) ? stepmul : MINSTEPMUL;
+      vsC_changemode(L, KGC_INC);
+      break;
+    }
+    case VS_GCPARALLEL: {
+      int n = va_arg(argp, int);
+      res = vsC_setgcworkers(L, n);
+      break;
+    }
+    case VS_GCBGSWEEP: {
+      int on = va_arg(argp, int);
+      res = vsC_setbgsweep(L, on);
+      break;
+    }
+    case VS_GCSTATS: {
+      vs_GCStats *st = va_arg(argp, vs_GCStats *);
+      st->cycles = cast(size_t, g->gccycles);
+      st->freed = cast(size_t, g->gcfreed);
+      st->propagate = g->gctime[GCTPROPAGATE];
+      st->atomic = g->gctime[GCTATOMIC];
+      st->sweep = g->gctime[GCTSWEEP];
+      break;
+    }
+    default: res = -1;  /* invalid option */
+  }
+  va_end(argp);
+  return res;
+}
+
+
+/*
+** Sampling profilers
+*/
+// 每分配rate字节记录一次分配时的调用栈, rate为0时停止采样但保留数据
+// 返回之前的rate
+VS_API size_t vs_allocprof (vs_State *L, size_t rate) {
+  return vsR_allocprof(L, rate);
+}
+
+
+// 写出采样到的分配, what是VS_PROFSTACKS, VS_PROFSITES或VS_PROFFUNCS
+// 可以加上VS_PROFRESET
+VS_API int vs_allocdump (vs_State *L, vs_Writer writer, void *data,
+                         int what) {
+  return vsR_allocdump(L, writer, data, what);
+}
+
+
+// 每usec微秒的处理器时间记录一次调用栈, usec为0时停止采样但保留数据
+// 返回之前的间隔, 无法设置定时器时返回-1
+VS_API int vs_cpuprof (vs_State *L, int usec) {
+  return vsR_cpuprof(L, usec);
+}
+
+
+// 写出CPU采样, what同vs_allocdump, 权重是微秒
+VS_API int vs_cpudump (vs_State *L, vs_Writer writer, void *data,
+                       int what) {
+  return vsR_cpudump(L, writer, data, what);
+}
+
+
+/*
+** Opcode counters
+*/
+// 操作码op执行的次数和花费的周期数写入count和cycles, 返回操作码的名字
+// op超出范围时返回NULL, 编译时没有定义VS_OPCOUNTS时次数都是0
+VS_API const char *vs_opcount (vs_State *L, int op, size_t *count,
+                               size_t *cycles) {
+  return vsR_opcount(L, op, count, cycles);
+}
+
+
+// 操作码op在两个操作数类型分别是tx和ty时执行的次数
+// 类型是VS_TNIL等基本类型(VS_TNUMBER代表整数), VS_OPTFLOAT或VS_OPTNONE
+VS_API size_t vs_optypecount (vs_State *L, int op, int tx, int ty) {
+  return vsR_optypecount(L, op, tx, ty);
+}
+
+
 /*
 ** miscellaneous functions
 */
@@ -865,8 +1105,11 @@ VS_API int vs_next (vs_State *L, int idx) {
   StkId t;
   int more;
   t = index2addr(L, idx);
-  api_check(L, ttistable(t), "table expected");
-  more = vsH_next(L, hvalue(t), L->top - 1);
+  api_check(L, ttistable(t) || ttisarray(t), "table expected");
+  if (ttisarray(t))
+    more = vsH_nextelem(L, arrvalue(t), L->top - 1);
+  else
+    more = vsH_next(L, hvalue(t), L->top - 1);
   if (more) {
     api_incr_top(L);
   }
@@ -908,6 +1151,7 @@ VS_API vs_Alloc vs_getallocf (vs_State *L, void **ud) {
 
 
 VS_API void vs_setallocf (vs_State *L, vs_Alloc f, void *ud) {
+  vsC_waitfrees(L);  /* queued blocks belong to the old allocator */
   G(L)->ud = ud;
   G(L)->frealloc = f;
 }
@@ -703,6 +703,68 @@ VSLIB_API int vsL_loadstring (vs_State *L, const char *s) {
 /* }====================================================== */
 
 
+/*
+** {======================================================
+** Heap snapshot and profiles
+** =======================================================
+*/
+
+static int writeF (vs_State *L, const void *p, size_t size, void *ud) {
+  (void)L;  /* not used */
+  return (fwrite(p, 1, size, (FILE *)ud) != size);
+}
+
+
+// 关闭写出快照或采样的文件, status是写出时的结果
+static int closedump (vs_State *L, FILE *f, const char *filename,
+                                   int status) {
+  if (fclose(f) != 0 || status != 0) {
+    vs_pushfstring(L, "cannot write %s: %s", filename, strerror(errno));
+    return VS_ERRFILE;
+  }
+  return VS_OK;
+}
+
+
+// 把堆的快照写入文件filename, 参数同vs_heapdump
+// 成功返回VS_OK, 失败时压入错误信息并返回VS_ERRFILE
+VSLIB_API int vsL_heapdump (vs_State *L, const char *filename,
+                                         int ntop, int flags) {
+  FILE *f = fopen(filename, "w");
+  int status;
+  if (f == NULL) {
+    vs_pushfstring(L, "cannot open %s: %s", filename, strerror(errno));
+    return VS_ERRFILE;
+  }
+  status = vs_heapdump(L, writeF, f, ntop, flags);
+  return closedump(L, f, filename, status);
+}
+
+
+// 把分配采样写入文件filename, 参数同vs_allocdump
+VSLIB_API int vsL_allocdump (vs_State *L, const char *filename, int what) {
+  FILE *f = fopen(filename, "w");
+  if (f == NULL) {
+    vs_pushfstring(L, "cannot open %s: %s", filename, strerror(errno));
+    return VS_ERRFILE;
+  }
+  return closedump(L, f, filename, vs_allocdump(L, writeF, f, what));
+}
+
+
+// 把CPU采样写入文件filename, 参数同vs_cpudump
+VSLIB_API int vsL_cpudump (vs_State *L, const char *filename, int what) {
+  FILE *f = fopen(filename, "w");
+  if (f == NULL) {
+    vs_pushfstring(L, "cannot open %s: %s", filename, strerror(errno));
+    return VS_ERRFILE;
+  }
+  return closedump(L, f, filename, vs_cpudump(L, writeF, f, what));
+}
+
+/* }====================================================== */
+
+
 VSLIB_API vs_Integer vsL_len (vs_State *L, int idx) {
   vs_Integer l;
   int isnum;
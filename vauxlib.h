@@ -75,6 +75,11 @@ VSLIB_API int (vsL_loadbufferx) (vs_State *L, const char *buff, size_t sz,
                                    const char *name, const char *mode);
 VSLIB_API int (vsL_loadstring) (vs_State *L, const char *s);
 
+VSLIB_API int (vsL_heapdump) (vs_State *L, const char *filename,
+                                int ntop, int flags);
+VSLIB_API int (vsL_allocdump) (vs_State *L, const char *filename, int what);
+VSLIB_API int (vsL_cpudump) (vs_State *L, const char *filename, int what);
+
 VSLIB_API vs_State *(vsL_newstate) (void);
 
 VSLIB_API vs_Integer (vsL_len) (vs_State *L, int idx);
@@ -102,6 +102,89 @@ static int vsB_error (vs_State *L) {
 }
 
 
+static int pushmode (vs_State *L, int oldmode) {
+  vs_pushstring(L, (oldmode == VS_GCINC) ? "incremental" : "generational");
+  return 1;
+}
+
+
+// 返回收集器的累计统计 {cycles, freed, propagate, atomic, sweep}
+static int pushstats (vs_State *L) {
+  vs_GCStats st;
+  vs_gc(L, VS_GCSTATS, &st);
+  vs_createtable(L, 0, 5);
+  vs_pushinteger(L, (vs_Integer)st.cycles);
+  vs_setfield(L, -2, "cycles");
+  vs_pushinteger(L, (vs_Integer)st.freed);
+  vs_setfield(L, -2, "freed");
+  vs_pushnumber(L, (vs_Number)st.propagate);
+  vs_setfield(L, -2, "propagate");
+  vs_pushnumber(L, (vs_Number)st.atomic);
+  vs_setfield(L, -2, "atomic");
+  vs_pushnumber(L, (vs_Number)st.sweep);
+  vs_setfield(L, -2, "sweep");
+  return 1;
+}
+
+
+static int vsB_collectgarbage (vs_State *L) {
+  static const char *const opts[] = {"stop", "restart", "collect",
+    "count", "step", "setpause", "setstepmul",
+    "isrunning", "generational", "incremental", "stats",
+    "steptime", "setsteptime", NULL};
+  static const int optsnum[] = {VS_GCSTOP, VS_GCRESTART, VS_GCCOLLECT,
+    VS_GCCOUNT, VS_GCSTEP, VS_GCSETPAUSE, VS_GCSETSTEPMUL,
+    VS_GCISRUNNING, VS_GCGEN, VS_GCINC, VS_GCSTATS,
+    VS_GCSTEPTIME, VS_GCSETSTEPTIME};
+  int o = optsnum[vsL_checkoption(L, 1, "collect", opts)];
+  switch (o) {
+    case VS_GCCOUNT: {
+      int k = vs_gc(L, o);
+      int b = vs_gc(L, VS_GCCOUNTB);
+      vs_pushnumber(L, (vs_Number)k + ((vs_Number)b/1024));
+      return 1;
+    }
+    case VS_GCSTEP: {
+      int step = (int)vsL_optinteger(L, 2, 0);
+      vs_pushboolean(L, vs_gc(L, o, step));
+      return 1;
+    }
+    case VS_GCSTEPTIME: {
+      int usec = (int)vsL_checkinteger(L, 2);
+      vs_pushboolean(L, vs_gc(L, o, usec));
+      return 1;
+    }
+    case VS_GCSETPAUSE:
+    case VS_GCSETSTEPMUL:
+    case VS_GCSETSTEPTIME: {
+      int p = (int)vsL_optinteger(L, 2, 0);
+      vs_pushinteger(L, vs_gc(L, o, p));
+      return 1;
+    }
+    case VS_GCISRUNNING: {
+      vs_pushboolean(L, vs_gc(L, o));
+      return 1;
+    }
+    case VS_GCGEN: {
+      int minormul = (int)vsL_optinteger(L, 2, 0);
+      int majormul = (int)vsL_optinteger(L, 3, 0);
+      return pushmode(L, vs_gc(L, o, minormul, majormul));
+    }
+    case VS_GCINC: {
+      int pause = (int)vsL_optinteger(L, 2, 0);
+      int stepmul = (int)vsL_optinteger(L, 3, 0);
+      return pushmode(L, vs_gc(L, o, pause, stepmul));
+    }
+    case VS_GCSTATS:
+      return pushstats(L);
+    default: {
+      vs_pushinteger(L, vs_gc(L, o));
+      return 1;
+    }
+  }
+}
+
+
 static int vsB_equal (vs_State *L) {
   vsL_checkany(L, 1);
   vsL_checkany(L, 2);
@@ -378,6 +461,7 @@ static int vsB_tostring (vs_State *L) {
 
 static const vsL_Reg base_funcs[] = {
   {"assert", vsB_assert},
+  {"collectgarbage", vsB_collectgarbage},
   {"dofile", vsB_dofile},
   {"error", vsB_error},
   {"ipairs", vsB_ipairs},
@@ -54,6 +54,22 @@ static int tonumeral(const expdesc *e, TValue *v) {
 }
 
 
+/*
+** Check whether expression 'e' is a small integer constant that fits
+** in a signed 'sC' argument (see OP_ADDI, OP_EQI, etc.); if so,
+** returns 1 and stores its value in '*pi'.
+*/
+// 判断表达式e是不是能放进指令参数sC的小整数常量
+static int isSCint (const expdesc *e, int *pi) {
+  if (e->k != VKINT || hasjumps(e))
+    return 0;
+  if (l_castS2U(e->u.ival) + MAXARG_sC > l_castS2U(2 * MAXARG_sC))
+    return 0;  /* out of range (also covers negative values) */
+  *pi = cast_int(e->u.ival);
+  return 1;
+}
+
+
 /*
 ** Create a OP_LOADNIL instruction, but try to optimize: if the previous
 ** instruction is also OP_LOADNIL and ranges are compatible, adjust
@@ -604,6 +620,17 @@ int vsK_stringK (FuncState *fs, TString *s) {
 }
 
 
+/*
+** Add a float to list of constants and return its index.
+*/
+// 将浮点数加入常量表 返回该浮点数在常量表中的下标
+static int vsK_numberK (FuncState *fs, vs_Number r) {
+  TValue o;
+  setfltvalue(&o, r);
+  return addk(fs, &o, &o);  /* use number itself as key */
+}
+
+
 /*
 ** Add an integer to list of constants and return its index.
 ** Integers use userdata as keys to avoid collision with floats with
@@ -615,22 +642,18 @@ int vsK_stringK (FuncState *fs, TString *s) {
 // 类型转换成'void*'只是用于求哈希不会导致精度损失
 int vsK_intK (FuncState *fs, vs_Integer n) {
   TValue k, o;
+#if defined(VS_NANBOXING)
+  // 装箱的指针只有47位, 超出范围的整数按浮点数保存
+  if (!nbfitsint(n))
+    return vsK_numberK(fs, cast_num(n));
+  setpvalue(&k, cast(void*, cast(size_t, l_castS2U(n) & NB_PAYLOAD)));
+#else
   setpvalue(&k, cast(void*, cast(size_t, n)));
+#endif
   setivalue(&o, n);
   return addk(fs, &k, &o);
 }
 
-/*
-** Add a float to list of constants and return its index.
-*/
-// 将浮点数加入常量表 返回该浮点数在常量表中的下标
-static int vsK_numberK (FuncState *fs, vs_Number r) {
-  TValue o;
-  setfltvalue(&o, r);
-  return addk(fs, &o, &o);  /* use number itself as key */
-}
-
-
 /*
 ** Add a boolean to list of constants and return its index.
 */
@@ -656,6 +679,18 @@ static int nilK (FuncState *fs) {
 }
 
 
+/*
+** Add the initializer of a typed array literal to list of constants and
+** return its index. Every literal gets its own constant, so the array
+** itself is the key.
+*/
+int vsK_arrayK (FuncState *fs, TArray *a) {
+  TValue o;
+  setarrvalue(fs->ls->L, &o, a);
+  return addk(fs, &o, &o);
+}
+
+
 /*
 ** Fix an expression to return the number of results 'nresults'.
 ** Either 'e' is a multi-ret expression (function call or vararg)
@@ -1410,9 +1445,31 @@ static void codeunexpval (FuncState *fs, OpCode op, expdesc *e, int line) {
 // 计算指令的结果不知道保存到哪里所以最终类型是VRELOCABLE
 static void codebinexpval (FuncState *fs, OpCode op,
                            expdesc *e1, expdesc *e2, int line) {
+  int rk1, rk2, imm;
+  // a+k,a-k和k+a 其中k是小整数常量 生成OP_ADDI,VM只需检查一个操作数
+  // a-0不能改成a+0: a是-0.0时前者是-0.0 后者是0.0
+  if (op == OP_ADD || op == OP_SUB) {
+    if (isSCint(e2, &imm) && e1->k == VNONRELOC &&
+        !(op == OP_SUB && imm == 0)) {
+      freeexp(fs, e1);
+      e1->u.info = vsK_codeABC(fs, OP_ADDI, 0, e1->u.info,
+                               (op == OP_ADD ? imm : -imm) + MAXARG_sC);
+      e1->k = VRELOCABLE;
+      vsK_fixline(fs, line);
+      return;
+    }
+    if (op == OP_ADD && isSCint(e1, &imm)) {
+      int r2 = vsK_exp2anyreg(fs, e2);
+      freeexp(fs, e2);
+      e1->u.info = vsK_codeABC(fs, OP_ADDI, 0, r2, imm + MAXARG_sC);
+      e1->k = VRELOCABLE;
+      vsK_fixline(fs, line);
+      return;
+    }
+  }
   // 先将两个操作数保存到RK中
-  int rk2 = vsK_exp2RK(fs, e2);  /* both operands are "RK" */
-  int rk1 = vsK_exp2RK(fs, e1);
+  rk2 = vsK_exp2RK(fs, e2);  /* both operands are "RK" */
+  rk1 = vsK_exp2RK(fs, e1);
   // 保存的操作数只是中间值,最终不需要
   freeexps(fs, e1, e2);
   e1->u.info = vsK_codeABC(fs, op, 0, rk1, rk2);  /* generate opcode */
@@ -1421,9 +1478,34 @@ static void codebinexpval (FuncState *fs, OpCode op,
 }
 
 
+/*
+** Emit code for a comparison between register 'r' and the small
+** integer 'imm'. If 'inv' is true, the constant was the left operand,
+** so the order of the comparison is inverted. Return jump position.
+*/
+// 生成OP_EQI,OP_LTI,OP_LEI,OP_GTI,OP_GEI之一以及一条跳转指令
+// inv为1说明常量在左边 例如1<a 转换成a>1
+static int codecompimm (FuncState *fs, BinOpr opr, int r, int imm, int inv) {
+  OpCode op;
+  int cond = 1;
+  switch (opr) {
+    case OPR_NE: cond = 0;  /* '(a ~= k)' ==> 'not (a == k)' */
+      /* FALLTHROUGH */
+    case OPR_EQ: op = OP_EQI; break;
+    case OPR_LT: op = inv ? OP_GTI : OP_LTI; break;
+    case OPR_LE: op = inv ? OP_GEI : OP_LEI; break;
+    case OPR_GT: op = inv ? OP_LTI : OP_GTI; break;
+    case OPR_GE: op = inv ? OP_LEI : OP_GEI; break;
+    default: vs_assert(0); op = OP_EQI;  /* to avoid warnings */
+  }
+  return condjump(fs, op, cond, r, imm + MAXARG_sC);
+}
+
+
 /*
 ** Emit code for comparisons.
-** 'e1' was already put in R/K form by 'vsK_infix'.
+** 'e1' was already put in R/K form by 'vsK_infix', unless it is
+** a numeral (which may become an immediate operand).
 */
 // 根据操作符对表达式e1和e2生成比较指令OP_EQ,OP_LT,OP_LE和一条跳转指令
 // 输入是e1已经在RK中,该函数也将e2存入RK中
@@ -1432,13 +1514,27 @@ static void codebinexpval (FuncState *fs, OpCode op,
 // 操作符包括 ~=,>,>=,==,<,<=
 // e1已经通过vsK_infix保存在寄存器或者常量表中
 static void codecomp (FuncState *fs, BinOpr opr, expdesc *e1, expdesc *e2) {
+  int rk1, rk2, imm;
+  // 一边是寄存器另一边是小整数常量 生成OP_EQI等立即数比较指令
+  if (isSCint(e2, &imm) && e1->k == VNONRELOC) {
+    freeexp(fs, e1);
+    e1->u.info = codecompimm(fs, opr, e1->u.info, imm, 0);
+    e1->k = VJMP;
+    return;
+  }
+  // 将e2存进RK中 获取位置
+  rk2 = vsK_exp2RK(fs, e2);
+  if (isSCint(e1, &imm) && !ISK(rk2)) {  /* 'k op a' ==> 'a op-inverted k' */
+    freeexp(fs, e2);
+    e1->u.info = codecompimm(fs, opr, rk2, imm, 1);
+    e1->k = VJMP;
+    return;
+  }
   // e1->k == VK说明保存在常量表中
   // e1->k == VNONRELOC说明保存在寄存器中
+  // 数字常量在vsK_infix中没有放入RK 这里再放入
   // 获取e1实际值存放的位置
-  int rk1 = (e1->k == VK) ? RKASK(e1->u.info)
-                          : check_exp(e1->k == VNONRELOC, e1->u.info);
-  // 将e2也存进RK中 获取位置
-  int rk2 = vsK_exp2RK(fs, e2);
+  rk1 = vsK_exp2RK(fs, e1);
   freeexps(fs, e1, e2);
   switch (opr) {
     case OPR_NE: {  /* '(a ~= b)' ==> 'not (a == b)' */
@@ -1534,6 +1630,13 @@ void vsK_infix (FuncState *fs, BinOpr op, expdesc *v) {
       // 能转换成数字 这两个操作数可能会被合并
       break;
     }
+    case OPR_EQ: case OPR_LT: case OPR_LE:
+    case OPR_NE: case OPR_GT: case OPR_GE: {
+      // 比较运算的数字常量也先保留 可能作为立即数生成OP_EQI等指令
+      if (!tonumeral(v, NULL))
+        vsK_exp2RK(fs, v);
+      break;
+    }
     default: {
       vsK_exp2RK(fs, v);  // 其他操作符直接把值放入RK中
       break;
@@ -1659,3 +1762,289 @@ void vsK_setlist (FuncState *fs, int base, int nelems, int tostore) {
   fs->freereg = base + 1;  /* free registers with list values */
 }
 
+
+
+/*
+** Return the destination of jump instruction 'i' at position 'pc'
+** (any instruction with a 'sBx' offset), or -1 if 'i' does not jump.
+*/
+// 计算跳转指令的目标位置 不是跳转指令返回-1
+static int jumpdest (Instruction i, int pc) {
+  switch (GET_OPCODE(i)) {
+    case OP_JMP: case OP_FORLOOP: case OP_FORPREP: case OP_TFORLOOP:
+      return pc + 1 + GETARG_sBx(i);
+    default: return -1;
+  }
+}
+
+
+/*
+** Check whether test instruction 'i' has a fused form.
+*/
+// OP_TESTSET还要设置寄存器 不能融合
+// OP_LT,OP_LE的第一个操作数必须是寄存器,OP_EQ可以交换两个操作数
+static int canfuse (Instruction i) {
+  switch (GET_OPCODE(i)) {
+    case OP_EQ: return !ISK(GETARG_B(i)) || !ISK(GETARG_C(i));
+    case OP_LT: case OP_LE: return !ISK(GETARG_B(i));
+    case OP_EQI: case OP_LTI: case OP_LEI: case OP_GTI: case OP_GEI:
+    case OP_TEST: return 1;
+    default: return 0;
+  }
+}
+
+
+/*
+** Build the fused jump for test instruction 'i' whose following
+** OP_JMP goes 'offset' instructions after the fused one.
+*/
+static Instruction fusejump (Instruction i, int offset) {
+  OpCode op = GET_OPCODE(i);
+  int a = GETARG_A(i);
+  int b = GETARG_B(i);
+  int c = GETARG_C(i);
+  vs_assert(canfuse(i) && -MAXARG_sJ <= offset && offset <= MAXARG_sJ);
+  if (op == OP_TEST)
+    return CREATE_ABC(OP_JTEST, a, 0, CREATE_kJ(c, offset));
+  if (op == OP_EQ && ISK(b)) {  /* 'k == a' ==> 'a == k' */
+    int t = b; b = c; c = t;
+  }
+  // 比较指令的A就是条件k,B和C变成融合指令的A和B  ORDER OP
+  if (op <= OP_LE)
+    op = cast(OpCode, (op - OP_EQ) + OP_JEQ);
+  else
+    op = cast(OpCode, (op - OP_EQI) + OP_JEQI);
+  return CREATE_ABC(op, b, c, CREATE_kJ(a, offset));
+}
+
+
+#define JTARGET		1  /* some instruction may jump here */
+#define JREMOVED	2  /* instruction is not part of the final code */
+#define JREACHED	4  /* instruction is reachable from the function entry */
+
+
+/*
+** Check whether instruction 'i' may skip the next one, which therefore
+** cannot be removed (nor moved).
+*/
+// 测试指令和C不为0的OP_LOADBOOL会跳过下一条指令
+static int isskip (Instruction i) {
+  return testTMode(GET_OPCODE(i)) ||
+         (GET_OPCODE(i) == OP_LOADBOOL && GETARG_C(i));
+}
+
+
+/*
+** Jump threading: make each OP_JMP that goes to a plain OP_JMP (one
+** that closes no upvalues) go directly to the final destination.
+*/
+// 跳转到跳转指令的OP_JMP直接跳转到最终位置 count用于避免死循环中的跳转链
+static void threadjumps (Instruction *code, int n) {
+  int pc;
+  for (pc = 0; pc < n; pc++) {
+    if (GET_OPCODE(code[pc]) == OP_JMP) {
+      int dest = jumpdest(code[pc], pc);
+      int count = 0;
+      while (GET_OPCODE(code[dest]) == OP_JMP && GETARG_A(code[dest]) == 0 &&
+             count++ < n)
+        dest = jumpdest(code[dest], dest);
+      SETARG_sBx(code[pc], dest - (pc + 1));
+    }
+  }
+}
+
+
+/*
+** Mark with JREACHED every instruction reachable from the entry point;
+** 'stack' must have room for 'n' positions.
+*/
+// 从第一条指令开始沿着所有可能的执行路径标记可达的指令
+static void markreachable (const Instruction *code, int n, int *flags,
+                           int *stack) {
+  int top = 0;
+  flags[0] |= JREACHED;
+  stack[top++] = 0;
+  while (top > 0) {
+    int pc = stack[--top];
+    Instruction i = code[pc];
+    int succ[3];
+    int ns = 0, k;
+    switch (GET_OPCODE(i)) {
+      case OP_JMP: succ[ns++] = jumpdest(i, pc); break;
+      case OP_RETURN: break;
+      case OP_LOADBOOL: succ[ns++] = pc + 1 + (GETARG_C(i) != 0); break;
+      case OP_FORPREP:  /* integer loop may skip its OP_FORLOOP */
+        succ[ns++] = jumpdest(i, pc) + 1;
+        /* FALLTHROUGH */
+      case OP_FORLOOP: case OP_TFORLOOP:
+        succ[ns++] = jumpdest(i, pc);
+        succ[ns++] = pc + 1;
+        break;
+      default:
+        succ[ns++] = pc + 1;
+        if (testTMode(GET_OPCODE(i)))  /* may skip the following jump */
+          succ[ns++] = pc + 2;
+        break;
+    }
+    for (k = 0; k < ns; k++) {
+      if (succ[k] < n && !(flags[succ[k]] & JREACHED)) {
+        flags[succ[k]] |= JREACHED;
+        stack[top++] = succ[k];
+      }
+    }
+  }
+}
+
+
+/*
+** Peephole simplifications over the instructions that survived dead
+** code elimination. 'last' is the previous instruction kept and 'fixed'
+** tells whether it follows a skip (and so must stay where it is).
+*/
+// 删除自己到自己和来回的OP_MOVE,被下一条OP_MOVE覆盖的OP_MOVE
+// 合并相邻的OP_LOADNIL,删除跳转到下一条指令的OP_JMP
+static void simplify (Instruction *code, int n, int *flags) {
+  int pc, d;
+  int last = -1, fixed = 0;
+  for (pc = 0; pc < n; pc++) {
+    Instruction i = code[pc];
+    int prevskip = (last >= 0 && isskip(code[last]));
+    if (flags[pc] & JREMOVED) {
+      if (!prevskip)
+        continue;
+      flags[pc] &= ~JREMOVED;  /* keep what a skip lands on */
+    }
+    if (!prevskip && last >= 0) {
+      Instruction li = code[last];
+      if (GET_OPCODE(i) == OP_MOVE) {
+        if (GETARG_A(i) == GETARG_B(i) ||  /* 'MOVE A A' */
+            (GET_OPCODE(li) == OP_MOVE && !(flags[pc] & JTARGET) &&
+             GETARG_A(li) == GETARG_B(i) && GETARG_B(li) == GETARG_A(i))) {
+          flags[pc] |= JREMOVED;  /* 'MOVE A B; MOVE B A' */
+          continue;
+        }
+        if (GET_OPCODE(li) == OP_MOVE && !fixed &&
+            GETARG_A(li) == GETARG_A(i))  /* 'MOVE A B; MOVE A C' */
+          flags[last] |= JREMOVED;
+      }
+      else if (GET_OPCODE(i) == OP_LOADNIL && GET_OPCODE(li) == OP_LOADNIL &&
+               !(flags[pc] & JTARGET)) {
+        int l1 = GETARG_A(li), l2 = l1 + GETARG_B(li);
+        int f2 = GETARG_A(i), t2 = f2 + GETARG_B(i);
+        if (f2 <= l2 + 1 && l1 <= t2 + 1) {  /* can connect both? */
+          if (f2 < l1) l1 = f2;
+          if (t2 > l2) l2 = t2;
+          SETARG_A(code[last], l1);
+          SETARG_B(code[last], l2 - l1);
+          flags[pc] |= JREMOVED;
+          continue;
+        }
+      }
+    }
+    fixed = prevskip;
+    last = pc;
+  }
+  // 跳转目标之前的指令全部被删除了 OP_JMP就是跳转到下一条指令
+  for (pc = 0, last = -1; pc < n; pc++) {
+    Instruction i = code[pc];
+    if (flags[pc] & JREMOVED)
+      continue;
+    if (GET_OPCODE(i) == OP_JMP && GETARG_A(i) == 0 &&
+        !(last >= 0 && isskip(code[last]))) {
+      int dest = jumpdest(i, pc);
+      for (d = pc + 1; d < dest && (flags[d] & JREMOVED); d++) ;
+      if (d == dest && dest > pc) {
+        flags[pc] |= JREMOVED;
+        continue;
+      }
+    }
+    last = pc;
+  }
+}
+
+
+/*
+** Final pass over the code of a function. If the peephole optimizer is
+** on, thread jumps, remove unreachable code and simplify MOVE, LOADNIL
+** and JMP sequences. Then merge each test instruction and the OP_JMP
+** that follows it into a fused jump when the offset fits in 'sJ', and
+** relocate jumps, line information and local variable ranges to the
+** compacted code.
+*/
+// 函数编译结束时调用 此后不会再有跳转链需要回填
+// pos数组先记录每条指令的标记 再原地转换成每条指令的新位置
+void vsK_finish (FuncState *fs) {
+  vs_State *L = fs->ls->L;
+  Proto *f = fs->f;
+  Instruction *code = f->code;
+  int n = fs->pc;
+  int *pos = vsM_newvector(L, n + 1, int);
+  int pc, d, count;
+  for (pc = 0; pc <= n; pc++)
+    pos[pc] = 0;
+  if (G(L)->peephole) {
+    int *stack = vsM_newvector(L, n, int);
+    threadjumps(code, n);
+    markreachable(code, n, pos, stack);
+    vsM_freearray(L, stack, n);
+    for (pc = 0; pc < n; pc++) {
+      if (!(pos[pc] & JREACHED))
+        pos[pc] |= JREMOVED;  /* dead code */
+    }
+  }
+  // 标记所有跳转目标 被跳转到的指令不能随便删除
+  for (pc = 0; pc < n; pc++) {
+    Instruction i = code[pc];
+    if (pos[pc] & JREMOVED)
+      continue;
+    if ((d = jumpdest(i, pc)) >= 0) {
+      pos[d] |= JTARGET;
+      if (GET_OPCODE(i) == OP_FORPREP)  /* may also skip the OP_FORLOOP */
+        pos[d + 1] |= JTARGET;
+    }
+    else if (GET_OPCODE(i) == OP_LOADBOOL && GETARG_C(i))
+      pos[pc + 2] |= JTARGET;
+  }
+  if (G(L)->peephole)
+    simplify(code, n, pos);
+  // 选出可以融合的测试指令 删除它后面的OP_JMP
+  // 删除指令只会缩短跳转距离,所以旧代码中能放进sJ的偏移在新代码中也能放下
+  for (pc = 0; pc < n - 1; pc++) {
+    if (!(pos[pc] & JREMOVED) && testTMode(GET_OPCODE(code[pc]))) {
+      Instruction jmp = code[++pc];
+      int offset;
+      vs_assert(GET_OPCODE(jmp) == OP_JMP && !(pos[pc] & JREMOVED));
+      offset = jumpdest(jmp, pc) - pc;
+      if (GETARG_A(jmp) == 0 && !(pos[pc] & JTARGET) &&
+          -MAXARG_sJ <= offset && offset <= MAXARG_sJ && canfuse(code[pc - 1]))
+        pos[pc] |= JREMOVED;
+    }
+  }
+  // 计算每条指令的新位置 pos[pc] == pos[pc+1]说明pc被删除了
+  for (pc = 0, count = 0; pc <= n; pc++) {
+    int flags = pos[pc];
+    pos[pc] = count;
+    if (!(flags & JREMOVED))
+      count++;
+  }
+  // 原地压缩代码 新位置不会超过旧位置
+  for (pc = 0; pc < n; pc++) {
+    Instruction i = code[pc];
+    if (pos[pc] == pos[pc + 1])  /* removed? */
+      continue;
+    if (testTMode(GET_OPCODE(i)) && pos[pc + 1] == pos[pc + 2]) {  /* fused? */
+      d = jumpdest(code[pc + 1], pc + 1);
+      i = fusejump(i, pos[d] - pos[pc] - 1);
+    }
+    else if ((d = jumpdest(i, pc)) >= 0)
+      SETARG_sBx(i, pos[d] - pos[pc] - 1);
+    code[pos[pc]] = i;
+    f->lineinfo[pos[pc]] = f->lineinfo[pc];
+  }
+  for (d = 0; d < fs->nlocvars; d++) {
+    f->locvars[d].startpc = pos[f->locvars[d].startpc];
+    f->locvars[d].endpc = pos[f->locvars[d].endpc];
+  }
+  fs->pc = pos[n];
+  vsM_freearray(L, pos, n + 1);
+}
@@ -59,6 +59,7 @@ VSI_FUNC void vsK_reserveregs (FuncState *fs, int n);
 VSI_FUNC void vsK_checkstack (FuncState *fs, int n);
 VSI_FUNC int vsK_stringK (FuncState *fs, TString *s);
 VSI_FUNC int vsK_intK (FuncState *fs, vs_Integer n);
+VSI_FUNC int vsK_arrayK (FuncState *fs, TArray *a);
 VSI_FUNC void vsK_dischargevars (FuncState *fs, expdesc *e);
 VSI_FUNC int vsK_exp2anyreg (FuncState *fs, expdesc *e);
 VSI_FUNC void vsK_exp2anyregup (FuncState *fs, expdesc *e);
@@ -84,6 +85,7 @@ VSI_FUNC void vsK_infix (FuncState *fs, BinOpr op, expdesc *v);
 VSI_FUNC void vsK_posfix (FuncState *fs, BinOpr op, expdesc *v1,
                             expdesc *v2, int line);
 VSI_FUNC void vsK_setlist (FuncState *fs, int base, int nelems, int tostore);
+VSI_FUNC void vsK_finish (FuncState *fs);
 
 
 #endif
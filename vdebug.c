@@ -346,8 +346,11 @@ static int findsetreg (Proto *p, int lastpc, int reg) {
           setreg = filterpc(pc, jmptarget);
         break;
       }
-      case OP_JMP: {
-        int b = GETARG_sBx(i);
+      case OP_JMP:
+      case OP_JEQ: case OP_JLT: case OP_JLE:
+      case OP_JEQI: case OP_JLTI: case OP_JLEI: case OP_JGTI: case OP_JGEI:
+      case OP_JTEST: {
+        int b = (op == OP_JMP) ? GETARG_sBx(i) : GETARG_sJ(i);
         int dest = pc + 1 + b;
         /* jump is forward and do not skip 'lastpc'? */
         if (pc < dest && dest <= lastpc) {
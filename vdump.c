@@ -7,6 +7,7 @@
 
 #include "vobject.h"
 #include "vstate.h"
+#include "vtable.h"
 #include "vundump.h"
 
 
@@ -107,6 +108,13 @@ static void DumpConstants (const Proto *f, DumpState *D) {
     case VS_TLNGSTR:
       DumpString(tsvalue(o), D);
       break;
+    case VS_TARRAY: {  /* initializer of a typed array */
+      const TArray *a = arrvalue(o);
+      DumpByte(a->etype, D);
+      DumpInt(a->size, D);
+      DumpBlock(a->u.b, a->size * elemsize(a->etype), D);
+      break;
+    }
     default:
       vs_assert(0);
     }
@@ -14,6 +14,7 @@
 #include "vgc.h"
 #include "vmem.h"
 #include "vobject.h"
+#include "vopcodes.h"
 #include "vstate.h"
 
 
@@ -113,6 +114,15 @@ Proto *vsF_newproto (vs_State *L) {
   f->sizep = 0;
   f->code = NULL;
   f->cache = NULL;
+  f->tcache = NULL;
+  f->sizetcache = 0;
+#if defined(VS_SHAPES)
+  f->scache = NULL;
+  f->sizescache = 0;
+#endif
+#if defined(VS_OPCOUNTS)
+  f->opcount = NULL;
+#endif
   f->sizecode = 0;
   f->lineinfo = NULL;
   f->sizelineinfo = 0;
@@ -139,10 +149,65 @@ void vsF_freeproto (vs_State *L, Proto *f) {
   vsM_freearray(L, f->lineinfo, f->sizelineinfo);
   vsM_freearray(L, f->locvars, f->sizelocvars);
   vsM_freearray(L, f->upvalues, f->sizeupvalues);
+  vsM_freearray(L, f->tcache, f->sizetcache);
+#if defined(VS_SHAPES)
+  vsM_freearray(L, f->scache, f->sizescache);
+#endif
+#if defined(VS_OPCOUNTS)
+  vsM_freearray(L, f->opcount, f->opcount ? f->sizecode : 0);
+#endif
   vsM_free(L, f);
 }
 
 
+#if defined(VS_SHAPES)
+/*
+** caches of OP_GETTABLE/OP_SETTABLE/OP_SELF; they are used only when
+** the key is a constant short string and the table is a record
+*/
+static void initscache (vs_State *L, Proto *f) {
+  int pc;
+  for (pc = 0; pc < f->sizecode; pc++) {
+    OpCode op = GET_OPCODE(f->code[pc]);
+    if (op == OP_GETTABLE || op == OP_SETTABLE || op == OP_SELF) {
+      f->scache = vsM_newvector(L, f->sizecode, ShapeCache);
+      f->sizescache = f->sizecode;
+      for (pc = 0; pc < f->sizescache; pc++) {
+        f->scache[pc].id = 0;  /* no shape has id 0 */
+        f->scache[pc].slot = 0;
+      }
+      return;
+    }
+  }
+}
+#endif
+
+
+/*
+** create the inline caches of a finished prototype; only functions
+** that access tables through upvalues (usually '_ENV') need them
+*/
+// 为函数原型中的OP_GETTABUP/OP_SETTABUP指令创建内联缓存
+// 缓存按pc索引, 每一项是上次查找到的Node在哈希部分中的下标
+void vsF_inittcache (vs_State *L, Proto *f) {
+  int pc;
+  vs_assert(f->tcache == NULL);
+#if defined(VS_SHAPES)
+  initscache(L, f);
+#endif
+  for (pc = 0; pc < f->sizecode; pc++) {
+    OpCode op = GET_OPCODE(f->code[pc]);
+    if (op == OP_GETTABUP || op == OP_SETTABUP) {
+      f->tcache = vsM_newvector(L, f->sizecode, int);
+      f->sizetcache = f->sizecode;
+      for (pc = 0; pc < f->sizetcache; pc++)
+        f->tcache[pc] = 0;
+      return;
+    }
+  }
+}
+
+
 /*
 ** Look for n-th local variable at line 'line' in function 'func'.
 ** Returns NULL if not found.
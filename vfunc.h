@@ -53,6 +53,7 @@ VSI_FUNC void vsF_initupvals (vs_State *L, LClosure *cl);
 VSI_FUNC UpVal *vsF_findupval (vs_State *L, StkId level);
 VSI_FUNC void vsF_close (vs_State *L, StkId level);
 VSI_FUNC void vsF_freeproto (vs_State *L, Proto *f);
+VSI_FUNC void vsF_inittcache (vs_State *L, Proto *f);
 VSI_FUNC const char *vsF_getlocalname (const Proto *func, int local_number,
                                          int pc);
 
@@ -1,6 +1,11 @@
 #define vgc_c
 
 #include <string.h>
+#include <time.h>
+
+#if defined(VS_PARALLELMARK) || defined(VS_BGSWEEP)
+#include <pthread.h>
+#endif
 
 #include "vs.h"
 
@@ -10,6 +15,7 @@
 #include "vgc.h"
 #include "vmem.h"
 #include "vobject.h"
+#include "vprof.h"
 #include "vstate.h"
 #include "vstring.h"
 #include "vtable.h"
@@ -35,6 +41,23 @@
 /* cost of calling one finalizer */
 #define GCFINALIZECOST	GCSWEEPCOST
 
+/* single steps between clock checks in time-budgeted steps */
+#define GCCLOCKSTEPS	16
+
+/* phase (in 'gctime') of a collector state */
+#define gcphase(s)	((s) == GCSatomic ? GCTATOMIC : \
+			 ((s) >= GCSswpallgc && (s) <= GCSswpend) ? GCTSWEEP : \
+			 GCTPROPAGATE)
+
+/*
+** tables with more slots than this are traversed in chunks of this
+** many slots by the incremental collector
+*/
+#define GCTABLECHUNK	1024
+
+/* number of dirty cards of a table (one bit of 'gcdirty' each) */
+#define GCCARDS		(cast_int(sizeof(lu_mem)) * CHAR_BIT)
+
 
 /*
 ** macro to adjust 'stepmul': 'stepmul' is actually used like
@@ -56,6 +79,21 @@
 */
 // 颜色位为0,其他位为1
 #define maskcolors	(~(bitmask(BLACKBIT) | WHITEBITS))
+// 颜色位和年龄位为0,其他位为1
+#define maskgcbits	(maskcolors & ~AGEBITS)
+
+
+/*
+** turn on/off the queueing of blocks freed by a sweep for the
+** background sweeper (never in emergency collections, which need the
+** memory back at once)
+*/
+#if defined(VS_BGSWEEP)
+#define deferfrees(g,on)  ((g)->gcdeferfree = cast_byte((on) && \
+	(g)->gcsweeper != NULL && !(g)->gcemergency))
+#else
+#define deferfrees(g,on)	((void)0)
+#endif
 // 清除x的所有颜色,然后设置x的颜色为当前白
 #define makewhite(g,x)	\
  (x->marked = cast_byte((x->marked & maskcolors) | vsC_white(g)))
@@ -95,6 +133,28 @@
 static void reallymarkobject (global_State *g, GCObject *o);
 
 
+/*
+** 'claimobject' turns a white object gray and returns true. With
+** parallel marking, several markers may find the same white object;
+** only the one that wins the compare-and-swap links it into its gray
+** list.
+*/
+#if defined(VS_PARALLELMARK)
+static int claimobject (GCObject *o) {
+  lu_byte m = __atomic_load_n(&o->marked, __ATOMIC_RELAXED);
+  while (m & WHITEBITS) {
+    if (__atomic_compare_exchange_n(&o->marked, &m,
+                                    cast_byte(m & ~WHITEBITS), 1,
+                                    __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+      return 1;
+  }
+  return 0;
+}
+#else
+#define claimobject(o)	(white2gray(o), 1)
+#endif
+
+
 /*
 ** {======================================================
 ** Generic functions
@@ -108,6 +168,69 @@ static void reallymarkobject (global_State *g, GCObject *o);
 // 获取表哈希部分最后一个的下一个
 #define gnodelast(h)	gnode(h, cast(size_t, sizenode(h)))
 
+/* memory used by a prototype and by a thread */
+#define sizeproto(f)	(sizeof(Proto) + sizeof(Instruction) * (f)->sizecode + \
+			 sizeof(Proto *) * (f)->sizep + \
+			 sizeof(TValue) * (f)->sizek + \
+			 sizeof(int) * (f)->sizelineinfo + \
+			 sizeof(LocVar) * (f)->sizelocvars + \
+			 sizeof(Upvaldesc) * (f)->sizeupvalues + \
+			 sizeof(int) * (f)->sizetcache + sizescache(f))
+
+#define sizethread(th)	(sizeof(vs_State) + sizeof(TValue) * (th)->stacksize + \
+			 sizeof(CallInfo) * (th)->nci)
+
+#if defined(VS_SHAPES)
+#define sizescache(f)	(sizeof(ShapeCache) * (f)->sizescache)
+#define sizeslots(h)	(sizeof(TValue) * (h)->sizeslots)
+#else
+#define sizescache(f)	0
+#define sizeslots(h)	0
+#endif
+
+/* memory used by a table */
+#define sizetable(h)	(sizeof(Table) + sizeof(TValue) * (h)->sizearray + \
+			 sizehash(h) + sizeslots(h) + sizerehash(h))
+
+/* memory used by a typed array */
+#define sizetarray(a)	(sizeof(TArray) + elemsize((a)->etype) * (a)->sizealloc)
+
+/* number of slots (array part, hash part and part being moved) of a table */
+#define tablesize(h)	((h)->sizearray + \
+			 cast(unsigned int, sizenode(h) + sizemoving(h)))
+
+#define largetable(h)	(tablesize(h) > GCTABLECHUNK)
+
+/* number of slots in each card of a table with 'n' slots */
+#define cardsize(n)	(((n) + GCCARDS - 1) / GCCARDS)
+
+
+/* the card of table 't' holding 'slot' (all cards if unknown) */
+static lu_mem cardof (Table *t, const TValue *slot) {
+  unsigned int i;
+  if (slot == NULL)
+    return ~(lu_mem)0;
+  else if (slot >= t->array && slot < t->array + t->sizearray)
+    i = cast(unsigned int, slot - t->array);
+#if defined(VS_SHAPES)
+  else if (slot >= t->slots && slot < t->slots + t->sizeslots)
+    i = 0;  /* slots of a record are traversed with the first card */
+#endif
+  else if (!isdummy(t) && cast(const char *, slot) >= cast(char *, t->node) &&
+           cast(const char *, slot) < cast(char *, gnodelast(t)))
+    i = t->sizearray + cast(unsigned int, (cast(const char *, slot) -
+                                   cast(char *, t->node)) / sizeof(Node));
+  else if (ismoving(t) &&
+           cast(const char *, slot) >= cast(char *, t->rh->old.node) &&
+           cast(const char *, slot) < cast(char *, gnodelast(&t->rh->old)))
+    i = t->sizearray + cast(unsigned int, sizenode(t)) +
+        cast(unsigned int, (cast(const char *, slot) -
+                            cast(char *, t->rh->old.node)) / sizeof(Node));
+  else
+    return ~(lu_mem)0;
+  return (lu_mem)1 << (i / cardsize(tablesize(t)));
+}
+
 
 /*
 ** link collectable object 'o' into list pointed by 'p'
@@ -116,6 +239,21 @@ static void reallymarkobject (global_State *g, GCObject *o);
 #define linkgclist(o,p)	((o)->gclist = (p), (p) = obj2gco(o))
 
 
+/*
+** Return the 'gclist' field of objects that can be in a gray list
+*/
+static GCObject **getgclist (GCObject *o) {
+  switch (o->tt) {
+    case VS_TTABLE: return &gco2t(o)->gclist;
+    case VS_TLCL: return &gco2lcl(o)->gclist;
+    case VS_TCCL: return &gco2ccl(o)->gclist;
+    case VS_TTHREAD: return &gco2th(o)->gclist;
+    case VS_TPROTO: return &gco2p(o)->gclist;
+    default: vs_assert(0); return NULL;
+  }
+}
+
+
 /*
 ** If key is not marked, mark its entry as dead. This allows key to be
 ** collected, but keeps its entry in the table.  A dead node is needed
@@ -149,8 +287,14 @@ void vsC_barrier_ (vs_State *L, GCObject *o, GCObject *v) {
   global_State *g = G(L);
   vs_assert(isblack(o) && iswhite(v) && !isdead(g, v) && !isdead(g, o));
   // 传播或原子阶段标记v
-  if (keepinvariant(g))  /* must keep invariant? */
+  if (keepinvariant(g)) {  /* must keep invariant? */
     reallymarkobject(g, v);  /* restore invariant */
+    // 分代模式下老对象不会再被遍历,所以它指向的对象也要变老
+    if (isold(o)) {
+      vs_assert(!isold(v));  /* white object could not be old */
+      setage(v, G_OLD0);  /* restore generational invariant */
+    }
+  }
   // 清扫阶段已经从旧白变成了新白
   // 设置父对象o为新白,避免在清扫阶段被清扫,等到下一轮再处理
   // ??
@@ -167,11 +311,26 @@ void vsC_barrier_ (vs_State *L, GCObject *o, GCObject *v) {
 */
 // 调用barrierback的父对象一定是表对象
 // 该函数直接将父对象的表设置为灰色
-void vsC_barrierback_ (vs_State *L, Table *t) {
+// 分代模式下黑色的表一定是老对象,标记为G_TOUCHED1让下次次回收重新遍历它
+// 增量模式下的大表保持黑色,只记录被修改的区域(card),原子阶段只重新遍历这些区域
+void vsC_barrierback_ (vs_State *L, Table *t, const TValue *slot) {
   global_State *g = G(L);
   vs_assert(isblack(t) && !isdead(g, t));
+  if (g->gckind == KGC_INC &&
+      (t->gcflags != 0 || t->gcdirty != 0 || largetable(t))) {
+    /* not in a gray list yet? ('gray' keeps tables being traversed) */
+    if (t->gcflags == 0 && t->gcdirty == 0)
+      linkgclist(t, g->grayagain);  /* rescan its dirty cards in 'atomic' */
+    t->gcdirty |= cardof(t, slot);
+    return;
+  }
+  vs_assert((g->gckind == KGC_GEN) == (isold(t) && getage(t) != G_TOUCHED1));
   black2gray(t);  /* make table gray (again) */
-  linkgclist(t, g->grayagain);
+  // G_TOUCHED2的表还在grayagain链表中,不需要再次加入
+  if (getage(t) != G_TOUCHED2)  /* not already in gray list? */
+    linkgclist(t, g->grayagain);  /* link it in 'grayagain' */
+  if (isold(t))  /* generational mode? */
+    setage(t, G_TOUCHED1);  /* touched in current cycle */
 }
 
 
@@ -185,8 +344,12 @@ void vsC_upvalbarrier_ (vs_State *L, UpVal *uv) {
   global_State *g = G(L);
   GCObject *o = gcvalue(uv->v);
   vs_assert(!upisopen(uv));  /* ensured by macro vsC_upvalbarrier */
-  if (keepinvariant(g))
-    markobject(g, o);
+  if (keepinvariant(g) && iswhite(o)) {
+    reallymarkobject(g, o);
+    // 分代模式下无法知道引用该上值的闭包是不是老对象,只能当作老对象处理
+    if (g->gckind == KGC_GEN)
+      setage(o, G_OLD0);
+  }
 }
 
 
@@ -194,6 +357,7 @@ void vsC_fix (vs_State *L, GCObject *o) {
   global_State *g = G(L);
   vs_assert(g->allgc == o);  /* object must be 1st in 'allgc' list! */
   white2gray(o);  /* they will be gray forever */
+  setage(o, G_OLD);  /* and old forever */
   g->allgc = o->next;  /* remove object from 'allgc' list */
   o->next = g->fixedgc;  /* link it to 'fixedgc' list */
   g->fixedgc = o;
@@ -207,8 +371,8 @@ void vsC_fix (vs_State *L, GCObject *o) {
 // 所有gc对象都由该函数创建,初始化CommonHeader并将对象加入allgc链表
 GCObject *vsC_newobj (vs_State *L, int tt, size_t sz) {
   global_State *g = G(L);
-  // 传入novariant(tt)没有意义,只是为了可读性
-  GCObject *o = cast(GCObject *, vsM_newobject(L, novariant(tt), sz));
+  // 分配器收不到这个标记, 传入带变体的tt让分配采样区分长短字符串等
+  GCObject *o = cast(GCObject *, vsM_newobject(L, tt, sz));
   // 初始化CommonHeader的三个字段
   o->marked = vsC_white(g);
   o->tt = tt;
@@ -243,7 +407,9 @@ static void reallymarkobject (global_State *g, GCObject *o) {
  reentry:
   // 设置white0和white1的两个标记位都为0
   // 如果传入的o不是black的话,执行后就变成gray了
-  white2gray(o);
+  // 并行标记时其他线程可能已经抢先标记了o
+  if (!claimobject(o))
+    return;  /* marked by another marker */
   switch (o->tt) {
     // 短字符串和长字符串都转换成black
     // 让g->GCmemtrav加上字符串对象占用的空间
@@ -271,6 +437,12 @@ static void reallymarkobject (global_State *g, GCObject *o) {
       }
       break;
     }
+    // 类型化数组不引用其他对象 和字符串一样直接变成black
+    case VS_TARRAY: {
+      gray2black(o);
+      g->GCmemtrav += sizetarray(gco2a(o));
+      break;
+    }
     // 以下类型都是将对象加入到gray链表中
     case VS_TLCL: {
       linkgclist(gco2lcl(o), g->gray);
@@ -281,7 +453,11 @@ static void reallymarkobject (global_State *g, GCObject *o) {
       break;
     }
     case VS_TTABLE: {
-      linkgclist(gco2t(o), g->gray);
+      Table *h = gco2t(o);
+      h->gcflags = 0;  /* start a fresh traversal */
+      h->gccursor = 0;
+      h->gcdirty = 0;
+      linkgclist(h, g->gray);
       break;
     }
     case VS_TTHREAD: {
@@ -292,6 +468,25 @@ static void reallymarkobject (global_State *g, GCObject *o) {
       linkgclist(gco2p(o), g->gray);
       break;
     }
+#if defined(VS_SHAPES)
+    // 形状创建后不再改变, 直接标记它的key和祖先
+    // 祖先的key都是它的key的前缀, 所以只需要标记一次key
+    case VS_TSHAPE: {
+      Shape *s = gco2sh(o);
+      int i;
+      gray2black(o);
+      g->GCmemtrav += sizeshape(s->nkeys, s->lsizeidx);
+      for (i = 0; i < s->nkeys; i++)
+        markobject(g, s->keys[i]);
+      for (s = s->parent; s != NULL && iswhite(s); s = s->parent) {
+        if (!claimobject(obj2gco(s)))
+          break;  /* another marker has it */
+        gray2black(s);
+        g->GCmemtrav += sizeshape(s->nkeys, s->lsizeidx);
+      }
+      break;
+    }
+#endif
     default: vs_assert(0); break;
   }
 }
@@ -355,18 +550,52 @@ static void restartcollection (global_State *g) {
 ** =======================================================
 */
 
-// 遍历标记表
+
+/*
+** In generational mode, a table touched in this cycle goes back to
+** 'grayagain' so that it is traversed again in the next minor
+** collection (its young children are still young then); a table
+** touched in the previous cycle is done and becomes really old.
+*/
+static void genlink (global_State *g, Table *h) {
+  vs_assert(isblack(h));
+  if (getage(h) == G_TOUCHED1) {  /* touched in this cycle? */
+    black2gray(h);
+    linkgclist(h, g->grayagain);  /* link it back in 'grayagain' */
+  }  /* everything else do not need to be linked back */
+  else if (getage(h) == G_TOUCHED2)
+    changeage(h, G_TOUCHED2, G_OLD);  /* advance age */
+}
+
+
+// 遍历标记表的[i, lim)槽位, 数组部分在前哈希部分在后
 // 数组部分直接标记
 // 哈希部分如果value为nil标记key为dead,否则标记key和value
-static lu_mem traversetable (global_State *g, Table *h) {
-  // limit作为for循环的结束标志,limit是哈希部分的最后一个元素的下一个
-  Node *n, *limit = gnodelast(h);
-  unsigned int i;
+static lu_mem traverseslots (global_State *g, Table *h, unsigned int i,
+                                                        unsigned int lim) {
+  unsigned int asize = h->sizearray;
+  unsigned int nsize = cast(unsigned int, sizenode(h));
+  lu_mem size;
+  if (lim > tablesize(h)) lim = tablesize(h);
+  if (i >= lim) return 0;
+  size = sizeof(TValue) * ((lim < asize ? lim : asize) - (i < asize ? i : asize));
+#if defined(VS_SHAPES)
+  if (i == 0 && h->shape != NULL) {  /* a record: mark its shape and slots */
+    int k;
+    markobject(g, h->shape);
+    for (k = 0; k < h->shape->nkeys; k++)
+      markvalue(g, &h->slots[k]);
+    size += sizeslots(h);
+  }
+#endif
   // 标记数组部分
-  for (i = 0; i < h->sizearray; i++)  /* traverse array part */
+  for (; i < lim && i < asize; i++)  /* traverse array part */
     markvalue(g, &h->array[i]);
   // 标记哈希部分
-  for (n = gnode(h, 0); n < limit; n++) {  /* traverse hash part */
+  size += sizeof(Node) * (lim - i);
+  for (; i < lim; i++) {  /* traverse hash part (and the one being moved) */
+    Node *n = (i - asize < nsize) ? gnode(h, i - asize)
+                                  : gnode(&h->rh->old, i - asize - nsize);
     // 确保key如果是VS_TDEADKEY那么value一定是nil
     checkdeadkey(n);
     // 如果value是nil 标记key为死亡
@@ -379,9 +608,59 @@ static lu_mem traversetable (global_State *g, Table *h) {
       markvalue(g, gval(n));  /* mark value */
     }
   }
+  return size;
+}
+
+
+// 遍历标记整个表
+static lu_mem traversetable (global_State *g, Table *h) {
+  traverseslots(g, h, 0, tablesize(h));
+  genlink(g, h);
   // 表占用的空间包括Table对象+TValue*数组部分大小+Node*哈希部分大小
-  return sizeof(Table) + sizeof(TValue) * h->sizearray +
-                         sizeof(Node) * cast(size_t, allocsizenode(h));
+  return sizetable(h);
+}
+
+
+/*
+** Incremental traversal of large tables. A table with more than
+** GCTABLECHUNK slots is traversed GCTABLECHUNK slots at a time; between
+** chunks it stays black at the front of 'gray' with its cursor in
+** 'gccursor', so that writes to it go through 'vsC_barrierback_'.
+** That barrier does not relink the table: it only sets the bit of the
+** written card (1/GCCARDS of the slots) in 'gcdirty'. A traversed
+** table with dirty cards waits in 'grayagain' (still black) and
+** 'atomic' rescans only those cards.
+*/
+static lu_mem traverseinctable (global_State *g, Table *h) {
+  unsigned int total = tablesize(h);
+  lu_mem size;
+  if (h->gcflags == 0 && h->gcdirty != 0) {  /* rescan dirty cards? */
+    unsigned int csize = cardsize(total);
+    lu_mem dirty = h->gcdirty;
+    unsigned int i;
+    h->gcdirty = 0;
+    size = sizeof(Table);
+    for (i = 0; dirty != 0; i += csize, dirty >>= 1) {
+      if (dirty & 1)
+        size += traverseslots(g, h, i, i + csize);
+    }
+    return size;
+  }
+  if (h->gcflags == 0 && total <= GCTABLECHUNK)
+    return traversetable(g, h);  /* small table: traverse it at once */
+  h->gcflags = TABTRAVERSING;
+  if (total - h->gccursor > GCTABLECHUNK) {  /* not the last chunk? */
+    size = traverseslots(g, h, h->gccursor, h->gccursor + GCTABLECHUNK);
+    h->gccursor += GCTABLECHUNK;
+    linkgclist(h, g->gray);  /* come back for the next chunk */
+    return size;
+  }
+  size = sizeof(Table) + traverseslots(g, h, h->gccursor, total);
+  h->gcflags = 0;
+  h->gccursor = 0;
+  if (h->gcdirty != 0)  /* written while being traversed? */
+    linkgclist(h, g->grayagain);  /* rescan dirty cards in 'atomic' */
+  return size;
 }
 
 
@@ -403,12 +682,7 @@ static int traverseproto (global_State *g, Proto *f) {
     markobjectN(g, f->p[i]);
   for (i = 0; i < f->sizelocvars; i++)  /* mark local-variable names */
     markobjectN(g, f->locvars[i].varname);
-  return sizeof(Proto) + sizeof(Instruction) * f->sizecode +
-                         sizeof(Proto *) * f->sizep +
-                         sizeof(TValue) * f->sizek +
-                         sizeof(int) * f->sizelineinfo +
-                         sizeof(LocVar) * f->sizelocvars +
-                         sizeof(Upvaldesc) * f->sizeupvalues;
+  return cast_int(sizeproto(f));
 }
 
 
@@ -464,10 +738,9 @@ static lu_mem traversethread (global_State *g, vs_State *th) {
       g->twups = th;
     }
   }
-  else if (g->gckind != KGC_EMERGENCY)
+  else if (!g->gcemergency)
     vsD_shrinkstack(th); /* do not change stack in emergency cycle */
-  return (sizeof(vs_State) + sizeof(TValue) * th->stacksize +
-          sizeof(CallInfo) * th->nci);
+  return sizethread(th);
 }
 
 
@@ -479,17 +752,21 @@ static lu_mem traversethread (global_State *g, vs_State *th) {
 // 原理是从g->gray链表上取出一个元素标记为黑色,然后遍历所有子元素标记为灰色
 // 表,vs函数,c函数,Proto对象都是变成黑色
 // 线程类型还是灰色,并且移入grayagain链表中
+// 分代模式下grayagain中的G_TOUCHED2表已经是黑色,也会被再次遍历
 static void propagatemark (global_State *g) {
   lu_mem size;
   GCObject *o = g->gray;
-  vs_assert(isgray(o));
+  vs_assert(!iswhite(o));
   // 开始遍历标记灰对象,所以灰对象要变黑,子对象变灰
   gray2black(o);
   switch (o->tt) {
     case VS_TTABLE: {
       Table *h = gco2t(o);
       g->gray = h->gclist;  /* remove from 'gray' list */
-      size = traversetable(g, h);
+      if (g->gckind == KGC_INC)
+        size = traverseinctable(g, h);
+      else
+        size = traversetable(g, h);
       break;
     }
     case VS_TLCL: {
@@ -525,7 +802,276 @@ static void propagatemark (global_State *g) {
 }
 
 
+/*
+** {======================================================
+** Parallel mark
+** =======================================================
+*/
+
+#if defined(VS_PARALLELMARK)
+
+/*
+** When the collector propagates all gray objects at once (that is,
+** in the atomic step and in full collections), the mutator is stopped
+** and the work can be shared with helper threads. Each marker works on
+** a private copy ('view') of the global state, so that the traversal
+** functions keep using 'g->gray', 'g->grayagain' and 'g->GCmemtrav'
+** without changes; only the claim of white objects is atomic. Markers
+** with long gray lists give batches to a shared pool when some other
+** marker is idle. Threads are not traversed in parallel (their
+** traversal may change 'twups' and reallocate the stack); markers hand
+** them back to the coordinator.
+*/
+
+/* number of traversals between checks for idle markers */
+#define PARSHARESTEP	64
+
+/* number of gray objects moved to the pool at once */
+#define PARBATCH	64
+
+typedef struct GCWorker {
+  global_State view;  /* private copy of the global state */
+  struct GCPar *par;
+  pthread_t tid;
+} GCWorker;
+
+typedef struct GCPar {
+  pthread_mutex_t lock;
+  pthread_cond_t work;  /* new job for helpers (or 'quit') */
+  pthread_cond_t more;  /* gray objects in 'pool' (or 'finished') */
+  pthread_cond_t done;  /* all helpers left the current job */
+  GCObject *pool;  /* shared gray objects */
+  GCObject *deferred;  /* threads left to the coordinator */
+  int nhelpers;  /* number of helper threads */
+  int epoch;  /* number of the current job */
+  int running;  /* helpers still inside the current job */
+  int idle;  /* markers waiting for the pool */
+  int finished;  /* true when the current job has no more work */
+  int quit;  /* true to stop helper threads */
+  GCWorker w[VSI_MAXGCWORKERS + 1];  /* 'w[0]' is the coordinator */
+} GCPar;
+
+
+/* move up to PARBATCH objects after the first one to the pool */
+static void sharegray (GCPar *par, global_State *v) {
+  GCObject *first = *getgclist(v->gray);
+  GCObject *last = first;
+  int n = 1;
+  if (first == NULL) return;  /* keep at least one object */
+  while (n < PARBATCH && *getgclist(last) != NULL) {
+    last = *getgclist(last);
+    n++;
+  }
+  *getgclist(v->gray) = *getgclist(last);  /* remove batch from 'v' */
+  pthread_mutex_lock(&par->lock);
+  *getgclist(last) = par->pool;
+  par->pool = first;
+  pthread_cond_signal(&par->more);
+  pthread_mutex_unlock(&par->lock);
+}
+
+
+/* take up to PARBATCH objects from the pool; 'par->lock' is held */
+static void takegray (GCPar *par, global_State *v) {
+  GCObject *first = par->pool;
+  GCObject *last = first;
+  int n = 1;
+  while (n < PARBATCH && *getgclist(last) != NULL) {
+    last = *getgclist(last);
+    n++;
+  }
+  par->pool = *getgclist(last);
+  *getgclist(last) = v->gray;
+  v->gray = first;
+}
+
+
+/*
+** Propagate gray objects until all markers run out of work. Returns
+** when the pool is empty and every marker is idle.
+*/
+static void parmark (GCPar *par, global_State *v) {
+  int nmarkers = par->nhelpers + 1;
+  int count = 0;
+  for (;;) {
+    while (v->gray != NULL) {
+      GCObject *o = v->gray;
+      if (o->tt == VS_TTHREAD) {  /* leave threads to the coordinator */
+        v->gray = gco2th(o)->gclist;
+        pthread_mutex_lock(&par->lock);
+        linkgclist(gco2th(o), par->deferred);
+        pthread_mutex_unlock(&par->lock);
+        continue;
+      }
+      propagatemark(v);
+      if (++count % PARSHARESTEP == 0 && v->gray != NULL &&
+          __atomic_load_n(&par->idle, __ATOMIC_RELAXED) > 0)
+        sharegray(par, v);
+    }
+    pthread_mutex_lock(&par->lock);
+    while (par->pool == NULL && !par->finished) {
+      if (++par->idle == nmarkers) {  /* everybody is out of work? */
+        par->finished = 1;
+        pthread_cond_broadcast(&par->more);
+      }
+      else {
+        pthread_cond_wait(&par->more, &par->lock);
+        if (!par->finished) par->idle--;
+      }
+    }
+    if (par->finished) {
+      pthread_mutex_unlock(&par->lock);
+      return;
+    }
+    takegray(par, v);
+    pthread_mutex_unlock(&par->lock);
+  }
+}
+
+
+static void *gchelper (void *ud) {
+  GCWorker *w = (GCWorker *)ud;
+  GCPar *par = w->par;
+  int epoch = 0;
+  pthread_mutex_lock(&par->lock);
+  for (;;) {
+    while (par->epoch == epoch && !par->quit)
+      pthread_cond_wait(&par->work, &par->lock);
+    if (par->quit) break;
+    epoch = par->epoch;
+    pthread_mutex_unlock(&par->lock);
+    parmark(par, &w->view);
+    pthread_mutex_lock(&par->lock);
+    if (--par->running == 0)
+      pthread_cond_signal(&par->done);
+  }
+  pthread_mutex_unlock(&par->lock);
+  return NULL;
+}
+
+
+/*
+** Run one parallel job over the gray list of 'g', then merge back what
+** the views produced: traversed memory and tables that went back to
+** 'grayagain'.
+*/
+static void parjob (global_State *g, GCPar *par) {
+  int i;
+  for (i = 0; i <= par->nhelpers; i++) {
+    global_State *v = &par->w[i].view;
+    *v = *g;
+    v->gray = v->grayagain = NULL;
+    v->GCmemtrav = 0;
+  }
+  pthread_mutex_lock(&par->lock);
+  par->pool = g->gray;
+  g->gray = NULL;
+  par->idle = par->finished = 0;
+  par->running = par->nhelpers;
+  par->epoch++;
+  pthread_cond_broadcast(&par->work);
+  pthread_mutex_unlock(&par->lock);
+  parmark(par, &par->w[0].view);
+  pthread_mutex_lock(&par->lock);
+  while (par->running > 0)
+    pthread_cond_wait(&par->done, &par->lock);
+  pthread_mutex_unlock(&par->lock);
+  for (i = 0; i <= par->nhelpers; i++) {
+    global_State *v = &par->w[i].view;
+    g->GCmemtrav += v->GCmemtrav;
+    while (v->grayagain != NULL) {
+      GCObject *o = v->grayagain;
+      v->grayagain = *getgclist(o);
+      *getgclist(o) = g->grayagain;
+      g->grayagain = o;
+    }
+  }
+}
+
+
+static void parallelpropagate (global_State *g) {
+  GCPar *par = g->gcpar;
+  while (g->gray != NULL) {
+    parjob(g, par);
+    while (par->deferred != NULL) {  /* traverse threads sequentially */
+      GCObject *o = par->deferred;
+      par->deferred = gco2th(o)->gclist;
+      linkgclist(gco2th(o), g->gray);
+      propagatemark(g);
+    }
+  }
+}
+
+
+static void stophelpers (vs_State *L, GCPar *par) {
+  int i;
+  pthread_mutex_lock(&par->lock);
+  par->quit = 1;
+  pthread_cond_broadcast(&par->work);
+  pthread_mutex_unlock(&par->lock);
+  for (i = 1; i <= par->nhelpers; i++)
+    pthread_join(par->w[i].tid, NULL);
+  pthread_mutex_destroy(&par->lock);
+  pthread_cond_destroy(&par->work);
+  pthread_cond_destroy(&par->more);
+  pthread_cond_destroy(&par->done);
+  vsM_free(L, par);
+}
+
+
+/*
+** Set the number of helper threads for marking (0 turns parallel
+** marking off). Returns the number of helpers actually running.
+*/
+int vsC_setgcworkers (vs_State *L, int n) {
+  global_State *g = G(L);
+  GCPar *par;
+  int i;
+  if (n > VSI_MAXGCWORKERS) n = VSI_MAXGCWORKERS;
+  if (g->gcpar != NULL) {
+    if (g->gcpar->nhelpers == n) return n;
+    stophelpers(L, g->gcpar);
+    g->gcpar = NULL;
+  }
+  if (n <= 0) return 0;
+  par = vsM_new(L, GCPar);
+  memset(par, 0, sizeof(GCPar));
+  pthread_mutex_init(&par->lock, NULL);
+  pthread_cond_init(&par->work, NULL);
+  pthread_cond_init(&par->more, NULL);
+  pthread_cond_init(&par->done, NULL);
+  for (i = 0; i <= n; i++) {
+    par->w[i].par = par;
+    if (i > 0 && pthread_create(&par->w[i].tid, NULL, gchelper,
+                                &par->w[i]) != 0)
+      break;  /* could not create more threads */
+    par->nhelpers = i;
+  }
+  if (par->nhelpers == 0) {  /* no helpers? */
+    stophelpers(L, par);
+    return 0;
+  }
+  g->gcpar = par;
+  return par->nhelpers;
+}
+
+#else
+
+int vsC_setgcworkers (vs_State *L, int n) {
+  UNUSED(L); UNUSED(n);
+  return 0;  /* parallel marking not available */
+}
+
+#endif
+
+
 static void propagateall (global_State *g) {
+#if defined(VS_PARALLELMARK)
+  if (g->gcpar != NULL) {
+    parallelpropagate(g);
+    return;
+  }
+#endif
   while (g->gray) propagatemark(g);
 }
 
@@ -568,6 +1114,8 @@ static void freeLclosure (vs_State *L, LClosure *cl) {
 
 // 释放传入GCObject类型对象
 static void freeobj (vs_State *L, GCObject *o) {
+  global_State *g = G(L);
+  l_mem debt = g->GCdebt;
   switch (o->tt) {
     // 原型对象需要释放几个保存的数组以及对象自身
     case VS_TPROTO: vsF_freeproto(L, gco2p(o)); break;
@@ -582,6 +1130,10 @@ static void freeobj (vs_State *L, GCObject *o) {
       break;
     }
     case VS_TTABLE: vsH_free(L, gco2t(o)); break;
+    case VS_TARRAY: vsH_freearray(L, gco2a(o)); break;
+#if defined(VS_SHAPES)
+    case VS_TSHAPE: vsH_freeshape(L, gco2sh(o)); break;
+#endif
     // 释放CallInfo链表,vs栈以及线程对象自身
     case VS_TTHREAD: vsE_freethread(L, gco2th(o)); break;
     case VS_TUSERDATA: vsM_freemem(L, o, sizeudata(gco2u(o))); break;
@@ -596,6 +1148,7 @@ static void freeobj (vs_State *L, GCObject *o) {
     }
     default: vs_assert(0);
   }
+  g->gcfreed += cast(lu_mem, debt - g->GCdebt);
 }
 
 
@@ -618,6 +1171,7 @@ static GCObject **sweeplist (vs_State *L, GCObject **p, lu_mem count) {
   global_State *g = G(L);
   int ow = otherwhite(g);
   int white = vsC_white(g);  /* current white */
+  deferfrees(g, 1);
   while (*p != NULL && count-- > 0) {
     GCObject *curr = *p;
     int marked = curr->marked;
@@ -634,16 +1188,170 @@ static GCObject **sweeplist (vs_State *L, GCObject **p, lu_mem count) {
       p = &curr->next;  /* go to next element */
     }
   }
+  deferfrees(g, 0);
   return (*p == NULL) ? NULL : p;
 }
 
+
+/*
+** Background sweep. Sweeping still unlinks dead objects on the mutator
+** thread (it must remove strings from the string table, release
+** upvalues and keep 'GCdebt' right), but while 'g->gcdeferfree' is on
+** 'vsM_realloc_' does not release blocks; it queues them here and a
+** background thread gives them back to the allocator, which therefore
+** must be thread safe. Objects created during the sweep are not
+** affected: they get the current white as usual.
+*/
+#if defined(VS_BGSWEEP)
+
+#define FREEBATCH	512  /* blocks in each batch */
+#define NFREEBATCH	8  /* batches in the ring */
+
+typedef struct FreeBlock {
+  void *block;
+  size_t size;
+} FreeBlock;
+
+typedef struct GCSweeper {
+  pthread_mutex_t lock;
+  pthread_cond_t ready;  /* a batch was handed to the thread (or 'quit') */
+  pthread_cond_t freed;  /* the thread released a batch */
+  global_State *g;
+  pthread_t tid;
+  int head;  /* batch being filled by the mutator */
+  int tail;  /* oldest batch handed to the thread */
+  int count;  /* number of batches handed to the thread */
+  int quit;  /* true to stop the thread */
+  int n[NFREEBATCH];  /* number of blocks in each batch */
+  FreeBlock batch[NFREEBATCH][FREEBATCH];
+} GCSweeper;
+
+
+static void *gcsweeper (void *ud) {
+  GCSweeper *sw = (GCSweeper *)ud;
+  pthread_mutex_lock(&sw->lock);
+  for (;;) {
+    FreeBlock *b;
+    vs_Alloc f;
+    void *fud;
+    int i, n;
+    while (sw->count == 0 && !sw->quit)
+      pthread_cond_wait(&sw->ready, &sw->lock);
+    if (sw->count == 0) break;  /* quit and nothing left to free */
+    b = sw->batch[sw->tail];
+    n = sw->n[sw->tail];
+    f = sw->g->frealloc;
+    fud = sw->g->ud;
+    pthread_mutex_unlock(&sw->lock);
+    for (i = 0; i < n; i++)
+      (*f)(fud, b[i].block, b[i].size, 0);
+    pthread_mutex_lock(&sw->lock);
+    sw->n[sw->tail] = 0;
+    sw->tail = (sw->tail + 1) % NFREEBATCH;
+    sw->count--;
+    pthread_cond_signal(&sw->freed);
+  }
+  pthread_mutex_unlock(&sw->lock);
+  return NULL;
+}
+
+
+/* hand the batch being filled to the thread */
+static void flushfrees (global_State *g) {
+  GCSweeper *sw = g->gcsweeper;
+  if (sw == NULL || sw->n[sw->head] == 0) return;
+  pthread_mutex_lock(&sw->lock);
+  sw->head = (sw->head + 1) % NFREEBATCH;
+  sw->count++;
+  pthread_cond_signal(&sw->ready);
+  while (sw->count == NFREEBATCH)  /* no free batch to fill? */
+    pthread_cond_wait(&sw->freed, &sw->lock);
+  pthread_mutex_unlock(&sw->lock);
+}
+
+
+void vsC_deferfree (global_State *g, void *block, size_t osize) {
+  GCSweeper *sw = g->gcsweeper;
+  FreeBlock *b = &sw->batch[sw->head][sw->n[sw->head]++];
+  b->block = block;
+  b->size = osize;
+  if (sw->n[sw->head] == FREEBATCH)
+    flushfrees(g);
+}
+
+
+/* wait until all queued blocks are back to the allocator */
+void vsC_waitfrees (vs_State *L) {
+  global_State *g = G(L);
+  GCSweeper *sw = g->gcsweeper;
+  if (sw == NULL) return;
+  flushfrees(g);
+  pthread_mutex_lock(&sw->lock);
+  while (sw->count > 0)
+    pthread_cond_wait(&sw->freed, &sw->lock);
+  pthread_mutex_unlock(&sw->lock);
+}
+
+
+/*
+** Turn the background sweeper on or off. Returns whether it is
+** running.
+*/
+int vsC_setbgsweep (vs_State *L, int on) {
+  global_State *g = G(L);
+  GCSweeper *sw = g->gcsweeper;
+  if (on && sw == NULL) {
+    sw = vsM_new(L, GCSweeper);
+    memset(sw, 0, sizeof(GCSweeper));
+    sw->g = g;
+    pthread_mutex_init(&sw->lock, NULL);
+    pthread_cond_init(&sw->ready, NULL);
+    pthread_cond_init(&sw->freed, NULL);
+    if (pthread_create(&sw->tid, NULL, gcsweeper, sw) == 0)
+      g->gcsweeper = sw;
+    else
+      on = 0;  /* no thread; release 'sw' below */
+  }
+  if (!on && sw != NULL) {
+    if (g->gcsweeper == sw) {  /* thread is running? */
+      vsC_waitfrees(L);
+      pthread_mutex_lock(&sw->lock);
+      sw->quit = 1;
+      pthread_cond_signal(&sw->ready);
+      pthread_mutex_unlock(&sw->lock);
+      pthread_join(sw->tid, NULL);
+      g->gcsweeper = NULL;
+    }
+    pthread_mutex_destroy(&sw->lock);
+    pthread_cond_destroy(&sw->ready);
+    pthread_cond_destroy(&sw->freed);
+    vsM_free(L, sw);
+  }
+  return (g->gcsweeper != NULL);
+}
+
+#else
+
+#define flushfrees(g)	((void)0)
+
+void vsC_waitfrees (vs_State *L) {
+  UNUSED(L);
+}
+
+int vsC_setbgsweep (vs_State *L, int on) {
+  UNUSED(L); UNUSED(on);
+  return 0;  /* background sweep not available */
+}
+
+#endif
+
 /* }====================================================== */
 
 /*
 ** If possible, shrink string table
 */
 static void checkSizes (vs_State *L, global_State *g) {
-  if (g->gckind != KGC_EMERGENCY) {
+  if (!g->gcemergency) {
     l_mem olddebt = g->GCdebt;
     if (g->strt.nuse < g->strt.size / 4)  /* string table too big? */
       vsS_resize(L, g->strt.size / 2);  /* shrink it a little */
@@ -714,18 +1422,37 @@ static void entersweep (vs_State *L) {
 
 void vsC_freeallobjects (vs_State *L) {
   global_State *g = G(L);
+  vsC_setgcworkers(L, 0);  /* stop marking helpers */
+  vsC_setbgsweep(L, 0);  /* free everything on this thread */
+  vsC_changemode(L, KGC_INC);
   g->currentwhite = WHITEBITS; /* this "white" makes all objects look dead */
-  g->gckind = KGC_NORMAL;
   sweepwholelist(L, &g->allgc);
   sweepwholelist(L, &g->fixedgc);  /* collect fixed objects */
   vs_assert(g->strt.nuse == 0);
 }
 
 
+/*
+** Mark the prototypes in CPU samples not aggregated yet, so that their
+** sources are still there when the samples are written
+*/
+static void markprofiler (global_State *g) {
+  CPUProf *p = g->cpuprof;
+  if (p != NULL) {
+    int i, j;
+    for (i = 0; i < p->nsamples; i++) {
+      for (j = 0; j < p->nframes[i]; j++)
+        markobjectN(g, p->ring[i][j].p);
+    }
+  }
+}
+
+
 static l_mem atomic (vs_State *L) {
   global_State *g = G(L);
   l_mem work;
   GCObject *grayagain = g->grayagain;  /* save original list */
+  g->grayagain = NULL;
   // 线程对象应该是灰对象
   vs_assert(!iswhite(g->mainthread));
   g->gcstate = GCSinsideatomic;
@@ -733,6 +1460,7 @@ static l_mem atomic (vs_State *L) {
   markobject(g, L);  /* mark running thread */
   /* registry and global metatables may be changed by API */
   markvalue(g, &g->l_registry);
+  markprofiler(g);
   /* remark occasional upvalues of (maybe) dead threads */
   remarkupvals(g);
   propagateall(g);  /* propagate changes */
@@ -748,6 +1476,14 @@ static l_mem atomic (vs_State *L) {
 }
 
 
+/* add the processor time since '*t' to phase 'phase'; restart '*t' */
+static void chargetime (global_State *g, int phase, clock_t *t) {
+  clock_t now = clock();
+  g->gctime[phase] += cast_num(now - *t) / CLOCKS_PER_SEC;
+  *t = now;
+}
+
+
 // 清理sweepgc链表上的元素,必要时更新gc的状态
 // 如果清理完毕,设置gc的状态为传入的状态,并更新sweepgc为nextlist
 // 没清理完成,达到了清理的上限,就不更新gc状态
@@ -808,7 +1544,9 @@ static lu_mem singlestep (vs_State *L) {
     // 设置主线程是当前白
     case GCSswpend: {  /* finish sweeps */
       makewhite(g, g->mainthread);  /* sweep main thread */
+      flushfrees(g);  /* hand the last freed blocks to the sweeper */
       checkSizes(L, g);
+      g->gccycles++;
       g->gcstate = GCSpause;
       return 0;
     }
@@ -823,11 +1561,310 @@ static lu_mem singlestep (vs_State *L) {
 */
 void vsC_runtilstate (vs_State *L, int statesmask) {
   global_State *g = G(L);
-  while (!testbit(statesmask, g->gcstate))
+  clock_t t = clock();
+  while (!testbit(statesmask, g->gcstate)) {
+    int state = g->gcstate;
     singlestep(L);
+    if (g->gcstate != state)  /* changed phase? */
+      chargetime(g, gcphase(state), &t);
+  }
+  chargetime(g, gcphase(g->gcstate), &t);
 }
 
 
+/*
+** {======================================================
+** Generational Collector
+** =======================================================
+*/
+
+
+/*
+** Sweep a list of objects in generational mode, stopping at 'limit'.
+** Dead (white) objects are freed; new objects go back to white as
+** survivals, all other live objects advance their ages and keep their
+** (black) color. Return where the sweep stopped.
+*/
+// allgc链表从头到尾依次是: 新对象,survival对象,old1对象,老对象
+// 次回收只需要清扫到g->old1为止
+static GCObject **sweepgen (vs_State *L, global_State *g, GCObject **p,
+                            GCObject *limit, GCObject **pfirstold1) {
+  static const lu_byte nextage[] = {
+    G_SURVIVAL,  /* from G_NEW */
+    G_OLD1,      /* from G_SURVIVAL */
+    G_OLD1,      /* from G_OLD0 */
+    G_OLD,       /* from G_OLD1 */
+    G_OLD,       /* from G_OLD (do not change) */
+    G_TOUCHED1,  /* from G_TOUCHED1 (do not change) */
+    G_TOUCHED2   /* from G_TOUCHED2 (do not change) */
+  };
+  int white = vsC_white(g);
+  GCObject *curr;
+  deferfrees(g, 1);
+  while ((curr = *p) != limit) {
+    if (iswhite(curr)) {  /* is 'curr' dead? */
+      vs_assert(!isold(curr) && isdead(g, curr));
+      *p = curr->next;  /* remove 'curr' from list */
+      freeobj(L, curr);  /* erase 'curr' */
+    }
+    else {  /* correct mark and age */
+      if (getage(curr) == G_NEW)  /* new objects go back to white */
+        curr->marked = cast_byte((curr->marked & maskgcbits) |
+                                 G_SURVIVAL | white);
+      else {  /* all other objects will be old, and so keep their color */
+        setage(curr, nextage[getage(curr)]);
+        if (getage(curr) == G_OLD1 && *pfirstold1 == NULL)
+          *pfirstold1 = curr;  /* first OLD1 object in the list */
+      }
+      p = &curr->next;  /* go to next element */
+    }
+  }
+  deferfrees(g, 0);
+  return p;
+}
+
+
+/*
+** Traverse a list making all its elements white and clearing their
+** age. In incremental mode, all objects are 'new' all the time,
+** except for fixed strings (which are always old).
+*/
+static void whitelist (global_State *g, GCObject *p) {
+  int white = vsC_white(g);
+  for (; p != NULL; p = p->next)
+    p->marked = cast_byte((p->marked & maskgcbits) | white);
+}
+
+
+/*
+** Correct a list of gray objects after a minor collection. Tables
+** touched in this cycle become black (so that a new assignment fires
+** the barrier again) and stay in the list as G_TOUCHED2; threads stay
+** gray in the list; everything else is removed.
+*/
+static GCObject **correctgraylist (GCObject **p) {
+  GCObject *curr;
+  while ((curr = *p) != NULL) {
+    GCObject **next = getgclist(curr);
+    if (iswhite(curr))
+      *p = *next;  /* remove all white objects */
+    else if (getage(curr) == G_TOUCHED1) {  /* touched in this cycle? */
+      vs_assert(isgray(curr));
+      gray2black(curr);  /* make it black, for next barrier */
+      changeage(curr, G_TOUCHED1, G_TOUCHED2);
+      p = next;  /* keep it in the list and go to next element */
+    }
+    else if (curr->tt == VS_TTHREAD) {
+      vs_assert(isgray(curr));
+      p = next;  /* keep non-white threads on the list */
+    }
+    else {  /* everything else is removed */
+      vs_assert(isold(curr));  /* young objects should be white here */
+      if (getage(curr) == G_TOUCHED2)  /* advance from TOUCHED2... */
+        changeage(curr, G_TOUCHED2, G_OLD);  /* ... to OLD */
+      gray2black(curr);  /* make object black (to be removed) */
+      *p = *next;
+    }
+  }
+  return p;
+}
+
+
+/*
+** Mark black 'OLD1' objects when starting a new young collection.
+** They survived only one cycle, so their children may still be young
+** and must be traversed once more.
+*/
+static void markold (global_State *g, GCObject *from, GCObject *to) {
+  GCObject *p;
+  for (p = from; p != to; p = p->next) {
+    if (getage(p) == G_OLD1) {
+      vs_assert(!iswhite(p));
+      changeage(p, G_OLD1, G_OLD);  /* now they are old */
+      if (isblack(p)) {
+        makewhite(g, p);  /* mark it again */
+        reallymarkobject(g, p);
+      }
+    }
+  }
+}
+
+
+/*
+** Finish a young-generation collection.
+*/
+static void finishgencycle (vs_State *L, global_State *g) {
+  correctgraylist(&g->grayagain);
+  flushfrees(g);
+  checkSizes(L, g);
+  g->gccycles++;
+  g->gcstate = GCSpropagate;  /* skip restart */
+}
+
+
+/*
+** Does a young collection. First, mark 'OLD1' objects. Then does the
+** atomic step. Then, sweep all lists and advance pointers. Finally,
+** finish the collection.
+*/
+// 次回收只标记和清扫新对象,老对象只有被touched的才会重新遍历
+static void youngcollection (vs_State *L, global_State *g) {
+  GCObject **psurvival;  /* to point to first non-dead survival object */
+  clock_t t = clock();
+  vs_assert(g->gcstate == GCSpropagate);
+  if (g->firstold1) {  /* are there regular OLD1 objects? */
+    markold(g, g->firstold1, g->reallyold);  /* mark them */
+    g->firstold1 = NULL;  /* no more OLD1 objects (for now) */
+  }
+  chargetime(g, GCTPROPAGATE, &t);
+  atomic(L);
+  chargetime(g, GCTATOMIC, &t);
+  /* sweep nursery and get a pointer to its last live element */
+  g->gcstate = GCSswpallgc;
+  psurvival = sweepgen(L, g, &g->allgc, g->survival, &g->firstold1);
+  /* sweep 'survival' */
+  sweepgen(L, g, psurvival, g->old1, &g->firstold1);
+  g->reallyold = g->old1;
+  g->old1 = *psurvival;  /* 'survival' survivals are old now */
+  g->survival = g->allgc;  /* all news are survivals */
+  finishgencycle(L, g);
+  chargetime(g, GCTSWEEP, &t);
+}
+
+
+/*
+** Clears all gray lists and sweeps all objects after a full atomic
+** step, making every survivor old. Threads go to 'grayagain' (they
+** are always gray); everything else becomes black.
+*/
+static void sweep2old (vs_State *L, GCObject **p) {
+  GCObject *curr;
+  global_State *g = G(L);
+  deferfrees(g, 1);
+  while ((curr = *p) != NULL) {
+    if (iswhite(curr)) {  /* is 'curr' dead? */
+      vs_assert(isdead(g, curr));
+      *p = curr->next;  /* remove 'curr' from list */
+      freeobj(L, curr);  /* erase 'curr' */
+    }
+    else {  /* all surviving objects become old */
+      setage(curr, G_OLD);
+      if (curr->tt == VS_TTHREAD) {  /* threads must be watched */
+        vs_State *th = gco2th(curr);
+        linkgclist(th, g->grayagain);  /* insert into 'grayagain' list */
+      }
+      else  /* everything else is black */
+        gray2black(curr);
+      p = &curr->next;  /* go to next element */
+    }
+  }
+  deferfrees(g, 0);
+}
+
+
+static void atomic2gen (vs_State *L, global_State *g) {
+  g->gray = g->grayagain = NULL;
+  /* sweep all elements making them old */
+  g->gcstate = GCSswpallgc;
+  sweep2old(L, &g->allgc);
+  /* main thread is not in 'allgc', but it must be watched, too */
+  setage(g->mainthread, G_OLD);
+  linkgclist(g->mainthread, g->grayagain);
+  /* everything alive now is old */
+  g->reallyold = g->old1 = g->survival = g->allgc;
+  g->firstold1 = NULL;  /* there are no OLD1 objects anywhere */
+  g->gckind = KGC_GEN;
+  g->GCestimate = gettotalbytes(g);  /* base for memory control */
+  finishgencycle(L, g);
+}
+
+
+/*
+** Set debt for the next minor collection, which will happen when
+** memory grows 'genminormul'%.
+*/
+static void setminordebt (global_State *g) {
+  vsE_setdebt(g, -(cast(l_mem, (gettotalbytes(g) / 100)) * g->genminormul));
+}
+
+
+/*
+** Enter generational mode. Must go until the end of an atomic cycle
+** to ensure that all objects are correctly marked and weak tables
+** are cleared. Then, turn all objects into old and finishes the
+** collection.
+*/
+static void entergen (vs_State *L, global_State *g) {
+  clock_t t;
+  vsC_runtilstate(L, bitmask(GCSpause));  /* prepare to start a new cycle */
+  vsC_runtilstate(L, bitmask(GCSpropagate));  /* start new cycle */
+  t = clock();
+  atomic(L);  /* propagates all and then do the atomic stuff */
+  chargetime(g, GCTATOMIC, &t);
+  atomic2gen(L, g);
+  chargetime(g, GCTSWEEP, &t);
+  setminordebt(g);  /* set debt assuming next cycle will be minor */
+}
+
+
+/*
+** Enter incremental mode. Turn all objects white, make all
+** intermediate lists point to NULL (to avoid invalid pointers),
+** and go to the pause state.
+*/
+static void enterinc (global_State *g) {
+  whitelist(g, g->allgc);
+  whitelist(g, obj2gco(g->mainthread));  /* main thread is not in 'allgc' */
+  g->reallyold = g->old1 = g->survival = g->firstold1 = NULL;
+  g->gray = g->grayagain = NULL;
+  g->gcstate = GCSpause;
+  g->gckind = KGC_INC;
+}
+
+
+/*
+** Change collector mode to 'newmode'.
+*/
+void vsC_changemode (vs_State *L, int newmode) {
+  global_State *g = G(L);
+  if (newmode != g->gckind) {
+    if (newmode == KGC_GEN)  /* entering generational mode? */
+      entergen(L, g);
+    else
+      enterinc(g);  /* entering incremental mode */
+  }
+}
+
+
+/*
+** Does a full collection in generational mode.
+*/
+static void fullgen (vs_State *L, global_State *g) {
+  enterinc(g);
+  entergen(L, g);
+}
+
+
+/*
+** Does a generational "step": a minor collection, unless memory has
+** grown more than 'genmajormul'% since the last major collection, in
+** which case it does a major (full) one.
+*/
+static void genstep (vs_State *L, global_State *g) {
+  lu_mem majorbase = g->GCestimate;  /* memory after last major collection */
+  lu_mem majorinc = (majorbase / 100) * getgcparam(g->genmajormul);
+  if (g->GCdebt > 0 && gettotalbytes(g) > majorbase + majorinc)
+    fullgen(L, g);  /* do a major collection */
+  else {  /* regular case; do a minor collection */
+    youngcollection(L, g);
+    setminordebt(g);
+    g->GCestimate = majorbase;  /* preserve base value */
+  }
+}
+
+/* }====================================================== */
+
+
 /*
 ** get GC debt and convert it from Kb to 'work units' (avoid zero debt
 ** and overflows)
@@ -846,20 +1883,54 @@ static l_mem getdebt (global_State *g) {
 }
 
 /*
-** performs a basic GC step when collector is running
+** performs a basic incremental step
 */
-void vsC_step (vs_State *L) {
-  global_State *g = G(L);
-  // 根据倍率stepmul计算出来当前的debt
-  l_mem debt = getdebt(g);  /* GC deficit (be paid now) */
-  if (!g->gcrunning) {  /* not running? */
-    vsE_setdebt(g, -GCSTEPSIZE * 10);  /* avoid being called too often */
-    return;
-  }
+/*
+** monotonic clock, in microseconds, for time-budgeted steps
+*/
+static l_mem gcclock (void) {
+#if defined(CLOCK_MONOTONIC)
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return cast(l_mem, ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+#else
+  return cast(l_mem, cast_num(clock()) * 1000000 / CLOCKS_PER_SEC);
+#endif
+}
+
+
+/*
+** performs single steps until 'debt' work units are done or the cycle
+** ends; with a 'deadline' (a 'gcclock' time, 0 for none), also stops
+** when it passes, checking the clock every GCCLOCKSTEPS steps. Returns
+** the debt left.
+*/
+static l_mem dosteps (vs_State *L, global_State *g, l_mem debt,
+                                                   l_mem deadline) {
+  clock_t t = clock();
+  int state;
+  int n = 0;
   do {  /* repeat until pause or enough "credit" (negative debt) */
-    lu_mem work = singlestep(L);  /* perform one single step */
+    lu_mem work;
+    state = g->gcstate;
+    work = singlestep(L);  /* perform one single step */
     debt -= work;
+    if (g->gcstate != state)  /* changed phase? */
+      chargetime(g, gcphase(state), &t);
+    if (deadline != 0 && ++n % GCCLOCKSTEPS == 0 && gcclock() >= deadline)
+      break;  /* out of time */
   } while (debt > -GCSTEPSIZE && g->gcstate != GCSpause);
+  chargetime(g, gcphase(state), &t);
+  return debt;
+}
+
+
+static void incstep (vs_State *L, global_State *g) {
+  // 根据倍率stepmul计算出来当前的debt
+  l_mem debt = getdebt(g);  /* GC deficit (be paid now) */
+  // 设置了时间预算时,每次增量最多执行gcsteptime微秒,没做完的债务留到下次
+  l_mem deadline = (g->gcsteptime > 0) ? gcclock() + g->gcsteptime : 0;
+  debt = dosteps(L, g, debt, deadline);
   // 如果这一轮垃圾回收结束了,设置g->GCdebt = -g->GCestimate
   // 也就是再分配g->GCestimate大小的内存后,再次开始垃圾回收
   if (g->gcstate == GCSpause)
@@ -873,32 +1944,463 @@ void vsC_step (vs_State *L) {
 
 
 /*
-** Performs a full GC cycle; if 'isemergency', set a flag to avoid
-** some operations which could change the interpreter state in some
-** unexpected ways (running finalizers and shrinking some structures).
-** Before running the collection, check 'keepinvariant'; if it is true,
-** there may be some objects marked as black, so the collector has
-** to sweep all objects to turn them back to white (as white has not
-** changed, nothing will be collected).
+** Does at most 'usec' microseconds of collection work (a step runs
+** GCCLOCKSTEPS single steps between clock checks, and an atomic step
+** cannot be split). Returns true if a cycle finished. The work done
+** pays the current debt. In generational mode a collection cannot be
+** split at all, so it does a regular step if one is due.
 */
-void vsC_fullgc (vs_State *L, int isemergency) {
+int vsC_steptime (vs_State *L, int usec) {
   global_State *g = G(L);
-  vs_assert(g->gckind == KGC_NORMAL);
-  if (isemergency) g->gckind = KGC_EMERGENCY;  /* set flag */
+  l_mem debt;
+  if (g->gckind == KGC_GEN) {
+    if (g->GCdebt > 0)
+      genstep(L, g);
+    return 0;
+  }
+  debt = dosteps(L, g, MAX_LMEM, gcclock() + (usec > 0 ? usec : 0));
+  if (g->gcstate == GCSpause) {
+    setpause(g);  /* pause until next cycle */
+    return 1;
+  }
+  /* convert the work done to bytes and take it from the debt */
+  vsE_setdebt(g, g->GCdebt - ((MAX_LMEM - debt) / g->gcstepmul) * STEPMULADJ);
+  return 0;
+}
+
+
+/*
+** performs a basic GC step when collector is running
+*/
+void vsC_step (vs_State *L) {
+  global_State *g = G(L);
+  if (!g->gcrunning)  /* not running? */
+    vsE_setdebt(g, -GCSTEPSIZE * 10);  /* avoid being called too often */
+  else if (g->gckind == KGC_GEN)
+    genstep(L, g);
+  else
+    incstep(L, g);
+}
+
+
+/*
+** Performs a full incremental cycle. Before running the collection,
+** check 'keepinvariant'; if it is true, there may be some objects
+** marked as black, so the collector has to sweep all objects to turn
+** them back to white (as white has not changed, nothing will be
+** collected).
+*/
+static void fullinc (vs_State *L, global_State *g) {
   if (keepinvariant(g)) {  /* black objects? */
     entersweep(L); /* sweep everything to turn them back to white */
   }
   /* finish any pending sweep phase to start a new cycle */
   vsC_runtilstate(L, bitmask(GCSpause));
   vsC_runtilstate(L, ~bitmask(GCSpause));  /* start new collection */
+  // 不需要逐步传播,直接在原子阶段一次标记完成(可以并行)
+  g->gcstate = GCSatomic;  /* propagate everything at once */
   vsC_runtilstate(L, bitmask(GCSswpend));  /* run up to finalizers */
   /* estimate must be correct after a full GC cycle */
   vs_assert(g->GCestimate == gettotalbytes(g));
   vsC_runtilstate(L, bitmask(GCSpause));  /* finish collection */
-  g->gckind = KGC_NORMAL;
   setpause(g);
 }
 
+
+/*
+** Performs a full GC cycle; if 'isemergency', set a flag to avoid
+** some operations which could change the interpreter state in some
+** unexpected ways (shrinking some structures).
+*/
+void vsC_fullgc (vs_State *L, int isemergency) {
+  global_State *g = G(L);
+  vs_assert(!g->gcemergency);
+  g->gcemergency = cast_byte(isemergency);  /* set flag */
+  if (isemergency)
+    vsC_waitfrees(L);  /* get back blocks still queued for the sweeper */
+  if (g->gckind == KGC_INC)
+    fullinc(L, g);
+  else
+    fullgen(L, g);
+  g->gcemergency = 0;
+}
+
 /* }====================================================== */
 
 
+/*
+** {======================================================
+** Heap census
+** =======================================================
+*/
+
+/*
+** 'vsC_heapdump' walks 'allgc', 'fixedgc' and the main thread once and
+** writes a JSON snapshot through 'writer':
+**   "types": count and bytes of each kind of object (tables also
+**            split into array and node bytes);
+**   "largest_tables": the 'ntop' largest tables;
+**   "roots": registry and main thread;
+**   "objects" (with VS_HEAPEDGES): [address, type, bytes, [children]]
+**            for every object, enough to compute retained sizes.
+** Dead objects not yet collected are included too (they are not
+** reachable from "roots"); run a full collection first to omit them.
+** Upvalues are not collectable objects; each closure accounts for
+** 1/refcount of each of its upvalues, and references through an
+** upvalue appear as edges from the closure to the value.
+*/
+
+#define CENSUSBUFF	4096
+
+/* kinds of objects in the census */
+enum { C_SHRSTR, C_LNGSTR, C_TABLE, C_ARRAY, C_LCL, C_CCL, C_PROTO,
+       C_UDATA, C_THREAD, C_UPVAL,
+#if defined(VS_SHAPES)
+       C_SHAPE,
+#endif
+       C_NKINDS };
+
+static const char *const censusnames[C_NKINDS] = {
+  "shortstring", "longstring", "table", "array", "lclosure", "cclosure",
+  "proto", "userdata", "thread", "upvalue",
+#if defined(VS_SHAPES)
+  "shape"
+#endif
+};
+
+typedef struct Census {
+  vs_State *L;
+  vs_Writer writer;
+  void *data;
+  int status;  /* result of the last call to 'writer' */
+  int edges;  /* write objects and edges? */
+  lu_mem nobjects;  /* objects written */
+  int nchildren;  /* children written for the current object */
+  lu_mem count[C_NKINDS];
+  lu_mem bytes[C_NKINDS];
+  lu_mem arraybytes, nodebytes;  /* parts of table bytes */
+  vs_Number upvals, upvalbytes;  /* sums of 1/refcount */
+  Table **top;  /* min-heap with the largest tables */
+  int ntop, maxtop;
+  size_t n;  /* bytes in 'buff' */
+  char buff[CENSUSBUFF];
+} Census;
+
+
+static void cflush (Census *C) {
+  if (C->n > 0 && C->status == 0)
+    C->status = (*C->writer)(C->L, C->buff, C->n, C->data);
+  C->n = 0;
+}
+
+
+static void cput (Census *C, const char *s, size_t l) {
+  if (C->n + l > CENSUSBUFF) {
+    cflush(C);
+    if (l > CENSUSBUFF) {  /* too large for the buffer? */
+      if (C->status == 0)
+        C->status = (*C->writer)(C->L, s, l, C->data);
+      return;
+    }
+  }
+  memcpy(C->buff + C->n, s, l);
+  C->n += l;
+}
+
+#define cputs(C,s)	cput(C, s, strlen(s))
+
+
+static void cputnum (Census *C, lu_mem x) {
+  char b[24];
+  int i = sizeof(b);
+  do { b[--i] = cast(char, '0' + x % 10); x /= 10; } while (x != 0);
+  cput(C, b + i, sizeof(b) - i);
+}
+
+
+static void cputaddr (Census *C, const void *p) {
+  static const char digits[] = "0123456789abcdef";
+  char b[2 * sizeof(size_t) + 4];
+  size_t x = cast(size_t, p);
+  int i = sizeof(b);
+  b[--i] = '"';
+  do { b[--i] = digits[x & 0xf]; x >>= 4; } while (x != 0);
+  b[--i] = 'x'; b[--i] = '0'; b[--i] = '"';
+  cput(C, b + i, sizeof(b) - i);
+}
+
+
+static void cedge (Census *C, GCObject *o) {
+  if (C->nchildren++ > 0) cput(C, ",", 1);
+  cputaddr(C, o);
+}
+
+#define cedgevalue(C,v)	{ if (iscollectable(v)) cedge(C, gcvalue(v)); }
+#define cedgeobject(C,o)	{ if ((o) != NULL) cedge(C, obj2gco(o)); }
+
+
+/* keep 't' if it is among the 'maxtop' largest tables seen so far */
+static void keeptable (Census *C, Table *t) {
+  lu_mem sz = sizetable(t);
+  int i = C->ntop;
+  if (C->maxtop == 0) return;
+  if (C->ntop == C->maxtop) {  /* heap full: replace its smallest table */
+    int j;
+    if (sz <= sizetable(C->top[0])) return;
+    i = 0;
+    for (;;) {  /* sift down */
+      j = 2 * i + 1;
+      if (j >= C->ntop) break;
+      if (j + 1 < C->ntop && sizetable(C->top[j + 1]) < sizetable(C->top[j]))
+        j++;
+      if (sizetable(C->top[j]) >= sz) break;
+      C->top[i] = C->top[j];
+      i = j;
+    }
+    C->top[i] = t;
+    return;
+  }
+  C->ntop++;
+  while (i > 0 && sizetable(C->top[(i - 1) / 2]) > sz) {  /* sift up */
+    C->top[i] = C->top[(i - 1) / 2];
+    i = (i - 1) / 2;
+  }
+  C->top[i] = t;
+}
+
+
+/* count object 'o' and write its entry in "objects" */
+static void censusobj (Census *C, GCObject *o) {
+  int kind;
+  lu_mem size;
+  int i;
+  switch (o->tt) {
+    case VS_TSHRSTR:
+      kind = C_SHRSTR; size = sizelstring(gco2ts(o)->shrlen); break;
+    case VS_TLNGSTR:
+      kind = C_LNGSTR; size = sizelstring(gco2ts(o)->u.lnglen); break;
+    case VS_TTABLE: {
+      Table *h = gco2t(o);
+      kind = C_TABLE; size = sizetable(h);
+      C->arraybytes += sizeof(TValue) * h->sizearray;
+      C->nodebytes += sizehash(h) + (ismoving(h) ? sizehash(&h->rh->old) : 0);
+      keeptable(C, h);
+      break;
+    }
+    case VS_TARRAY:
+      kind = C_ARRAY; size = sizetarray(gco2a(o)); break;
+    case VS_TLCL: {
+      LClosure *cl = gco2lcl(o);
+      kind = C_LCL; size = sizeLclosure(cl->nupvalues);
+      for (i = 0; i < cl->nupvalues; i++) {
+        UpVal *uv = cl->upvals[i];
+        if (uv != NULL) {
+          C->upvals += cast_num(1) / cast_num(uv->refcount);
+          C->upvalbytes += cast_num(sizeof(UpVal)) / cast_num(uv->refcount);
+        }
+      }
+      break;
+    }
+    case VS_TCCL:
+      kind = C_CCL; size = sizeCclosure(gco2ccl(o)->nupvalues); break;
+    case VS_TPROTO:
+      kind = C_PROTO; size = sizeproto(gco2p(o)); break;
+    case VS_TUSERDATA:
+      kind = C_UDATA; size = sizeudata(gco2u(o)); break;
+    case VS_TTHREAD:
+      kind = C_THREAD; size = sizethread(gco2th(o)); break;
+#if defined(VS_SHAPES)
+    case VS_TSHAPE: {
+      Shape *s = gco2sh(o);
+      kind = C_SHAPE; size = sizeshape(s->nkeys, s->lsizeidx);
+      break;
+    }
+#endif
+    default: vs_assert(0); return;
+  }
+  C->count[kind]++;
+  C->bytes[kind] += size;
+  if (!C->edges) return;
+  cputs(C, (C->nobjects == 0) ? "\n  [" : ",\n  [");
+  C->nobjects++;
+  cputaddr(C, o);
+  cput(C, ",\"", 2);
+  cputs(C, censusnames[kind]);
+  cput(C, "\",", 2);
+  cputnum(C, size);
+  cput(C, ",[", 2);
+  C->nchildren = 0;
+  switch (o->tt) {
+    case VS_TTABLE: {
+      Table *h = gco2t(o);
+      Node *n, *limit = gnodelast(h);
+      for (i = 0; i < cast_int(h->sizearray); i++)
+        cedgevalue(C, &h->array[i]);
+#if defined(VS_SHAPES)
+      if (h->shape != NULL) {
+        cedgeobject(C, h->shape);
+        for (i = 0; i < h->shape->nkeys; i++)
+          cedgevalue(C, &h->slots[i]);
+      }
+#endif
+      for (n = gnode(h, 0); n < limit; n++) {
+        if (!ttisnil(gval(n))) {
+          cedgevalue(C, gkey(n));
+          cedgevalue(C, gval(n));
+        }
+      }
+      if (ismoving(h)) {  /* nodes not moved yet */
+        limit = gnodelast(&h->rh->old);
+        for (n = gnode(&h->rh->old, 0); n < limit; n++) {
+          if (!ttisnil(gval(n))) {
+            cedgevalue(C, gkey(n));
+            cedgevalue(C, gval(n));
+          }
+        }
+      }
+      break;
+    }
+    case VS_TLCL: {
+      LClosure *cl = gco2lcl(o);
+      cedgeobject(C, cl->p);
+      for (i = 0; i < cl->nupvalues; i++) {
+        if (cl->upvals[i] != NULL)
+          cedgevalue(C, cl->upvals[i]->v);
+      }
+      break;
+    }
+    case VS_TCCL: {
+      CClosure *cl = gco2ccl(o);
+      for (i = 0; i < cl->nupvalues; i++)
+        cedgevalue(C, &cl->upvalue[i]);
+      break;
+    }
+    case VS_TPROTO: {
+      Proto *f = gco2p(o);
+      cedgeobject(C, f->source);
+      for (i = 0; i < f->sizek; i++)
+        cedgevalue(C, &f->k[i]);
+      for (i = 0; i < f->sizep; i++)
+        cedgeobject(C, f->p[i]);
+      break;
+    }
+    case VS_TUSERDATA: {
+      TValue uvalue;
+      getuservalue(C->L, gco2u(o), &uvalue);
+      cedgevalue(C, &uvalue);
+      break;
+    }
+    case VS_TTHREAD: {
+      vs_State *th = gco2th(o);
+      StkId s;
+      for (s = th->stack; th->stack != NULL && s < th->top; s++)
+        cedgevalue(C, s);
+      break;
+    }
+#if defined(VS_SHAPES)
+    case VS_TSHAPE: {
+      Shape *s = gco2sh(o);
+      cedgeobject(C, s->parent);
+      for (i = 0; i < s->nkeys; i++)
+        cedgeobject(C, s->keys[i]);
+      break;
+    }
+#endif
+    default: break;
+  }
+  cput(C, "]]", 2);
+}
+
+
+static void censuslist (Census *C, GCObject *o) {
+  for (; o != NULL; o = o->next)
+    censusobj(C, o);
+}
+
+
+int vsC_heapdump (vs_State *L, vs_Writer writer, void *data, int ntop,
+                  int flags) {
+  global_State *g = G(L);
+  Census *C = vsM_new(L, Census);
+  int i, status;
+  memset(C, 0, sizeof(Census));
+  C->L = L;
+  C->writer = writer;
+  C->data = data;
+  C->edges = (flags & VS_HEAPEDGES) != 0;
+  C->maxtop = (ntop > 0) ? ntop : 0;
+  if (C->maxtop > 0)
+    C->top = vsM_newvector(L, C->maxtop, Table *);
+  /* a sweep in progress may have freed children of dead objects */
+  if (issweepphase(g))
+    vsC_runtilstate(L, bitmask(GCSpause));
+  cputs(C, C->edges ? "{\n\"objects\": [" : "{");
+  censusobj(C, obj2gco(g->mainthread));
+  censuslist(C, g->allgc);
+  censuslist(C, g->fixedgc);
+  cputs(C, C->edges ? "\n],\n\"totalbytes\": " : "\n\"totalbytes\": ");
+  cputnum(C, cast(lu_mem, gettotalbytes(g)));
+  cputs(C, ",\n\"types\": {");
+  C->count[C_UPVAL] = cast(lu_mem, C->upvals + 0.5);
+  C->bytes[C_UPVAL] = cast(lu_mem, C->upvalbytes + 0.5);
+  for (i = 0; i < C_NKINDS; i++) {
+    cputs(C, (i == 0) ? "\n  \"" : ",\n  \"");
+    cputs(C, censusnames[i]);
+    cputs(C, "\": {\"count\": ");
+    cputnum(C, C->count[i]);
+    cputs(C, ", \"bytes\": ");
+    cputnum(C, C->bytes[i]);
+    if (i == C_TABLE) {
+      cputs(C, ", \"array_bytes\": ");
+      cputnum(C, C->arraybytes);
+      cputs(C, ", \"node_bytes\": ");
+      cputnum(C, C->nodebytes);
+    }
+    cput(C, "}", 1);
+  }
+  cputs(C, "\n},\n\"largest_tables\": [");
+  while (C->ntop > 0) {  /* largest first: sort the heap in place */
+    Table *t = C->top[0];
+    C->top[0] = C->top[--C->ntop];
+    C->top[C->ntop] = t;
+    if (C->ntop > 1) {  /* restore the heap property */
+      Table *x = C->top[0];
+      int j, k = 0;
+      for (;;) {
+        j = 2 * k + 1;
+        if (j >= C->ntop) break;
+        if (j + 1 < C->ntop && sizetable(C->top[j + 1]) < sizetable(C->top[j]))
+          j++;
+        if (sizetable(C->top[j]) >= sizetable(x)) break;
+        C->top[k] = C->top[j];
+        k = j;
+      }
+      C->top[k] = x;
+    }
+  }
+  for (i = 0; i < C->maxtop && i < cast_int(C->count[C_TABLE]); i++) {
+    Table *t = C->top[i];
+    cputs(C, (i == 0) ? "\n  {\"address\": " : ",\n  {\"address\": ");
+    cputaddr(C, t);
+    cputs(C, ", \"bytes\": ");
+    cputnum(C, sizetable(t));
+    cputs(C, ", \"array\": ");
+    cputnum(C, t->sizearray);
+    cputs(C, ", \"node\": ");
+    cputnum(C, cast(lu_mem, allocsizenode(t)));
+    cput(C, "}", 1);
+  }
+  cputs(C, "\n],\n\"roots\": [");
+  cputaddr(C, gcvalue(&g->l_registry));
+  cput(C, ",", 1);
+  cputaddr(C, g->mainthread);
+  cputs(C, "]\n}\n");
+  cflush(C);
+  status = C->status;
+  if (C->maxtop > 0)
+    vsM_freearray(L, C->top, C->maxtop);
+  vsM_free(L, C);
+  return status;
+}
+
+/* }====================================================== */
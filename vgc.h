@@ -18,6 +18,12 @@
 ** is not being enforced (e.g., sweep phase).
 */
 
+/*
+** In generational mode the collector also keeps an age for each object
+** (in the low bits of 'marked'). Old objects are always black and are
+** not traversed again in minor collections, except when a back barrier
+** "touches" them or a forward barrier makes one of their children old.
+*/
 
 
 /* how much to allocate before next GC step */
@@ -74,11 +80,14 @@
 #define testbit(x,b)		testbits(x, bitmask(b))
 
 
-/* Layout for bit use in 'marked' field: */
-#define WHITE0BIT	0  /* object is white (type 0) */
-#define WHITE1BIT	1  /* object is white (type 1) */
-#define BLACKBIT	2  /* object is black */
-#define FINALIZEDBIT	3  /* object has been marked for finalization */
+/*
+** Layout for bit use in 'marked' field. First three bits are
+** used for object "age" in generational mode.
+*/
+#define WHITE0BIT	3  /* object is white (type 0) */
+#define WHITE1BIT	4  /* object is white (type 1) */
+#define BLACKBIT	5  /* object is black */
+#define FINALIZEDBIT	6  /* object has been marked for finalization */
 /* bit 7 is currently used by tests (vsL_checkmemory) */
 
 // 同时标记white0和white1
@@ -113,6 +122,47 @@
 #define vsC_white(g)	cast(lu_byte, (g)->currentwhite & WHITEBITS)
 
 
+/* object age in generational mode */
+// 新对象是G_NEW,存活一次变成G_SURVIVAL,再存活一次变成老对象
+#define G_NEW		0	/* created in current cycle */
+#define G_SURVIVAL	1	/* created in previous cycle */
+#define G_OLD0		2	/* marked old by frw. barrier in this cycle */
+#define G_OLD1		3	/* first full cycle as old */
+#define G_OLD		4	/* really old object (not to be visited) */
+#define G_TOUCHED1	5	/* old object touched this cycle */
+#define G_TOUCHED2	6	/* old object touched in previous cycle */
+
+#define AGEBITS		7  /* all age bits (111) */
+
+#define getage(o)	((o)->marked & AGEBITS)
+#define setage(o,a)  ((o)->marked = cast_byte(((o)->marked & (~AGEBITS)) | a))
+// G_OLD0及以上都算老对象
+#define isold(o)	(getage(o) > G_SURVIVAL)
+
+#define changeage(o,f,t)  \
+	check_exp(getage(o) == (f), (o)->marked ^= ((f)^(t)))
+
+
+/* Default Values for GC parameters */
+// 分代模式下,每分配当前内存的genminormul%就执行一次次回收
+// 内存超过上次主回收后的(100+genmajormul)%时执行主回收
+#define VSI_GENMAJORMUL         100
+#define VSI_GENMINORMUL         20
+
+/*
+** 'genmajormul' can go above 255, so it is kept divided by 4 (rounded
+** up); 'genminormul' is kept as is. Larger values are clamped.
+*/
+#define setgcparam(p,v)	((p) = cast_byte(((v) + 3) / 4))
+#define getgcparam(p)	((p) * 4)
+
+#define MAXGENMINORMUL          UCHAR_MAX
+#define MAXGENMAJORMUL          (UCHAR_MAX * 4)
+
+// 并行标记最多使用的辅助线程数(需要用VS_PARALLELMARK编译)
+#define VSI_MAXGCWORKERS        16
+
+
 /*
 ** Does one step of collection when debt becomes positive. 'pre'/'pos'
 ** allows some adjustments to be done only when needed. macro
@@ -139,9 +189,23 @@
 	vsC_barrier_(L,obj2gco(p),gcvalue(v)) : cast_void(0))
 
 // barrierback是将父对象变灰,子对象依旧为白
-#define vsC_barrierback(L,p,v) (  \
+// s是被写入的槽位(不知道时为NULL),用于记录大表中被修改的区域
+#define vsC_barrierback(L,p,s,v) (  \
 	(iscollectable(v) && isblack(p) && iswhite(gcvalue(v))) ? \
-	vsC_barrierback_(L,p) : cast_void(0))
+	vsC_barrierback_(L,p,s) : cast_void(0))
+
+/*
+** A table traversed in chunks keeps a cursor and its written cards in
+** the layout of its arrays; after a resize the traversal restarts and
+** a table waiting in 'grayagain' is rescanned in full.
+*/
+#define TABTRAVERSING	1  /* table is in the middle of a traversal */
+
+#define vsC_tableresized(t) \
+	(((t)->gcflags & TABTRAVERSING) ? \
+	   cast_void(((t)->gccursor = 0, (t)->gcdirty = 0)) : \
+	 ((t)->gcdirty != 0) ? cast_void((t)->gcdirty = ~(lu_mem)0) : \
+	 cast_void(0))
 
 #define vsC_objbarrier(L,p,o) (  \
 	(isblack(p) && iswhite(o)) ? \
@@ -154,13 +218,23 @@
 VSI_FUNC void vsC_fix (vs_State *L, GCObject *o);
 VSI_FUNC void vsC_freeallobjects (vs_State *L);
 VSI_FUNC void vsC_step (vs_State *L);
+VSI_FUNC int vsC_steptime (vs_State *L, int usec);
 VSI_FUNC void vsC_runtilstate (vs_State *L, int statesmask);
 VSI_FUNC void vsC_fullgc (vs_State *L, int isemergency);
+VSI_FUNC int vsC_heapdump (vs_State *L, vs_Writer writer, void *data,
+                           int ntop, int flags);
 VSI_FUNC GCObject *vsC_newobj (vs_State *L, int tt, size_t sz);
 VSI_FUNC void vsC_barrier_ (vs_State *L, GCObject *o, GCObject *v);
-VSI_FUNC void vsC_barrierback_ (vs_State *L, Table *o);
+VSI_FUNC void vsC_barrierback_ (vs_State *L, Table *o, const TValue *slot);
 VSI_FUNC void vsC_upvalbarrier_ (vs_State *L, UpVal *uv);
 VSI_FUNC void vsC_upvdeccount (vs_State *L, UpVal *uv);
+VSI_FUNC void vsC_changemode (vs_State *L, int newmode);
+VSI_FUNC int vsC_setgcworkers (vs_State *L, int n);
+VSI_FUNC int vsC_setbgsweep (vs_State *L, int on);
+VSI_FUNC void vsC_waitfrees (vs_State *L);
+#if defined(VS_BGSWEEP)
+VSI_FUNC void vsC_deferfree (global_State *g, void *block, size_t osize);
+#endif
 
 
 #endif
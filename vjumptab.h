@@ -0,0 +1,94 @@
+/*
+** 线程化分派(threaded dispatch)使用的跳转表
+** 只在vvm.c的vsV_execute内部包含, 需要GCC的"labels as values"扩展
+** 每个操作码对应一个标签地址, 每条指令执行完毕后直接取下一条指令跳转
+** 这样每个操作码都有自己的间接跳转, 分支预测比单个switch准确
+*/
+
+#undef vmdispatch
+#undef vmcase
+#undef vmbreak
+
+#define vmdispatch(x)     goto *disptab[x];
+
+#define vmcase(l)     L_##l:
+
+// 每个指令的结尾都复制一份取指和分派
+#define vmbreak		vmfetch(); vmdispatch(GET_OPCODE(i));
+
+
+/* ORDER OP */
+static const void *const disptab[NUM_OPCODES] = {
+
+#if 0
+** you can update the following list with this command:
+**
+**  sed -n '/^OP_/\!d; s/OP_/\&\&L_OP_/ ; s/,.*/,/ ; s/\/.*/,/ ; p'  vopcodes.h
+**
+#endif
+
+&&L_OP_MOVE,
+&&L_OP_LOADK,
+&&L_OP_LOADKX,
+&&L_OP_LOADBOOL,
+&&L_OP_LOADNIL,
+&&L_OP_GETUPVAL,
+&&L_OP_GETTABUP,
+&&L_OP_GETTABLE,
+&&L_OP_SETTABUP,
+&&L_OP_SETUPVAL,
+&&L_OP_SETTABLE,
+&&L_OP_NEWTABLE,
+&&L_OP_NEWARRAY,
+&&L_OP_SELF,
+&&L_OP_ADD,
+&&L_OP_SUB,
+&&L_OP_MUL,
+&&L_OP_MOD,
+&&L_OP_POW,
+&&L_OP_DIV,
+&&L_OP_IDIV,
+&&L_OP_BAND,
+&&L_OP_BOR,
+&&L_OP_BXOR,
+&&L_OP_SHL,
+&&L_OP_SHR,
+&&L_OP_ADDI,
+&&L_OP_UNM,
+&&L_OP_BNOT,
+&&L_OP_NOT,
+&&L_OP_LEN,
+&&L_OP_CONCAT,
+&&L_OP_JMP,
+&&L_OP_EQ,
+&&L_OP_LT,
+&&L_OP_LE,
+&&L_OP_EQI,
+&&L_OP_LTI,
+&&L_OP_LEI,
+&&L_OP_GTI,
+&&L_OP_GEI,
+&&L_OP_TEST,
+&&L_OP_TESTSET,
+&&L_OP_JEQ,
+&&L_OP_JLT,
+&&L_OP_JLE,
+&&L_OP_JEQI,
+&&L_OP_JLTI,
+&&L_OP_JLEI,
+&&L_OP_JGTI,
+&&L_OP_JGEI,
+&&L_OP_JTEST,
+&&L_OP_CALL,
+&&L_OP_TAILCALL,
+&&L_OP_RETURN,
+&&L_OP_FORLOOP,
+&&L_OP_FORPREP,
+&&L_OP_TFORCALL,
+&&L_OP_TFORLOOP,
+&&L_OP_SETLIST,
+&&L_OP_CLOSURE,
+&&L_OP_VARARG,
+&&L_OP_EXTRAARG
+
+};
@@ -145,7 +145,8 @@ TString *vsX_newstring (LexState *ls, const char *str, size_t l) {
     setbvalue(o, 1);  /* t[string] = true 创建表中str项 */
     vsC_checkGC(L);
   }
-  else {  /* string already present */
+  else if (ts->tt == VS_TLNGSTR) {  /* long string already present */
+    /* (short strings are unique already, and may be in record slots) */
     ts = tsvalue(keyfromval(o));  /* re-use value previously stored 复用之前的key */
   }
   L->top--;  /* remove string from stack */
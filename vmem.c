@@ -4,6 +4,7 @@
 
 
 #include <stddef.h>
+#include <string.h>
 
 #include "vs.h"
 
@@ -12,6 +13,7 @@
 #include "vgc.h"
 #include "vmem.h"
 #include "vobject.h"
+#include "vprof.h"
 #include "vstate.h"
 
 
@@ -76,6 +78,264 @@ l_noret vsM_toobig (vs_State *L) {
 
 
 
+/*
+** {======================================================
+** Paged heap
+** =======================================================
+*/
+
+/*
+** 不超过HEAPMAXSIZE的块从页中分配. 页按HEAPPAGESIZE对齐, 所以由块的地址
+** 就能找到它所在的页; 块的大小决定了它属于页堆还是分配函数, 因此释放时
+** 传入的大小必须和分配时一致(所有释放都满足这一点)
+** Pages come from arenas allocated with 'frealloc'; a page whose blocks
+** are all free goes back to the 'empty' list and an arena whose pages
+** are all empty goes back to its allocator.
+*/
+
+#define HEAPPAGESIZE	4096  /* must be a power of 2 */
+#define ARENAPAGES	16  /* pages in each arena */
+
+#define HEAPMAXSIZE	(HEAPCLASSES * HEAPSTEP)
+
+/* is a block of size 's' in the paged heap? */
+#define inheap(s)	((s) - 1 < HEAPMAXSIZE)  /* 0 < s <= HEAPMAXSIZE */
+#define sizeclass(s)	(((s) - 1) / HEAPSTEP)
+#define classsize(c)	(((c) + 1) * HEAPSTEP)
+
+#define pageof(b)	cast(HeapPage *, cast(size_t, b) & ~(size_t)(HEAPPAGESIZE - 1))
+
+
+typedef struct HeapPage {
+  struct HeapPage *next, *prev;  /* links in 'avail' or 'empty' */
+  struct HeapArena *arena;
+  void *freelist;  /* free blocks in this page */
+  unsigned short nfree;  /* number of free blocks */
+  unsigned short nblocks;  /* number of blocks */
+  lu_byte sclass;  /* size class of the blocks */
+} HeapPage;
+
+/* offset of the first block in a page */
+#define PAGEHEADER	(((sizeof(HeapPage) + HEAPSTEP - 1) / HEAPSTEP) * HEAPSTEP)
+
+typedef struct HeapArena {
+  struct HeapArena *next, *prev;
+  vs_Alloc frealloc;  /* allocator that created the arena */
+  void *ud;
+  int nused;  /* number of pages not in the 'empty' list */
+} HeapArena;
+
+/* the pages follow the header, aligned to HEAPPAGESIZE */
+#define ARENASIZE	(sizeof(HeapArena) + (ARENAPAGES + 1) * HEAPPAGESIZE)
+
+
+static void linkpage (HeapPage **list, HeapPage *p) {
+  p->prev = NULL;
+  p->next = *list;
+  if (*list) (*list)->prev = p;
+  *list = p;
+}
+
+
+static void unlinkpage (HeapPage **list, HeapPage *p) {
+  if (p->prev) p->prev->next = p->next;
+  else *list = p->next;
+  if (p->next) p->next->prev = p->prev;
+}
+
+
+static HeapPage *firstpage (HeapArena *a) {
+  size_t addr = cast(size_t, a + 1) + HEAPPAGESIZE - 1;
+  return cast(HeapPage *, addr & ~(size_t)(HEAPPAGESIZE - 1));
+}
+
+
+static int newarena (global_State *g) {
+  Heap *h = &g->heap;
+  HeapArena *a = cast(HeapArena *, (*g->frealloc)(g->ud, NULL, 0, ARENASIZE));
+  HeapPage *p;
+  int i;
+  if (a == NULL) return 0;
+  a->frealloc = g->frealloc;
+  a->ud = g->ud;
+  a->nused = 0;
+  a->prev = NULL;
+  a->next = h->arenas;
+  if (h->arenas) h->arenas->prev = a;
+  h->arenas = a;
+  h->narenas++;
+  p = firstpage(a);
+  for (i = 0; i < ARENAPAGES; i++) {
+    p->arena = a;
+    linkpage(&h->empty, p);
+    p = cast(HeapPage *, cast(char *, p) + HEAPPAGESIZE);
+  }
+  return 1;
+}
+
+
+static void freearena (global_State *g, HeapArena *a) {
+  Heap *h = &g->heap;
+  HeapPage *p = firstpage(a);
+  int i;
+  vs_assert(a->nused == 0);
+  for (i = 0; i < ARENAPAGES; i++) {
+    unlinkpage(&h->empty, p);
+    p = cast(HeapPage *, cast(char *, p) + HEAPPAGESIZE);
+  }
+  if (a->prev) a->prev->next = a->next;
+  else h->arenas = a->next;
+  if (a->next) a->next->prev = a->prev;
+  h->narenas--;
+  (*a->frealloc)(a->ud, a, ARENASIZE, 0);
+}
+
+
+/* take an empty page and cut it into blocks of class 'c' */
+static HeapPage *newpage (global_State *g, int c) {
+  Heap *h = &g->heap;
+  HeapPage *p;
+  char *b;
+  size_t sz = classsize(c);
+  int i, n = cast_int((HEAPPAGESIZE - PAGEHEADER) / sz);
+  if (h->empty == NULL && !newarena(g))
+    return NULL;
+  p = h->empty;
+  unlinkpage(&h->empty, p);
+  p->arena->nused++;
+  p->sclass = cast_byte(c);
+  p->nblocks = p->nfree = cast(unsigned short, n);
+  b = cast(char *, p) + PAGEHEADER;
+  p->freelist = b;
+  for (i = 0; i < n - 1; i++, b += sz)
+    *cast(void **, b) = b + sz;
+  *cast(void **, b) = NULL;
+  linkpage(&h->avail[c], p);
+  return p;
+}
+
+
+static void *heapalloc (global_State *g, size_t size) {
+  int c = cast_int(sizeclass(size));
+  HeapPage *p = g->heap.avail[c];
+  void *b;
+  if (p == NULL && (p = newpage(g, c)) == NULL)
+    return NULL;
+  b = p->freelist;
+  p->freelist = *cast(void **, b);
+  if (--p->nfree == 0)  /* page is full? */
+    unlinkpage(&g->heap.avail[c], p);
+  return b;
+}
+
+
+static void heapfree (global_State *g, void *b, size_t size) {
+  Heap *h = &g->heap;
+  HeapPage *p = pageof(b);
+  int c = p->sclass;
+  /* a failed shrink may have left the block in a larger class */
+  vs_assert(c >= cast_int(sizeclass(size)));
+  UNUSED(size);
+  *cast(void **, b) = p->freelist;
+  p->freelist = b;
+  if (p->nfree++ == 0)  /* page was full? */
+    linkpage(&h->avail[c], p);
+  else if (p->nfree == p->nblocks && h->avail[c] != p) {
+    /* page is empty and it is not the one in use; release it */
+    HeapArena *a = p->arena;
+    unlinkpage(&h->avail[c], p);
+    linkpage(&h->empty, p);
+    if (--a->nused == 0 && h->narenas > 1)
+      freearena(g, a);
+  }
+}
+
+
+/* is 'b' inside one of the arenas? */
+static int inarena (Heap *h, void *b) {
+  HeapArena *a;
+  for (a = h->arenas; a != NULL; a = a->next) {
+    if (cast(char *, b) > cast(char *, a) &&
+        cast(char *, b) < cast(char *, a) + ARENASIZE)
+      return 1;
+  }
+  return 0;
+}
+
+
+/*
+** is block 'b' of size 's' in a page? 通常由大小决定; 缩小失败后留在
+** 'frealloc'中的小块(很少见)存在时才需要查找arena
+*/
+static int heapblock (global_State *g, void *b, size_t s) {
+  if (!inheap(s)) return 0;
+  return (g->heap.nforeign == 0 || inarena(&g->heap, b));
+}
+
+
+/* move a block between the heap and 'frealloc' (or between classes) */
+static void *heaprealloc (global_State *g, void *block, size_t osize,
+                                                        size_t nsize) {
+  void *newblock;
+  int oldheap = (block != NULL && heapblock(g, block, osize));
+  if (oldheap && nsize != 0 && inheap(nsize) &&
+      pageof(block)->sclass == sizeclass(nsize))
+    return block;  /* same class; nothing to do */
+  if (nsize == 0)
+    newblock = NULL;
+  else if (inheap(nsize))
+    newblock = heapalloc(g, nsize);
+  else
+    newblock = (*g->frealloc)(g->ud, NULL, 0, nsize);
+  if (newblock == NULL && nsize > 0) {
+    if (block == NULL || nsize > osize)
+      return NULL;  /* keep the old block */
+    /* a shrink cannot fail: keep the old block where it is */
+    if (oldheap)
+      return block;  /* its page still knows its class */
+    newblock = (*g->frealloc)(g->ud, block, osize, nsize);
+    vs_assert(newblock != NULL);
+    if (inheap(osize)) g->heap.nforeign--;  /* was already foreign */
+    if (inheap(nsize)) g->heap.nforeign++;
+    return newblock;
+  }
+  if (block != NULL) {
+    if (newblock != NULL)
+      memcpy(newblock, block, (osize < nsize) ? osize : nsize);
+    if (oldheap)
+      heapfree(g, block, osize);
+    else {
+      if (inheap(osize)) g->heap.nforeign--;  /* foreign block */
+      (*g->frealloc)(g->ud, block, osize, 0);
+    }
+  }
+  return newblock;
+}
+
+
+static void *tryrealloc (global_State *g, void *block, size_t osize,
+                                                       size_t nsize) {
+  if (block == NULL) osize = 0;  /* 'osize' is a tag */
+  if (inheap(osize) || inheap(nsize))
+    return heaprealloc(g, block, osize, nsize);
+  return (*g->frealloc)(g->ud, block, osize, nsize);
+}
+
+
+/* give all arenas back to their allocators (state is being closed) */
+void vsM_freeheap (vs_State *L) {
+  global_State *g = G(L);
+  while (g->heap.arenas != NULL) {
+    HeapArena *a = g->heap.arenas;
+    g->heap.arenas = a->next;
+    (*a->frealloc)(a->ud, a, ARENASIZE, 0);
+  }
+  g->heap.narenas = 0;
+}
+
+/* }====================================================== */
+
+
 /*
 ** generic allocation routine.
 */
@@ -90,15 +350,27 @@ void *vsM_realloc_ (vs_State *L, void *block, size_t osize, size_t nsize) {
   global_State *g = G(L);
   size_t realosize = (block) ? osize : 0;  // block为NULL 说明osize是0
   vs_assert((realosize == 0) == (block == NULL));
-  newblock = (*g->frealloc)(g->ud, block, osize, nsize);
+#if defined(VS_BGSWEEP)
+  if (g->gcdeferfree && nsize == 0 && block != NULL && !inheap(osize)) {
+    /* block freed by a sweep */
+    vsC_deferfree(g, block, osize);  /* background sweeper will free it */
+    g->GCdebt -= osize;
+    return NULL;
+  }
+#endif
+  // 在分配前采样, 此时调用栈一定是完整的(例如栈本身还没有被移动)
+  if (nsize > realosize)
+    vsR_allocated(L, block, osize, nsize - realosize);
+  newblock = tryrealloc(g, block, osize, nsize);
   if (newblock == NULL && nsize > 0) { // 内存分配失败
-    vs_assert(nsize > realosize);  /* cannot fail when shrinking a block 缩小空间时不应该会失败 */
+    /* cannot fail when shrinking a block 缩小空间时不应该会失败 */
+    vs_assert(nsize > realosize);
     if (g->version) {  /* is state fully built? 尝试gc后再次进行分配内存 */
       vsC_fullgc(L, 1);  /* try to free some memory... */
       // g->frealloc 实际函数 l_alloc
       // nsize是0   调用free(block)
       // nsize不是0 调用realloc(block, nsize)
-      newblock = (*g->frealloc)(g->ud, block, osize, nsize);  /* try again */
+      newblock = tryrealloc(g, block, osize, nsize);  /* try again */
     }
     if (newblock == NULL)  // 重新分配还是失败 抛出错误
       vsD_throw(L, VS_ERRMEM);
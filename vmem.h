@@ -53,6 +53,7 @@
    ((v)=cast(t *, vsM_reallocv(L, v, oldn, n, sizeof(t))))
 
 VSI_FUNC l_noret vsM_toobig (vs_State *L);
+VSI_FUNC void vsM_freeheap (vs_State *L);
 
 /* not to be called directly */
 VSI_FUNC void *vsM_realloc_ (vs_State *L, void *block, size_t oldsize,
@@ -23,6 +23,35 @@
 VSI_DDEF const TValue vsO_nilobject_ = {NILCONSTANT};
 
 
+#if defined(VS_NANBOXING)
+
+// 装箱类型NB_T*到原始type tag的映射
+VSI_DDEF const lu_byte vsO_nbtt_[16] = {
+  VS_TNIL, VS_TNIL, VS_TBOOLEAN, VS_TLIGHTUSERDATA,
+  VS_TLCF, VS_TNUMINT, VS_TDEADKEY, VS_TNIL,
+  ctb(VS_TSHRSTR), ctb(VS_TLNGSTR), ctb(VS_TTABLE), ctb(VS_TUSERDATA),
+  ctb(VS_TLCL), ctb(VS_TCCL), ctb(VS_TTHREAD), ctb(VS_TARRAY)
+};
+
+
+// 可回收对象的type tag转换成装箱类型
+int vsO_tt2nb (int tt) {
+  switch (tt) {
+    case VS_TSHRSTR: return NB_TSHRSTR;
+    case VS_TLNGSTR: return NB_TLNGSTR;
+    case VS_TTABLE: return NB_TTABLE;
+    case VS_TUSERDATA: return NB_TUSERDATA;
+    case VS_TLCL: return NB_TLCL;
+    case VS_TCCL: return NB_TCCL;
+    case VS_TTHREAD: return NB_TTHREAD;
+    case VS_TARRAY: return NB_TARRAY;
+    default: vs_assert(0); return NB_TNIL;
+  }
+}
+
+#endif
+
+
 /*
 ** converts an integer to a "floating point byte", represented as
 ** (eeeeexxx), where the real value is (1xxx) * 2^(eeeee - 1) if
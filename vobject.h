@@ -21,6 +21,10 @@
 #define VS_TPROTO	VS_NUMTAGS		/* function prototypes 函数原型*/
 // 如果一个key对应的value被设置为nil了,这个key就会被标记为VS_TDEADKEY
 #define VS_TDEADKEY	(VS_NUMTAGS+1)		/* removed keys in tables 元表中删除的key */
+#if defined(VS_SHAPES)
+// 记录表的形状 也不是值类型, 作为VS_TPROTO的变体
+#define VS_TSHAPE	(VS_TPROTO | (1 << 4))	/* shapes of record tables */
+#endif
 
 /*
 ** number of all possible tags (including VS_TNONE but excluding DEADKEY)
@@ -66,6 +70,11 @@
 #define VS_TNUMINT	(VS_TNUMBER | (1 << 4))  /* integer numbers */
 
 
+/* Variant tags for tables */
+// 类型化数组也是表 元素是同一种不装箱的数字, 见vtable.c
+#define VS_TARRAY	(VS_TTABLE | (1 << 4))  /* typed arrays */
+
+
 /* Bit mark for collectable types */
 #define BIT_ISCOLLECTABLE	(1 << 6)
 
@@ -109,6 +118,83 @@ typedef union Value {
 } Value;
 
 
+#if defined(VS_NANBOXING)	/* { */
+
+/*
+** NaN-boxing表示: TValue只占用一个64位字
+** 浮点数直接保存IEEE754的位模式, 所有的NaN都被规范成NB_NAN
+** 其他类型都保存在符号位为1的quiet NaN空间里:
+**   位63-51 全是1 (NB_BOXBASE)
+**   位50-47 装箱类型NB_T*, 8以上是可回收类型
+**   位46-0  47位载荷 指针/布尔值/整数
+** 整数只有47位, 超出范围的整数(运算结果, vs_pushinteger等)变成浮点数
+** (vsconf.h中相应缩小了VS_MAXINTEGER和VS_MININTEGER)
+** 指针和轻量级c函数必须位于47位的用户地址空间内
+*/
+
+#include <stdint.h>
+
+#if VS_FLOAT_TYPE != VS_FLOAT_DOUBLE || VS_INT_TYPE != VS_INT_LONGLONG
+#error "VS_NANBOXING requires 'double' floats and 64-bit integers"
+#endif
+
+#define NB_BOXBASE	UINT64_C(0xFFF8000000000000)
+#define NB_PAYLOAD	UINT64_C(0x00007FFFFFFFFFFF)
+#define NB_NAN		UINT64_C(0x7FF8000000000000)  /* 规范化的NaN */
+#define NB_TAGSHIFT	47
+
+/* 装箱类型 */
+#define NB_TNIL		1
+#define NB_TBOOLEAN	2
+#define NB_TLIGHTUD	3
+#define NB_TLCF		4
+#define NB_TNUMINT	5
+#define NB_TDEADKEY	6
+#define NB_TSHRSTR	8
+#define NB_TLNGSTR	9
+#define NB_TTABLE	10
+#define NB_TUSERDATA	11
+#define NB_TLCL		12
+#define NB_TCCL		13
+#define NB_TTHREAD	14
+#define NB_TARRAY	15
+
+#define TValuefields	union { uint64_t u; vs_Number n; } nb_
+
+typedef struct vs_TValue {
+  TValuefields;
+} TValue;
+
+
+// 装箱类型t对应的高17位
+#define nbhead(t)	((NB_BOXBASE >> NB_TAGSHIFT) | (t))
+// 生成类型为t 载荷为p的装箱值
+#define nbbox(t,p)	((cast(uint64_t, nbhead(t)) << NB_TAGSHIFT) | (p))
+
+#define nbbits(o)	((o)->nb_.u)
+#define nbhi(o)		(nbbits(o) >> NB_TAGSHIFT)
+#define nbtag(o)	cast_int(nbhi(o) & 0xF)
+#define nbisbox(o)	(nbbits(o) >= NB_BOXBASE)
+#define nbpayload(o)	(nbbits(o) & NB_PAYLOAD)
+#define nbptr(o)	cast(void *, cast(size_t, nbpayload(o)))
+#define checknbtag(o,t)	(nbhi(o) == nbhead(t))
+
+/* does integer 'i' fit in the 47-bit payload? */
+#define nbfitsint(i)	(l_castS2U(i) + l_castS2U(-VS_MININTEGER) <= NB_PAYLOAD)
+
+
+/* macro defining a nil value */
+#define NILCONSTANT	{nbbox(NB_TNIL, 0)}
+
+
+/* raw type tag of a TValue */
+// 装箱类型到原始type tag的映射保存在vsO_nbtt_中
+#define rttype(o)	(nbisbox(o) ? vsO_nbtt_[nbtag(o)] : VS_TNUMFLT)
+
+VSI_DDEC const lu_byte vsO_nbtt_[16];
+
+#else				/* }{ */
+
 #define TValuefields	Value value_; int tt_
 
 // 使用value_表示真实值, tt_标记类型
@@ -132,6 +218,8 @@ typedef struct vs_TValue {
 // 取出原始type tag
 #define rttype(o)	((o)->tt_)
 
+#endif				/* } */
+
 /* tag with no variants (bits 0-3) */
 // 去掉变体部分 只有最后4位 即主类型
 #define novariant(x)	((x) & 0x0F)
@@ -148,6 +236,60 @@ typedef struct vs_TValue {
 /* Macros to test type */
 #define checktag(o,t)		(rttype(o) == (t))  // 检查主类型加变体类型
 #define checktype(o,t)		(ttnov(o) == (t)) // 只检查主类型
+#if defined(VS_NANBOXING)	/* { */
+
+#define ttisnumber(o)		(!nbisbox(o) || checknbtag(o, NB_TNUMINT))
+#define ttisfloat(o)		(!nbisbox(o))
+#define ttisinteger(o)		checknbtag((o), NB_TNUMINT)
+#define ttisnil(o)		checknbtag((o), NB_TNIL)
+#define ttisboolean(o)		checknbtag((o), NB_TBOOLEAN)
+#define ttislightuserdata(o)	checknbtag((o), NB_TLIGHTUD)
+#define ttisstring(o)		((nbhi(o) | 1) == nbhead(NB_TLNGSTR))
+#define ttisshrstring(o)	checknbtag((o), NB_TSHRSTR)
+#define ttislngstring(o)	checknbtag((o), NB_TLNGSTR)
+#define ttistable(o)		checknbtag((o), NB_TTABLE)
+#define ttisarray(o)		checknbtag((o), NB_TARRAY)
+#define ttisfunction(o)		(ttisclosure(o) || ttislcf(o))
+#define ttisclosure(o)		((nbhi(o) | 1) == nbhead(NB_TCCL))
+#define ttisCclosure(o)		checknbtag((o), NB_TCCL)
+#define ttisLclosure(o)		checknbtag((o), NB_TLCL)
+#define ttislcf(o)		checknbtag((o), NB_TLCF)
+#define ttisfulluserdata(o)	checknbtag((o), NB_TUSERDATA)
+#define ttisthread(o)		checknbtag((o), NB_TTHREAD)
+#define ttisdeadkey(o)		checknbtag((o), NB_TDEADKEY)
+
+
+/* Macros to access values */
+// 整数需要把47位载荷做符号扩展
+#define ivalue(o)	check_exp(ttisinteger(o), \
+	l_castU2S(nbbits(o) << (64 - NB_TAGSHIFT)) >> (64 - NB_TAGSHIFT))
+#define fltvalue(o)	check_exp(ttisfloat(o), (o)->nb_.n)
+#define nvalue(o)	check_exp(ttisnumber(o), \
+	(ttisinteger(o) ? cast_num(ivalue(o)) : fltvalue(o)))
+#define gcvalue(o)	check_exp(iscollectable(o), cast(GCObject *, nbptr(o)))
+#define pvalue(o)	check_exp(ttislightuserdata(o), nbptr(o))
+#define tsvalue(o)	check_exp(ttisstring(o), gco2ts(nbptr(o)))
+#define uvalue(o)	check_exp(ttisfulluserdata(o), gco2u(nbptr(o)))
+#define clvalue(o)	check_exp(ttisclosure(o), gco2cl(nbptr(o)))
+#define clLvalue(o)	check_exp(ttisLclosure(o), gco2lcl(nbptr(o)))
+#define clCvalue(o)	check_exp(ttisCclosure(o), gco2ccl(nbptr(o)))
+#define fvalue(o)	check_exp(ttislcf(o), \
+	cast(vs_CFunction, cast(size_t, nbpayload(o))))
+#define hvalue(o)	check_exp(ttistable(o), gco2t(nbptr(o)))
+#define arrvalue(o)	check_exp(ttisarray(o), gco2a(nbptr(o)))
+#define bvalue(o)	check_exp(ttisboolean(o), cast_int(nbpayload(o)))
+#define thvalue(o)	check_exp(ttisthread(o), gco2th(nbptr(o)))
+/* a dead value may get the 'gc' field, but cannot access its contents */
+#define deadvalue(o)	check_exp(ttisdeadkey(o), nbptr(o))
+
+#define l_isfalse(o)	(ttisnil(o) || (ttisboolean(o) && bvalue(o) == 0))
+
+
+// 可回收类型的装箱类型都不小于NB_TSHRSTR, 浮点数的高17位一定更小
+#define iscollectable(o)	(nbhi(o) >= nbhead(NB_TSHRSTR))
+
+#else				/* }{ */
+
 #define ttisnumber(o)		checktype((o), VS_TNUMBER)
 #define ttisfloat(o)		checktag((o), VS_TNUMFLT)
 #define ttisinteger(o)		checktag((o), VS_TNUMINT)
@@ -158,6 +300,7 @@ typedef struct vs_TValue {
 #define ttisshrstring(o)	checktag((o), ctb(VS_TSHRSTR))
 #define ttislngstring(o)	checktag((o), ctb(VS_TLNGSTR))
 #define ttistable(o)		checktag((o), ctb(VS_TTABLE))
+#define ttisarray(o)		checktag((o), ctb(VS_TARRAY))
 #define ttisfunction(o)		checktype(o, VS_TFUNCTION)
 // 闭包有vs闭包和c闭包
 // 要检查vs类型是否是闭包 首先必须是VS_TFUNCTION
@@ -196,6 +339,8 @@ typedef struct vs_TValue {
 #define fvalue(o)	check_exp(ttislcf(o), val_(o).f)
 // 表类型
 #define hvalue(o)	check_exp(ttistable(o), gco2t(val_(o).gc))
+// 类型化数组
+#define arrvalue(o)	check_exp(ttisarray(o), gco2a(val_(o).gc))
 #define bvalue(o)	check_exp(ttisboolean(o), val_(o).b)
 #define thvalue(o)	check_exp(ttisthread(o), gco2th(val_(o).gc))
 /* a dead value may get the 'gc' field, but cannot access its contents */
@@ -206,6 +351,8 @@ typedef struct vs_TValue {
 
 #define iscollectable(o)	(rttype(o) & BIT_ISCOLLECTABLE)
 
+#endif				/* } */
+
 
 /* Macros for internal tests */
 // 检测type tag是否正确
@@ -223,6 +370,77 @@ typedef struct vs_TValue {
 /* Macros to set values */
 // 一系列宏 用于赋值
 // 主要操作是修改真实值以及修改type tag
+#if defined(VS_NANBOXING)	/* { */
+
+#define setnbbits(o,b)	((o)->nb_.u=(b))
+
+// 硬件产生的NaN可能落在装箱空间里, 写入前规范成NB_NAN
+#define setfltvalue(obj,x) \
+  { TValue *io=(obj); io->nb_.n=(x); \
+    if (nbisbox(io)) setnbbits(io, NB_NAN); }
+
+#define chgfltvalue(obj,x) \
+  { TValue *io=(obj); vs_assert(ttisfloat(io)); io->nb_.n=(x); \
+    if (nbisbox(io)) setnbbits(io, NB_NAN); }
+
+// 超出47位的整数(例如运算结果)保存成浮点数, 数值和64位整数相同(只损失精度)
+#define setivalue(obj,x) \
+  { TValue *io=(obj); vs_Integer iv_=(x); \
+    if (nbfitsint(iv_)) \
+      setnbbits(io, nbbox(NB_TNUMINT, l_castS2U(iv_) & NB_PAYLOAD)); \
+    else io->nb_.n = cast_num(iv_); }
+
+// 只用于for循环, 那里的值不会超出范围
+#define chgivalue(obj,x) \
+  { TValue *io=(obj); vs_Integer iv_=(x); \
+    vs_assert(ttisinteger(io) && nbfitsint(iv_)); \
+    setnbbits(io, nbbox(NB_TNUMINT, l_castS2U(iv_) & NB_PAYLOAD)); }
+
+#define setnilvalue(obj) setnbbits(obj, nbbox(NB_TNIL, 0))
+
+// 把指针p装箱成类型t写入obj
+#define setnbptr(obj,t,p) \
+  { TValue *io_=(obj); size_t p_=cast(size_t, (p)); \
+    vs_assert(p_ <= NB_PAYLOAD); setnbbits(io_, nbbox(t, p_)); }
+
+#define setfvalue(obj,x)	setnbptr(obj, NB_TLCF, x)
+
+#define setpvalue(obj,x)	setnbptr(obj, NB_TLIGHTUD, x)
+
+#define setbvalue(obj,x) \
+  { TValue *io=(obj); \
+    setnbbits(io, nbbox(NB_TBOOLEAN, cast(uint64_t, (x) != 0))); }
+
+#define setgcovalue(L,obj,x) \
+  { GCObject *i_g=(x); setnbptr(obj, vsO_tt2nb(i_g->tt), i_g); }
+
+#define setsvalue(L,obj,x) \
+  { TString *x_ = (x); \
+    setnbptr(obj, x_->tt == VS_TSHRSTR ? NB_TSHRSTR : NB_TLNGSTR, x_); }
+
+#define setuvalue(L,obj,x) \
+  { Udata *x_ = (x); setnbptr(obj, NB_TUSERDATA, x_); }
+
+#define setthvalue(L,obj,x) \
+  { vs_State *x_ = (x); setnbptr(obj, NB_TTHREAD, x_); }
+
+#define setclLvalue(L,obj,x) \
+  { LClosure *x_ = (x); setnbptr(obj, NB_TLCL, x_); }
+
+#define setclCvalue(L,obj,x) \
+  { CClosure *x_ = (x); setnbptr(obj, NB_TCCL, x_); }
+
+#define sethvalue(L,obj,x) \
+  { Table *x_ = (x); setnbptr(obj, NB_TTABLE, x_); }
+
+#define setarrvalue(L,obj,x) \
+  { TArray *x_ = (x); setnbptr(obj, NB_TARRAY, x_); }
+
+// 保留原来的指针, vsH_next还需要用它来比较已经被删除的键
+#define setdeadvalue(obj)	setnbbits(obj, nbbox(NB_TDEADKEY, nbpayload(obj)))
+
+#else				/* }{ */
+
 #define settt_(o,t)	((o)->tt_=(t))
 
 #define setfltvalue(obj,x) \
@@ -283,8 +501,15 @@ typedef struct vs_TValue {
     val_(io).gc = obj2gco(x_); settt_(io, ctb(VS_TTABLE)); \
     checkliveness(L,io); }
 
+#define setarrvalue(L,obj,x) \
+  { TValue *io = (obj); TArray *x_ = (x); \
+    val_(io).gc = obj2gco(x_); settt_(io, ctb(VS_TARRAY)); \
+    checkliveness(L,io); }
+
 #define setdeadvalue(obj)	settt_(obj, VS_TDEADKEY)
 
+#endif				/* } */
+
 
 // 直接进行赋值
 #define setobj(L,obj1,obj2) \
@@ -391,12 +616,19 @@ typedef union UTString {
 typedef struct Udata {
   // commonHeader中的tt 指定了类型位Udata
   CommonHeader;
+#if defined(VS_NANBOXING)
+  // NaN-boxing时关联值本身就是一个TValue
+  TValue user_;  /* user value */
+  // 申请的内存块的大小
+  size_t len;  /* number of bytes */
+#else
   // 关联的值类型,和下面的user_组合
   lu_byte ttuv_;  /* user value's tag */
   // 申请的内存块的大小
   size_t len;  /* number of bytes */
   // 关联值,实际存放数据的地方
   union Value user_;  /* user value */
+#endif
 } Udata;
 
 
@@ -411,10 +643,22 @@ typedef union UUdata {
 
 /*
 **  Get the address of memory block inside 'Udata'.
-** (Access to 'ttuv_' ensures that value is really a 'Udata'.)
+** (Access to 'len' ensures that value is really a 'Udata'.)
 */
 #define getudatamem(u)  \
-  check_exp(sizeof((u)->ttuv_), (cast(char*, (u)) + sizeof(UUdata)))
+  check_exp(sizeof((u)->len), (cast(char*, (u)) + sizeof(UUdata)))
+
+#if defined(VS_NANBOXING)
+
+#define setuservalue(L,u,o) \
+	{ const TValue *io=(o); Udata *iu = (u); \
+	  iu->user_ = *io; checkliveness(L,io); }
+
+#define getuservalue(L,u,o) \
+	{ TValue *io=(o); const Udata *iu = (u); \
+	  *io = iu->user_; checkliveness(L,io); }
+
+#else
 
 // 不论是get还是set都是两步 1.设置值 2.设置type tag
 // 把o的值设置到u上 o是TValue,u是Udata
@@ -429,6 +673,8 @@ typedef union UUdata {
 	  io->value_ = iu->user_; settt_(io, iu->ttuv_); \
 	  checkliveness(L,io); }
 
+#endif
+
 
 /*
 ** Description of an upvalue for function prototypes
@@ -461,6 +707,35 @@ typedef struct LocVar {
 
 
 
+#if defined(VS_SHAPES)
+
+/*
+** Shape of record tables (see vtable.c): the keys of a shape are the
+** keys of its parent plus one more, in slot order. A shape with more
+** than SHAPELINEAR keys has an index after 'keys': 2^lsizeidx bytes
+** with 1 + the slot of each key, by hash (0 is empty).
+*/
+typedef struct Shape {
+  CommonHeader;
+  lu_byte nkeys;  /* number of keys (and used slots) */
+  lu_byte lsizeidx;  /* log2 of size of the index (0 if none) */
+  size_t id;  /* unique identity, for inline caches */
+  struct Shape *parent;  /* shape without the last key */
+  struct Shape *child;  /* first shape with one more key (weak) */
+  struct Shape *sibling;  /* next child of 'parent' */
+  TString *keys[1];  /* keys, in slot order */
+} Shape;
+
+
+/* inline cache of a field access (see vvm.c) */
+typedef struct ShapeCache {
+  size_t id;  /* id of the shape seen last time (0 if none) */
+  int slot;  /* slot of the key in that shape */
+} ShapeCache;
+
+#endif
+
+
 // 函数原型
 typedef struct Proto {
   CommonHeader;
@@ -474,6 +749,10 @@ typedef struct Proto {
   // 子函数数组的长度
   int sizep;  /* size of 'p' */
   int sizelocvars;
+  int sizetcache;  /* size of 'tcache' */
+#if defined(VS_SHAPES)
+  int sizescache;  /* size of 'scache' */
+#endif
   int linedefined;  /* debug information  */
   int lastlinedefined;  /* debug information  */
   TValue *k;  /* constants used by the function */
@@ -484,6 +763,16 @@ typedef struct Proto {
   LocVar *locvars;  /* information about local variables (debug information) */
   Upvaldesc *upvalues;  /* upvalue information */
   struct LClosure *cache;  /* last-created closure with this prototype */
+  // OP_GETTABUP/OP_SETTABUP的内联缓存 按pc索引 记录上次查到的Node下标
+  int *tcache;  /* inline caches for table accesses through upvalues */
+#if defined(VS_SHAPES)
+  // OP_GETTABLE/OP_SETTABLE/OP_SELF的内联缓存 按pc索引 记录上次的形状和槽位
+  ShapeCache *scache;  /* inline caches for field accesses */
+#endif
+#if defined(VS_OPCOUNTS)
+  // 每条指令执行的次数, 第一次执行时才创建
+  lu_mem *opcount;  /* executions of each instruction (or NULL) */
+#endif
   TString  *source;  /* used for debug information */
   GCObject *gclist;
 } Proto;
@@ -549,10 +838,16 @@ typedef union TKey {
 /* copy a value into a key without messing up field 'next' */
 // 向TKey类型写入一个TValue
 // 直接写入tvk会导致next被覆盖
+#if defined(VS_NANBOXING)
+#define setnodekey(L,key,obj) \
+	{ TKey *k_=(key); const TValue *io_=(obj); \
+	  k_->nk.nb_.u = io_->nb_.u; (void)L; checkliveness(L,io_); }
+#else
 #define setnodekey(L,key,obj) \
 	{ TKey *k_=(key); const TValue *io_=(obj); \
 	  k_->nk.value_ = io_->value_; k_->nk.tt_ = io_->tt_; \
 	  (void)L; checkliveness(L,io_); }
+#endif
 
 
 // Node就是table的一项 分为键和值
@@ -566,20 +861,57 @@ typedef struct Table {
   CommonHeader;
   // lsizenode 字段是该表Hash桶大小的log2值,Hash桶数组大小一定是2的次方,当扩展Hash桶的时候每次需要乘以2。
   lu_byte lsizenode;  /* log2 of size of 'node' array */
+  // 大表分段遍历的状态, 见vgc.c
+  lu_byte gcflags;  /* state of a chunked traversal */
   // sizearray 字段表示该表数组部分的size
   unsigned int sizearray;  /* size of 'array' array */
+  // 上次#t找到的边界, 见vsH_getn
+  unsigned int lenhint;  /* a border of the table (maybe outdated) */
   // array 指向该表的数组部分的起始位置。
   TValue *array;  /* array part */
   // node 指向该表的Hash部分的起始位置。
   // node部分使用了开放定址法实现哈希表
   Node *node;
+#if defined(VS_SWISSTABLE)
+  // 开放定址的哈希部分 每个Node有一个控制字节, 见vtable.c
+  lu_byte *ctrl;  /* control bytes of the hash part */
+  int growthleft;  /* number of new keys that still fit in 'node' */
+#else
   // lastfree 指向Lua表的Hash 部分的末尾位置。
   Node *lastfree;  /* any free position is before this position */
+#endif
+  // 大哈希部分的整数键计数和搬迁状态, 见vtable.c
+  struct Rehash *rh;  /* only for large hash parts (or NULL) */
+#if defined(VS_SHAPES)
+  // 记录表的形状和各个key的值 不是记录表时shape是NULL, 见vtable.c
+  struct Shape *shape;  /* shape of a record (or NULL) */
+  TValue *slots;  /* values of the keys of 'shape' */
+  lu_byte sizeslots;  /* size of 'slots' */
+#endif
   // gclist GC相关的链表。 
   GCObject *gclist;
+  unsigned int gccursor;  /* next slot of a chunked traversal */
+  lu_mem gcdirty;  /* cards written since the table was traversed */
 } Table;
 
 
+/*
+** Typed arrays (see vtable.c): elements 1..'size' are numbers of type
+** 'etype', stored unboxed in 'u'.
+*/
+typedef struct TArray {
+  CommonHeader;
+  lu_byte etype;  /* VS_AINT64, VS_ADOUBLE or VS_ABYTE */
+  unsigned int size;  /* number of elements */
+  unsigned int sizealloc;  /* number of elements allocated in 'u' */
+  union {
+    vs_Integer *i;
+    vs_Number *n;
+    lu_byte *b;
+  } u;
+} TArray;
+
+
 
 // 求s%size 由于size一定是2的指数 所以使用了下面的位运算加速
 // 当b是2的指数时 mod(a,b) 与 a&(b-1)等价 一般的编译器也会对这种情况进行优化
@@ -602,6 +934,9 @@ VSI_DDEC const TValue vsO_nilobject_;
 // 设置vsO_utf8esc函数缓存区的大小
 #define UTF8BUFFSZ	8
 
+#if defined(VS_NANBOXING)
+VSI_FUNC int vsO_tt2nb (int tt);
+#endif
 VSI_FUNC int vsO_int2fb (unsigned int x);
 VSI_FUNC int vsO_fb2int (int x);
 VSI_FUNC int vsO_utf8esc (char *buff, unsigned long x);
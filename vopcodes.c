@@ -21,6 +21,7 @@ VSI_DDEF const char *const vsP_opnames[NUM_OPCODES+1] = {
   "SETUPVAL",
   "SETTABLE",
   "NEWTABLE",
+  "NEWARRAY",
   "SELF",
   "ADD",
   "SUB",
@@ -34,6 +35,7 @@ VSI_DDEF const char *const vsP_opnames[NUM_OPCODES+1] = {
   "BXOR",
   "SHL",
   "SHR",
+  "ADDI",
   "UNM",
   "BNOT",
   "NOT",
@@ -43,8 +45,22 @@ VSI_DDEF const char *const vsP_opnames[NUM_OPCODES+1] = {
   "EQ",
   "LT",
   "LE",
+  "EQI",
+  "LTI",
+  "LEI",
+  "GTI",
+  "GEI",
   "TEST",
   "TESTSET",
+  "JEQ",
+  "JLT",
+  "JLE",
+  "JEQI",
+  "JLTI",
+  "JLEI",
+  "JGTI",
+  "JGEI",
+  "JTEST",
   "CALL",
   "TAILCALL",
   "RETURN",
@@ -76,6 +92,7 @@ VSI_DDEF const lu_byte vsP_opmodes[NUM_OPCODES] = {
  ,opmode(0, 0, OpArgU, OpArgN, iABC)		/* OP_SETUPVAL */
  ,opmode(0, 0, OpArgK, OpArgK, iABC)		/* OP_SETTABLE */
  ,opmode(0, 1, OpArgU, OpArgU, iABC)		/* OP_NEWTABLE */
+ ,opmode(0, 1, OpArgK, OpArgN, iABx)		/* OP_NEWARRAY */
  ,opmode(0, 1, OpArgR, OpArgK, iABC)		/* OP_SELF */
  ,opmode(0, 1, OpArgK, OpArgK, iABC)		/* OP_ADD */
  ,opmode(0, 1, OpArgK, OpArgK, iABC)		/* OP_SUB */
@@ -89,6 +106,7 @@ VSI_DDEF const lu_byte vsP_opmodes[NUM_OPCODES] = {
  ,opmode(0, 1, OpArgK, OpArgK, iABC)		/* OP_BXOR */
  ,opmode(0, 1, OpArgK, OpArgK, iABC)		/* OP_SHL */
  ,opmode(0, 1, OpArgK, OpArgK, iABC)		/* OP_SHR */
+ ,opmode(0, 1, OpArgR, OpArgU, iABC)		/* OP_ADDI */
  ,opmode(0, 1, OpArgR, OpArgN, iABC)		/* OP_UNM */
  ,opmode(0, 1, OpArgR, OpArgN, iABC)		/* OP_BNOT */
  ,opmode(0, 1, OpArgR, OpArgN, iABC)		/* OP_NOT */
@@ -98,8 +116,22 @@ VSI_DDEF const lu_byte vsP_opmodes[NUM_OPCODES] = {
  ,opmode(1, 0, OpArgK, OpArgK, iABC)		/* OP_EQ */
  ,opmode(1, 0, OpArgK, OpArgK, iABC)		/* OP_LT */
  ,opmode(1, 0, OpArgK, OpArgK, iABC)		/* OP_LE */
+ ,opmode(1, 0, OpArgR, OpArgU, iABC)		/* OP_EQI */
+ ,opmode(1, 0, OpArgR, OpArgU, iABC)		/* OP_LTI */
+ ,opmode(1, 0, OpArgR, OpArgU, iABC)		/* OP_LEI */
+ ,opmode(1, 0, OpArgR, OpArgU, iABC)		/* OP_GTI */
+ ,opmode(1, 0, OpArgR, OpArgU, iABC)		/* OP_GEI */
  ,opmode(1, 0, OpArgN, OpArgU, iABC)		/* OP_TEST */
  ,opmode(1, 1, OpArgR, OpArgU, iABC)		/* OP_TESTSET */
+ ,opmode(0, 0, OpArgK, OpArgU, iABC)		/* OP_JEQ */
+ ,opmode(0, 0, OpArgK, OpArgU, iABC)		/* OP_JLT */
+ ,opmode(0, 0, OpArgK, OpArgU, iABC)		/* OP_JLE */
+ ,opmode(0, 0, OpArgU, OpArgU, iABC)		/* OP_JEQI */
+ ,opmode(0, 0, OpArgU, OpArgU, iABC)		/* OP_JLTI */
+ ,opmode(0, 0, OpArgU, OpArgU, iABC)		/* OP_JLEI */
+ ,opmode(0, 0, OpArgU, OpArgU, iABC)		/* OP_JGTI */
+ ,opmode(0, 0, OpArgU, OpArgU, iABC)		/* OP_JGEI */
+ ,opmode(0, 0, OpArgN, OpArgU, iABC)		/* OP_JTEST */
  ,opmode(0, 1, OpArgU, OpArgU, iABC)		/* OP_CALL */
  ,opmode(0, 1, OpArgU, OpArgU, iABC)		/* OP_TAILCALL */
  ,opmode(0, 0, OpArgU, OpArgN, iABC)		/* OP_RETURN */
@@ -86,6 +86,7 @@ enum OpMode {iABC, iABx, iAsBx, iAx};  /* basic instruction format */
 #define MAXARG_A        ((1<<SIZE_A)-1)   // 2^8-1
 #define MAXARG_B        ((1<<SIZE_B)-1)   // 2^9-1
 #define MAXARG_C        ((1<<SIZE_C)-1)   // 2^9-1
+#define MAXARG_sC        (MAXARG_C>>1)    // 2^8-1      /* 'sC' is signed */
 
 
 /* creates a mask with 'n' 1 bits at position 'p' */
@@ -127,6 +128,20 @@ enum OpMode {iABC, iABx, iAsBx, iAx};  /* basic instruction format */
 #define GETARG_C(i)	getarg(i, POS_C, SIZE_C)
 #define SETARG_C(i,v)	setarg(i, v, POS_C, SIZE_C)
 
+// sC是立即数形式的参数C 表示范围 -(2^8-1) 到 2^8
+#define GETARG_sC(i)	(GETARG_C(i)-MAXARG_sC)
+#define SETARG_sC(i,v)	SETARG_C((i),cast(unsigned int, (v)+MAXARG_sC))
+
+// 融合的立即数比较指令(OP_JEQI等)把OP_EQI等的sC放在参数B中
+#define GETARG_sB(i)	(GETARG_B(i)-MAXARG_sC)
+
+// 比较跳转融合指令(OP_JEQ等)的参数C 最高位是条件k 剩余8位是有符号跳转偏移sJ
+#define SIZE_sJ		(SIZE_C - 1)
+#define MAXARG_sJ	((1<<(SIZE_sJ-1))-1)   // 2^7-1
+#define GETARG_k(i)	(GETARG_C(i) >> SIZE_sJ)
+#define GETARG_sJ(i)	(cast_int(GETARG_C(i) & MASK1(SIZE_sJ,0))-MAXARG_sJ)
+#define CREATE_kJ(k,j)	(((k)<<SIZE_sJ) | ((j)+MAXARG_sJ))
+
 #define GETARG_Bx(i)	getarg(i, POS_Bx, SIZE_Bx)
 #define SETARG_Bx(i,v)	setarg(i, v, POS_Bx, SIZE_Bx)
 
@@ -215,6 +230,8 @@ OP_SETTABLE,/*	A B C	R(A)[RK(B)] := RK(C)				*/
 // 在R(A)位置新建一个表 参数B代表array部分大小 参数C代表hash部分大小
 // 参数BC的表示方法查看vsO_int2fb
 OP_NEWTABLE,/*	A B C	R(A) := {} (size = B,C)				*/
+// 复制常量表中的类型化数组 用于::int64{...}这样的字面量
+OP_NEWARRAY,/*	A Bx	R(A) := copy of typed array Kst(Bx)		*/
 
 // 例如语句a:b('x')
 // 开始时参数B存放表a,参数C存放字符串常量'b'
@@ -233,6 +250,8 @@ OP_BOR,/*	A B C	R(A) := RK(B) | RK(C)				*/
 OP_BXOR,/*	A B C	R(A) := RK(B) ~ RK(C)				*/
 OP_SHL,/*	A B C	R(A) := RK(B) << RK(C)				*/
 OP_SHR,/*	A B C	R(A) := RK(B) >> RK(C)				*/
+// 第二个操作数是小整数字面量的加法, a-k也编码成ADDI a -k
+OP_ADDI,/*	A B sC	R(A) := R(B) + sC				*/
 OP_UNM,/*	A B	R(A) := -R(B)					*/
 OP_BNOT,/*	A B	R(A) := ~R(B)					*/
 OP_NOT,/*	A B	R(A) := not R(B)				*/
@@ -246,10 +265,28 @@ OP_JMP,/*	A sBx	pc+=sBx; if (A) close all upvalues >= R(A - 1)	*/
 OP_EQ,/*	A B C	if ((RK(B) == RK(C)) ~= A) then pc++		*/
 OP_LT,/*	A B C	if ((RK(B) <  RK(C)) ~= A) then pc++		*/
 OP_LE,/*	A B C	if ((RK(B) <= RK(C)) ~= A) then pc++		*/
+// 与小整数字面量比较,只需要检查R(B)的类型,同样紧跟一条OP_JMP指令
+OP_EQI,/*	A B sC	if ((R(B) == sC) ~= A) then pc++		*/
+OP_LTI,/*	A B sC	if ((R(B) <  sC) ~= A) then pc++		*/
+OP_LEI,/*	A B sC	if ((R(B) <= sC) ~= A) then pc++		*/
+OP_GTI,/*	A B sC	if ((R(B) >  sC) ~= A) then pc++		*/
+OP_GEI,/*	A B sC	if ((R(B) >= sC) ~= A) then pc++		*/
 
 OP_TEST,/*	A C	if not (R(A) <=> C) then pc++			*/
 OP_TESTSET,/*	A B C	if (R(B) <=> C) then R(A) := R(B) else pc++	*/
 
+// 比较与跳转融合的指令,由vsK_finish把测试指令和后面的OP_JMP合并而成
+// 条件成立时直接跳转 不需要再取出下一条OP_JMP指令
+OP_JEQ,/*	A B k sJ	if ((R(A) == RK(B)) == k) then pc+=sJ		*/
+OP_JLT,/*	A B k sJ	if ((R(A) <  RK(B)) == k) then pc+=sJ		*/
+OP_JLE,/*	A B k sJ	if ((R(A) <= RK(B)) == k) then pc+=sJ		*/
+OP_JEQI,/*	A sB k sJ	if ((R(A) == sB) == k) then pc+=sJ		*/
+OP_JLTI,/*	A sB k sJ	if ((R(A) <  sB) == k) then pc+=sJ		*/
+OP_JLEI,/*	A sB k sJ	if ((R(A) <= sB) == k) then pc+=sJ		*/
+OP_JGTI,/*	A sB k sJ	if ((R(A) >  sB) == k) then pc+=sJ		*/
+OP_JGEI,/*	A sB k sJ	if ((R(A) >= sB) == k) then pc+=sJ		*/
+OP_JTEST,/*	A k sJ	if ((R(A) <=> true) == k) then pc+=sJ		*/
+
 // R(A)存放被调用的函数 B=1说明没有参数 B=2或更大说明有B-1个参数且R(A+1)是base
 // B=0代表top, R(A+1)到R(top-1)都是参数 这种可能出现在前一条指令是OP_CALL或者OP_VARARG 因为参数个数不确定
 // C=1说明不保存返回值 C=2或更大保存C-1个返回值
@@ -261,9 +298,11 @@ OP_TAILCALL,/*	A B C	return R(A)(R(A+1), ... ,R(A+B-1))		*/
 OP_RETURN,/*	A B	return R(A), ... ,R(A+B-2)	(see note)	*/
 
 // 这是for循环的结束指令,将index+step,与limit比较,如果小于等于limit,对循环变量进行赋值,再跳转到OP_FORPREP下一条指令
+// 整数循环的R(A+1)是OP_FORPREP算好的剩余次数,只需要检查它是否大于0再递减
 OP_FORLOOP,/*	A sBx	R(A)+=R(A+2);
 			if R(A) <?= R(A+1) then { pc+=sBx; R(A+3)=R(A) }*/
 // 这是for循环的开始指令,将index-step然后跳转到OP_FORLOOP
+// 整数循环直接执行第一次迭代(不跳转),或者在一次都不执行时跳过OP_FORLOOP
 OP_FORPREP,/*	A sBx	R(A)-=R(A+2); pc+=sBx				*/
 
 // 第二种for循环首先生成排放好三个变量generator,state,control
@@ -321,6 +360,11 @@ OP_EXTRAARG/*	Ax	extra (larger) argument for previous opcode	*/
   (*) All 'skips' (pc++) assume that next instruction is a jump.
   所有使用pc++的地方都假设下一条指令是跳转指令 即OP_JMP
 
+  (*) Fused jumps (OP_JEQ ... OP_JTEST) are never produced directly by
+  the code generator; 'vsK_finish' merges a test and its OP_JMP into
+  one of them when the jump offset fits in 'sJ'.
+  融合指令只在函数编译结束时由vsK_finish生成 偏移放不下时保留原来的两条指令
+
 ===========================================================================*/
 
 
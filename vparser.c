@@ -58,6 +58,7 @@
 #include "vstate.h"
 #include "vstring.h"
 #include "vtable.h"
+#include "vvm.h"
 
 
 
@@ -795,6 +796,8 @@ static void close_func (LexState *ls) {
   // OP_RETURN指令的参数
   vsK_ret(fs, 0, 0);  /* final return */
   leaveblock(fs);
+  // 代码生成结束 合并测试指令与跳转指令
+  vsK_finish(fs);
   // 避免浪费空间 将各个数组的大小都重新分配成它当前存的元素个数
   // 重新分配指令数组
   vsM_reallocvector(L, f->code, f->sizecode, fs->pc, Instruction);
@@ -814,6 +817,8 @@ static void close_func (LexState *ls) {
   // 重新分配upvalue数组
   vsM_reallocvector(L, f->upvalues, f->sizeupvalues, fs->nups, Upvaldesc);
   f->sizeupvalues = fs->nups;
+  // 代码已经确定 创建全局变量访问的内联缓存
+  vsF_inittcache(L, f);
   // 执行该函数时应该只有块栈应该只有一层,调用过leaveblock后fs->bl应为NULL
   vs_assert(fs->bl == NULL);
   // 退出当前函数
@@ -1059,6 +1064,61 @@ static void constructor (LexState *ls, expdesc *t) {
   SETARG_C(fs->f->code[pc], vsO_int2fb(cc.nh));  /* set initial table size */
 }
 
+
+// 识别类型化数组的字面量 例如::int64{1, 2, -3}
+// 元素在识别时就写入一个常量数组 运行时OP_NEWARRAY复制一份
+static void arrayconstructor (LexState *ls, expdesc *v) {
+  /* arrayconstructor -> '::' NAME '{' [ number { sep number } [sep] ] '}'
+     number -> ['-'] (INT | FLT) */
+  static const char *const kinds[] = {"int64", "double", "byte", NULL};
+  vs_State *L = ls->L;
+  FuncState *fs = ls->fs;
+  int line = ls->linenumber;
+  int etype = 0;
+  int k;
+  TString *name;
+  TArray *a;
+  vsX_next(ls);  /* skip '::' */
+  name = str_checkname(ls);
+  while (kinds[etype] != NULL && strcmp(getstr(name), kinds[etype]) != 0)
+    etype++;
+  check_condition(ls, kinds[etype] != NULL, "unknown typed array kind");
+  a = vsH_newarray(L, etype);
+  setarrvalue(L, L->top, a);  /* anchor it */
+  vsD_inctop(L);
+  checknext(ls, '{');
+  while (ls->t.token != '}') {
+    TValue o;
+    vs_Integer n;
+    int neg = testnext(ls, '-');
+    if (ls->t.token == TK_INT) {
+      vs_Integer i = ls->t.seminfo.i;
+      setivalue(&o, neg ? l_castU2S(0u - l_castS2U(i)) : i);
+    }
+    else if (ls->t.token == TK_FLT) {
+      vs_Number r = ls->t.seminfo.r;
+      setfltvalue(&o, neg ? -r : r);
+    }
+    else
+      vsX_syntaxerror(ls, "number expected");
+    if (etype != VS_ADOUBLE) {
+      check_condition(ls, vsV_tointeger(&o, &n, 0),
+                      "number has no integer representation");
+      check_condition(ls, etype != VS_ABYTE || l_castS2U(n) <= UCHAR_MAX,
+                      "value out of range for a byte array");
+    }
+    vsH_setelem(L, a, cast(vs_Integer, a->size) + 1, &o);
+    vsX_next(ls);
+    if (!testnext(ls, ',') && !testnext(ls, ';'))
+      break;
+  }
+  check_match(ls, '}', '{', line);
+  k = vsK_arrayK(fs, a);
+  L->top--;  /* constant table keeps it now */
+  check_condition(ls, k <= MAXARG_Bx, "too many constants");
+  init_exp(v, VRELOCABLE, vsK_codeABx(fs, OP_NEWARRAY, 0, k));
+}
+
 /* }====================================================================== */
 
 
@@ -1302,7 +1362,8 @@ static void suffixedexp (LexState *ls, expdesc *v) {
 // 识别简单表达式
 static void simpleexp (LexState *ls, expdesc *v) {
   /* simpleexp -> FLT | INT | STRING | NIL | TRUE | FALSE | ... |
-                  constructor | FUNCTION body | suffixedexp */
+                  constructor | arrayconstructor | FUNCTION body |
+                  suffixedexp */
   switch (ls->t.token) {
     case TK_FLT: {  // 浮点类型
       init_exp(v, VKFLT, 0);
@@ -1344,6 +1405,10 @@ static void simpleexp (LexState *ls, expdesc *v) {
       constructor(ls, v);
       return;
     }
+    case TK_DBCOLON: {  /* typed array literal */
+      arrayconstructor(ls, v);
+      return;
+    }
     case TK_FUNCTION: {  // 识别函数
       vsX_next(ls);  // 跳过function关键字
       body(ls, v, 0, ls->linenumber);
@@ -0,0 +1,657 @@
+#define vprof_c
+#define VS_CORE
+
+
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(VS_USE_POSIX) || defined(__unix__) || defined(__APPLE__)
+#include <sys/time.h>  /* for 'setitimer' */
+#endif
+
+#include "vs.h"
+
+#include "vdebug.h"
+#include "vobject.h"
+#include "vprof.h"
+#include "vstate.h"
+
+
+
+/*
+** Sampling profilers. Samples are aggregated by key (a folded stack, a
+** line or a function) in 'ProfTable's. Their memory comes directly from
+** the allocator of the state (remembered in 'ProfData', in case it
+** changes) and is not counted by the collector, so that profiling does
+** not change the behavior of the program being profiled.
+*/
+
+#define ci_func(ci)		(clLvalue((ci)->func))
+
+/* maximum size of a key (longer stacks are cut at their root side) */
+#define PROFKEYSIZE	(PROFDEPTH * 24)
+
+/* maximum size of a frame in a key */
+#define FRAMESIZE	(VS_IDSIZE + 16)
+
+
+typedef struct ProfEntry {
+  struct ProfEntry *next;  /* next entry in the same bucket */
+  unsigned int h;  /* hash of 'key' */
+  size_t count;  /* number of samples */
+  size_t weight;  /* bytes (or time) represented by those samples */
+  size_t len;  /* length of 'key' */
+  char key[1];  /* variable length */
+} ProfEntry;
+
+
+static void *profalloc (ProfData *d, void *block, size_t osize,
+                                     size_t nsize) {
+  return (*d->frealloc)(d->ud, block, osize, nsize);
+}
+
+
+static unsigned int profhash (const char *s, size_t l) {
+  unsigned int h = cast(unsigned int, l);
+  for (; l > 0; l--)
+    h ^= ((h<<5) + (h>>2) + cast_byte(s[l - 1]));
+  return h;
+}
+
+
+static void freetable (ProfData *d, ProfTable *t) {
+  int i;
+  for (i = 0; i < t->size; i++) {
+    ProfEntry *e = t->hash[i];
+    while (e != NULL) {
+      ProfEntry *next = e->next;
+      profalloc(d, e, sizeof(ProfEntry) + e->len, 0);
+      e = next;
+    }
+  }
+  profalloc(d, t->hash, t->size * sizeof(ProfEntry *), 0);
+  t->hash = NULL;
+  t->size = t->nuse = 0;
+}
+
+
+static void resizetable (ProfData *d, ProfTable *t, int newsize) {
+  ProfEntry **newhash = cast(ProfEntry **,
+      profalloc(d, NULL, 0, newsize * sizeof(ProfEntry *)));
+  int i;
+  if (newhash == NULL) return;  /* keep the old (crowded) buckets */
+  memset(newhash, 0, newsize * sizeof(ProfEntry *));
+  for (i = 0; i < t->size; i++) {  /* rehash all entries */
+    ProfEntry *e = t->hash[i];
+    while (e != NULL) {
+      ProfEntry *next = e->next;
+      unsigned int b = lmod(e->h, newsize);
+      e->next = newhash[b];
+      newhash[b] = e;
+      e = next;
+    }
+  }
+  profalloc(d, t->hash, t->size * sizeof(ProfEntry *), 0);
+  t->hash = newhash;
+  t->size = newsize;
+}
+
+
+/* add a sample with the given weight to entry 'key' */
+static void addsample (ProfData *d, ProfTable *t, const char *key,
+                       size_t l, size_t count, size_t weight) {
+  unsigned int h = profhash(key, l);
+  ProfEntry *e;
+  if (t->nuse >= t->size)
+    resizetable(d, t, (t->size == 0) ? 64 : t->size * 2);
+  if (t->size == 0) return;  /* no memory for the table */
+  for (e = t->hash[lmod(h, t->size)]; e != NULL; e = e->next) {
+    if (e->h == h && e->len == l && memcmp(e->key, key, l) == 0)
+      break;
+  }
+  if (e == NULL) {  /* new key? */
+    e = cast(ProfEntry *, profalloc(d, NULL, 0, sizeof(ProfEntry) + l));
+    if (e == NULL) return;  /* no memory; drop the sample */
+    e->h = h;
+    e->count = e->weight = 0;
+    e->len = l;
+    memcpy(e->key, key, l);
+    e->key[l] = '\0';
+    e->next = t->hash[lmod(h, t->size)];
+    t->hash[lmod(h, t->size)] = e;
+    t->nuse++;
+  }
+  e->count += count;
+  e->weight += weight;
+}
+
+
+static void initdata (global_State *g, ProfData *d) {
+  memset(d, 0, sizeof(ProfData));
+  d->frealloc = g->frealloc;
+  d->ud = g->ud;
+}
+
+
+static void freedata (ProfData *d) {
+  freetable(d, &d->stacks);
+  freetable(d, &d->sites);
+  freetable(d, &d->funcs);
+}
+
+
+/*
+** Copies the frames of the stack of 'L' (innermost first) into
+** 'frames'; returns how many.
+*/
+static int getframes (vs_State *L, ProfFrame *frames) {
+  int n = 0;
+  CallInfo *ci;
+  for (ci = L->ci; ci != &L->base_ci && n < PROFDEPTH; ci = ci->previous) {
+    ProfFrame *f = &frames[n++];
+    if (isVS(ci)) {
+      int pc;
+      f->p = ci_func(ci)->p;
+      pc = pcRel(ci->savedpc, f->p);
+      f->line = getfuncline(f->p, (pc < 0) ? 0 : pc);  /* not started yet? */
+    }
+    else {
+      f->p = NULL;
+      f->line = -1;
+    }
+  }
+  return n;
+}
+
+
+/*
+** Writes frame 'f' into 'buff' as "source:line", or as
+** "source:linedefined" when 'func' is true; returns its length.
+** C functions have no source and are written as "[C]".
+*/
+static int frameinfo (const ProfFrame *f, int func, char *buff) {
+  char src[VS_IDSIZE];
+  if (f->p == NULL)
+    return sprintf(buff, "[C]");
+  if (f->p->source)
+    vsO_chunkid(src, getstr(f->p->source), VS_IDSIZE);
+  else
+    strcpy(src, "?");
+  return sprintf(buff, "%s:%d", src, func ? f->p->linedefined : f->line);
+}
+
+
+/*
+** Adds a sample of the stack 'frames' (with 'n' frames, innermost
+** first) to the three tables of 'd'. The folded stack has the
+** outermost frame first and frames separated by ';'. If 'leaf' is not
+** NULL, it is added as a last frame to the stack and after a space to
+** the line and function keys.
+*/
+static void adddata (ProfData *d, const ProfFrame *frames, int n,
+                     const char *leaf, size_t count, size_t weight) {
+  char key[PROFKEYSIZE + FRAMESIZE];
+  int lens[PROFDEPTH];
+  size_t l = 0;
+  int i;
+  for (i = 0; i < n; i++) {  /* compute length of the stack */
+    lens[i] = frameinfo(&frames[i], 0, key);
+    l += lens[i] + 1;
+  }
+  while (l >= PROFKEYSIZE)  /* too long? */
+    l -= lens[--n] + 1;  /* drop outermost frame */
+  l = 0;
+  for (i = n - 1; i >= 0; i--) {
+    frameinfo(&frames[i], 0, key + l);
+    l += lens[i];
+    key[l++] = ';';
+  }
+  if (leaf != NULL)
+    l += sprintf(key + l, "%s", leaf);
+  else if (l > 0)
+    l--;  /* remove last ';' */
+  addsample(d, &d->stacks, key, l, count, weight);
+  for (i = 0; i < 2; i++) {  /* line and function of innermost frame */
+    l = (n > 0) ? cast(size_t, frameinfo(&frames[0], i, key))
+                : cast(size_t, sprintf(key, "?"));
+    if (leaf != NULL)
+      l += sprintf(key + l, " %s", leaf);
+    addsample(d, (i == 0) ? &d->sites : &d->funcs, key, l, count, weight);
+  }
+}
+
+
+static int cmpweight (const void *a, const void *b) {
+  size_t x = (*cast(ProfEntry *const *, a))->weight;
+  size_t y = (*cast(ProfEntry *const *, b))->weight;
+  return (x < y) - (x > y);  /* heaviest first */
+}
+
+
+/*
+** Writes each entry of 't' as a line "key weight" (folded stacks) or
+** "key weight count" (lines and functions), heaviest first.
+*/
+static int dumptable (vs_State *L, ProfData *d, ProfTable *t,
+                      vs_Writer writer, void *data, int withcount) {
+  ProfEntry **all;
+  char line[PROFKEYSIZE + FRAMESIZE + 64];
+  int i, n = 0, status = 0;
+  if (t->nuse == 0) return 0;
+  all = cast(ProfEntry **, profalloc(d, NULL, 0,
+                                     t->nuse * sizeof(ProfEntry *)));
+  if (all == NULL) return 1;
+  for (i = 0; i < t->size; i++) {
+    ProfEntry *e;
+    for (e = t->hash[i]; e != NULL; e = e->next)
+      all[n++] = e;
+  }
+  qsort(all, n, sizeof(ProfEntry *), cmpweight);
+  for (i = 0; i < n && status == 0; i++) {
+    int l;
+    if (withcount)
+      l = snprintf(line, sizeof(line), "%s %lu %lu\n", all[i]->key,
+                   (unsigned long)all[i]->weight, (unsigned long)all[i]->count);
+    else
+      l = snprintf(line, sizeof(line), "%s %lu\n", all[i]->key,
+                   (unsigned long)all[i]->weight);
+    status = (*writer)(L, line, l, data);
+  }
+  profalloc(d, all, t->nuse * sizeof(ProfEntry *), 0);
+  return status;
+}
+
+
+/*
+** Writes the tables selected by 'what': folded stacks, or functions
+** and/or lines (functions first, followed by an empty line when both
+** are written). Resets 'd' if asked.
+*/
+static int dumpdata (vs_State *L, ProfData *d, vs_Writer writer,
+                     void *data, int what) {
+  int status = 0;
+  if (!(what & (VS_PROFSITES | VS_PROFFUNCS)))
+    status = dumptable(L, d, &d->stacks, writer, data, 0);
+  if (what & VS_PROFFUNCS)
+    status = dumptable(L, d, &d->funcs, writer, data, 1);
+  if ((what & VS_PROFFUNCS) && (what & VS_PROFSITES) && status == 0)
+    status = (*writer)(L, "\n", 1, data);
+  if ((what & VS_PROFSITES) && status == 0)
+    status = dumptable(L, d, &d->sites, writer, data, 1);
+  if (what & VS_PROFRESET)
+    freedata(d);
+  return status;
+}
+
+
+/*
+** {======================================================
+** Allocation profiler
+** =======================================================
+*/
+
+
+/* name of the kind of block allocated with tag/old size 'osize' */
+static const char *blockname (void *block, size_t osize) {
+  if (block != NULL) return "resize";  /* a block growing */
+  switch (osize) {  /* new objects have their full tag as old size */
+    case VS_TSHRSTR: return "shortstring";
+    case VS_TLNGSTR: return "longstring";
+    case VS_TTABLE: return "table";
+    case VS_TARRAY: return "typedarray";
+    case VS_TLCL: return "lclosure";
+    case VS_TCCL: return "cclosure";
+    case VS_TPROTO: return "proto";
+    case VS_TUSERDATA: return "userdata";
+#if defined(VS_SHAPES)
+    case VS_TSHAPE: return "shape";
+#endif
+    default: return "memory";
+  }
+}
+
+
+/* distance to next sample: uniform in [rate/2, 3*rate/2) */
+static l_mem nextinterval (AllocProf *p) {
+  p->seed = p->seed * 1103515245u + 12345u;
+  return cast(l_mem, p->rate / 2 + (p->seed >> 8) % (p->rate | 1));
+}
+
+
+/*
+** Counts 'n' new bytes; each time the countdown reaches zero, the
+** current stack is recorded with the mean interval as its weight, so
+** that totals estimate the real number of bytes allocated there.
+*/
+void vsR_allocated_ (vs_State *L, void *block, size_t osize, size_t n) {
+  AllocProf *p = G(L)->allocprof;
+  ProfFrame frames[PROFDEPTH];
+  size_t nsamples;
+  if (p->rate == 0 || (p->left -= cast(l_mem, n)) > 0)
+    return;  /* not sampling this allocation */
+  nsamples = 1 + cast(size_t, -p->left) / p->rate;
+  p->left += cast(l_mem, (nsamples - 1) * p->rate) + nextinterval(p);
+  adddata(&p->d, frames, getframes(L, frames), blockname(block, osize),
+          nsamples, nsamples * p->rate);
+}
+
+
+/*
+** Sets the sampling rate to 'rate' bytes (0 stops sampling but keeps
+** the collected data). Returns the previous rate.
+*/
+size_t vsR_allocprof (vs_State *L, size_t rate) {
+  global_State *g = G(L);
+  AllocProf *p = g->allocprof;
+  size_t old = (p != NULL) ? p->rate : 0;
+  if (p == NULL) {
+    if (rate == 0) return 0;  /* nothing to stop */
+    p = cast(AllocProf *, (*g->frealloc)(g->ud, NULL, 0, sizeof(AllocProf)));
+    if (p == NULL) return 0;  /* cannot profile */
+    p->seed = cast(unsigned int, cast(size_t, p));
+    initdata(g, &p->d);
+    g->allocprof = p;
+  }
+  p->rate = rate;
+  if (rate > 0)
+    p->left = nextinterval(p);
+  return old;
+}
+
+
+int vsR_allocdump (vs_State *L, vs_Writer writer, void *data, int what) {
+  AllocProf *p = G(L)->allocprof;
+  if (p == NULL) return 0;  /* nothing collected */
+  return dumpdata(L, &p->d, writer, data, what);
+}
+
+/* }====================================================== */
+
+
+
+/*
+** {======================================================
+** CPU profiler
+** =======================================================
+*/
+
+/*
+** A profiling timer ('ITIMER_PROF', which counts the processor time of
+** the process) raises SIGPROF; the handler only sets the 'cpupending'
+** flag of the profiled state. The interpreter checks that flag at calls
+** and backward jumps and then copies the stack into the ring.
+*/
+
+#if defined(ITIMER_PROF)
+
+/* flag of the state being profiled (only one at a time) */
+static volatile sig_atomic_t *cpuflag = NULL;
+
+
+static void cpuaction (int i) {
+  volatile sig_atomic_t *flag = cpuflag;
+  (void)i;
+  if (flag != NULL) *flag = 1;
+}
+
+
+/* starts (or stops, when 'usec' is 0) the profiling timer */
+static int settimer (volatile sig_atomic_t *flag, int usec) {
+  struct itimerval it;
+  if (usec > 0) {
+    struct sigaction sa;
+    sa.sa_handler = cpuaction;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = SA_RESTART;  /* do not interrupt I/O */
+    cpuflag = flag;
+    if (sigaction(SIGPROF, &sa, NULL) != 0) return 0;
+  }
+  it.it_interval.tv_sec = usec / 1000000;
+  it.it_interval.tv_usec = usec % 1000000;
+  it.it_value = it.it_interval;
+  if (setitimer(ITIMER_PROF, &it, NULL) != 0) return 0;
+  if (usec == 0) {
+    signal(SIGPROF, SIG_IGN);  /* a late signal must not kill the process */
+    if (cpuflag == flag) cpuflag = NULL;
+  }
+  return 1;
+}
+
+#else
+
+static int settimer (volatile sig_atomic_t *flag, int usec) {
+  (void)flag; (void)usec;
+  return 0;  /* no profiling timer */
+}
+
+#endif
+
+
+/* aggregate the samples in the ring */
+static void drainring (CPUProf *p) {
+  int i;
+  for (i = 0; i < p->nsamples; i++)
+    adddata(&p->d, p->ring[i], p->nframes[i], NULL, 1, p->usec[i]);
+  p->nsamples = 0;
+}
+
+
+/*
+** Each sample weighs the processor time since the previous one, as
+** the timer may be coarser than the requested interval.
+*/
+void vsR_cpusample (vs_State *L) {
+  global_State *g = G(L);
+  CPUProf *p = g->cpuprof;
+  clock_t now;
+  g->cpupending = 0;
+  if (p == NULL || p->interval == 0) return;  /* not profiling */
+  if (p->nsamples == PROFRING)  /* ring is full? */
+    drainring(p);
+  now = clock();
+  p->usec[p->nsamples] = cast(size_t, cast_num(now - p->last) * 1e6 /
+                                      CLOCKS_PER_SEC);
+  p->last = now;
+  p->nframes[p->nsamples] = getframes(L, p->ring[p->nsamples]);
+  p->nsamples++;
+}
+
+
+/*
+** Takes a CPU sample every 'usec' microseconds of processor time (0
+** stops sampling but keeps the collected data). Returns the previous
+** interval, or -1 if the timer cannot be set.
+*/
+int vsR_cpuprof (vs_State *L, int usec) {
+  global_State *g = G(L);
+  CPUProf *p = g->cpuprof;
+  int old = (p != NULL) ? p->interval : 0;
+  if (usec < 0) usec = 0;
+  if (p == NULL) {
+    if (usec == 0) return 0;  /* nothing to stop */
+    p = cast(CPUProf *, (*g->frealloc)(g->ud, NULL, 0, sizeof(CPUProf)));
+    if (p == NULL) return -1;  /* cannot profile */
+    p->interval = p->nsamples = 0;
+    initdata(g, &p->d);
+    g->cpuprof = p;
+  }
+  drainring(p);  /* old samples keep their old weight */
+  if (!settimer(&g->cpupending, usec)) {
+    settimer(&g->cpupending, 0);
+    p->interval = 0;
+    return -1;
+  }
+  p->interval = usec;
+  p->last = clock();
+  g->cpupending = 0;
+  return old;
+}
+
+
+int vsR_cpudump (vs_State *L, vs_Writer writer, void *data, int what) {
+  CPUProf *p = G(L)->cpuprof;
+  if (p == NULL) return 0;  /* nothing collected */
+  drainring(p);
+  return dumpdata(L, &p->d, writer, data, what);
+}
+
+/* }====================================================== */
+
+
+/*
+** {======================================================
+** Opcode counters
+** =======================================================
+*/
+
+/*
+** With VS_OPCOUNTS the interpreter counts every instruction it fetches
+** (see 'countop' in vvm.c): by opcode, by opcode and operand types, and
+** by position in its prototype. The counters are allocated with the
+** state and printed to stderr when it is closed.
+*/
+
+/* number of (opcode, operand types) lines printed by 'vsR_opdump' */
+#define OPTYPESTOP	40
+
+
+typedef struct OpEntry {
+  lu_mem count;
+  int op, tx, ty;
+} OpEntry;
+
+
+void vsR_opinit (vs_State *L) {
+#if defined(VS_OPCOUNTS)
+  global_State *g = G(L);
+  OpCounts *oc = cast(OpCounts *, (*g->frealloc)(g->ud, NULL, 0,
+                                                  sizeof(OpCounts)));
+  if (oc == NULL) return;  /* no memory: do not count */
+  memset(oc, 0, sizeof(OpCounts));
+  oc->lastop = -1;
+  g->opcounts = oc;
+#else
+  UNUSED(L);
+#endif
+}
+
+
+const char *vsR_opcount (vs_State *L, int op, size_t *count,
+                                      size_t *cycles) {
+  OpCounts *oc = G(L)->opcounts;
+  if (op < 0 || op >= NUM_OPCODES) return NULL;
+  if (count) *count = (oc != NULL) ? cast(size_t, oc->count[op]) : 0;
+  if (cycles) *cycles = (oc != NULL) ? cast(size_t, oc->cycles[op]) : 0;
+  return vsP_opnames[op];
+}
+
+
+size_t vsR_optypecount (vs_State *L, int op, int tx, int ty) {
+  OpCounts *oc = G(L)->opcounts;
+  if (oc == NULL || op < 0 || op >= NUM_OPCODES ||
+      tx < 0 || tx >= OPTYPES || ty < 0 || ty >= OPTYPES)
+    return 0;
+  return cast(size_t, oc->types[op][tx][ty]);
+}
+
+
+static int cmpcount (const void *a, const void *b) {
+  lu_mem x = cast(const OpEntry *, a)->count;
+  lu_mem y = cast(const OpEntry *, b)->count;
+  return (x < y) - (x > y);  /* most executed first */
+}
+
+
+static const char *optypename (vs_State *L, int t) {
+  switch (t) {
+    case VS_TNUMBER: return "integer";
+    case VS_OPTFLOAT: return "float";
+    case VS_OPTNONE: return "-";
+    default: return vs_typename(L, t);
+  }
+}
+
+
+/*
+** Prints the executed opcodes, most executed first, followed by the
+** most common combinations of opcode and operand types.
+*/
+void vsR_opdump (vs_State *L) {
+  global_State *g = G(L);
+  OpCounts *oc = g->opcounts;
+  OpEntry ops[NUM_OPCODES];
+  OpEntry *pairs;
+  size_t sz = NUM_OPCODES * OPTYPES * OPTYPES * sizeof(OpEntry);
+  lu_mem total = 0;
+  int i, x, y, n = 0;
+  if (oc == NULL) return;
+  for (i = 0; i < NUM_OPCODES; i++) {
+    ops[i].count = oc->count[i];
+    ops[i].op = i;
+    total += oc->count[i];
+  }
+  if (total == 0) return;  /* nothing executed */
+  qsort(ops, NUM_OPCODES, sizeof(OpEntry), cmpcount);
+  fprintf(stderr, "opcode counts (%lu instructions):\n",
+          cast(unsigned long, total));
+  for (i = 0; i < NUM_OPCODES && ops[i].count > 0; i++) {
+    lu_mem c = oc->cycles[ops[i].op];
+    fprintf(stderr, "  %-9s %12lu %6.2f%%", vsP_opnames[ops[i].op],
+            cast(unsigned long, ops[i].count),
+            cast_num(ops[i].count) * 100 / cast_num(total));
+    if (c > 0)
+      fprintf(stderr, " %14lu cycles %8.1f/op", cast(unsigned long, c),
+              cast_num(c) / cast_num(ops[i].count));
+    fprintf(stderr, "\n");
+  }
+  pairs = cast(OpEntry *, (*g->frealloc)(g->ud, NULL, 0, sz));
+  if (pairs == NULL) return;
+  for (i = 0; i < NUM_OPCODES; i++) {
+    for (x = 0; x < OPTYPES; x++) {
+      for (y = 0; y < OPTYPES; y++) {
+        if (oc->types[i][x][y] > 0 && x + y < 2 * VS_OPTNONE) {
+          pairs[n].count = oc->types[i][x][y];
+          pairs[n].op = i;
+          pairs[n].tx = x;
+          pairs[n].ty = y;
+          n++;
+        }
+      }
+    }
+  }
+  qsort(pairs, n, sizeof(OpEntry), cmpcount);
+  fprintf(stderr, "operand types:\n");
+  for (i = 0; i < n && i < OPTYPESTOP; i++)
+    fprintf(stderr, "  %-9s %-8s %-8s %12lu %6.2f%%\n",
+            vsP_opnames[pairs[i].op], optypename(L, pairs[i].tx),
+            optypename(L, pairs[i].ty), cast(unsigned long, pairs[i].count),
+            cast_num(pairs[i].count) * 100 / cast_num(total));
+  (*g->frealloc)(g->ud, pairs, sz, 0);
+}
+
+/* }====================================================== */
+
+
+void vsR_freeprof (vs_State *L) {
+  global_State *g = G(L);
+  AllocProf *ap = g->allocprof;
+  CPUProf *cp = g->cpuprof;
+  if (ap != NULL) {
+    freedata(&ap->d);
+    (*ap->d.frealloc)(ap->d.ud, ap, sizeof(AllocProf), 0);
+    g->allocprof = NULL;
+  }
+  if (cp != NULL) {
+    if (cp->interval > 0) settimer(&g->cpupending, 0);
+    freedata(&cp->d);
+    (*cp->d.frealloc)(cp->d.ud, cp, sizeof(CPUProf), 0);
+    g->cpuprof = NULL;
+  }
+  if (g->opcounts != NULL) {
+    (*g->frealloc)(g->ud, g->opcounts, sizeof(OpCounts), 0);
+    g->opcounts = NULL;
+  }
+}
@@ -0,0 +1,113 @@
+#ifndef vprof_h
+#define vprof_h
+
+
+#include <time.h>
+
+#include "vobject.h"
+#include "vopcodes.h"
+#include "vstate.h"
+
+
+/* maximum number of frames in a sampled stack */
+#define PROFDEPTH	64
+
+/* number of CPU samples kept before they are aggregated */
+#define PROFRING	128
+
+
+/* one frame of a sampled stack; 'p' is NULL for C functions */
+typedef struct ProfFrame {
+  Proto *p;
+  int line;  /* current line */
+} ProfFrame;
+
+
+/* aggregated samples (see vprof.c) */
+typedef struct ProfTable {
+  struct ProfEntry **hash;
+  int size;  /* number of buckets (a power of 2) */
+  int nuse;  /* number of entries */
+} ProfTable;
+
+typedef struct ProfData {
+  ProfTable stacks;  /* by folded stack */
+  ProfTable sites;  /* by current line */
+  ProfTable funcs;  /* by current function */
+  vs_Alloc frealloc;  /* function used to allocate entries */
+  void *ud;
+} ProfData;
+
+
+typedef struct AllocProf {
+  size_t rate;  /* mean distance (in bytes) between samples */
+  l_mem left;  /* bytes to allocate before next sample */
+  unsigned int seed;  /* state of the random generator for intervals */
+  ProfData d;
+} AllocProf;
+
+
+/*
+** CPU samples are only copied into 'ring' when taken; they are
+** aggregated (which needs the prototypes' sources) when the ring is
+** full or the profile is written. The collector marks the prototypes
+** in the ring so that they stay alive until then.
+*/
+typedef struct CPUProf {
+  int interval;  /* microseconds between samples */
+  int nsamples;  /* samples in 'ring' */
+  clock_t last;  /* processor time of the previous sample */
+  size_t usec[PROFRING];  /* processor time represented by each sample */
+  int nframes[PROFRING];  /* number of frames of each sample */
+  ProfFrame ring[PROFRING][PROFDEPTH];  /* innermost frame first */
+  ProfData d;
+} CPUProf;
+
+
+/*
+** Opcode counters, only in builds with VS_OPCOUNTS (and cycles only
+** with VS_OPCYCLES on x86). Operand types are the basic types, with
+** floats in VS_OPTFLOAT and missing operands in VS_OPTNONE.
+*/
+#define OPTYPES		(VS_OPTNONE+1)
+
+typedef struct OpCounts {
+  lu_mem count[NUM_OPCODES];  /* executions of each opcode */
+  lu_mem cycles[NUM_OPCODES];  /* cycles until the next fetch */
+  lu_mem types[NUM_OPCODES][OPTYPES][OPTYPES];  /* by operand types */
+  unsigned long long tsc;  /* time stamp of the previous fetch */
+  int lastop;  /* opcode of the previous fetch (-1 if none) */
+} OpCounts;
+
+
+/*
+** Called by 'vsM_realloc_' for every allocation while the allocation
+** profiler is on; 'n' is the number of bytes the allocation adds.
+*/
+#define vsR_allocated(L,b,os,n) \
+	{ if (G(L)->allocprof != NULL) vsR_allocated_(L,b,os,n); }
+
+/*
+** Called by the interpreter at calls and backward jumps; takes a CPU
+** sample if the profiling timer expired since the last check.
+*/
+#define vsR_cpucheck(L) \
+	{ if (G(L)->cpupending) vsR_cpusample(L); }
+
+VSI_FUNC void vsR_allocated_ (vs_State *L, void *block, size_t osize,
+                                           size_t n);
+VSI_FUNC size_t vsR_allocprof (vs_State *L, size_t rate);
+VSI_FUNC int vsR_allocdump (vs_State *L, vs_Writer writer, void *data,
+                                         int what);
+VSI_FUNC void vsR_cpusample (vs_State *L);
+VSI_FUNC int vsR_cpuprof (vs_State *L, int usec);
+VSI_FUNC int vsR_cpudump (vs_State *L, vs_Writer writer, void *data,
+                                       int what);
+VSI_FUNC void vsR_opinit (vs_State *L);
+VSI_FUNC const char *vsR_opcount (vs_State *L, int op, size_t *count,
+                                               size_t *cycles);
+VSI_FUNC size_t vsR_optypecount (vs_State *L, int op, int tx, int ty);
+VSI_FUNC void vsR_opdump (vs_State *L);
+VSI_FUNC void vsR_freeprof (vs_State *L);
+
+#endif
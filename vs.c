@@ -20,6 +20,15 @@
 
 #define VS_PROGNAME		"vs"
 
+// --heapdump写出的最大表的个数
+#define VS_HEAPTOP		20
+
+// --allocprof默认的采样间隔(字节)
+#define VS_ALLOCRATE		65536
+
+// --profile的采样间隔(微秒)
+#define VS_PROFINTERVAL		1000
+
 /*
 ** vs_readline defines how to show a prompt and then read a line from
 ** the standard input.
@@ -39,6 +48,14 @@ static vs_State *globalL = NULL;
 
 static const char *progname = VS_PROGNAME;
 
+static const char *heapfile = NULL;  /* file for '--heapdump' */
+static int heapflags = 0;  /* flags for 'vsL_heapdump' */
+static const char *allocfile = NULL;  /* file for '--allocprof' */
+static size_t allocrate = VS_ALLOCRATE;  /* bytes between samples */
+static const char *proffile = NULL;  /* file for '--profile' */
+static const char *summaryfile = NULL;  /* file for '--profsummary' */
+static int peephole = 1;  /* cleared by '--nopeephole' */
+
 
 /*
 ** Function to be called at a C signal. Because a C signal cannot
@@ -51,6 +68,49 @@ static void laction (int i) {
 }
 
 
+/*
+** Checks whether 'arg' is the long option 'name', alone or followed by
+** '=' and its value.
+*/
+static int isoption (const char *arg, const char *name) {
+  size_t l = strlen(name);
+  return (strncmp(arg, name, l) == 0 && (arg[l] == '\0' || arg[l] == '='));
+}
+
+
+/* options that need an argument */
+static const char *const valueoptions[] = {
+  "--heapdump", "--allocprof", "--allocrate", "--profile", "--profsummary",
+  NULL
+};
+
+
+static void print_usage (const char *badoption) {
+  int i;
+  vs_writestringerror("%s: ", progname);
+  for (i = 0; valueoptions[i] != NULL; i++)
+    if (isoption(badoption, valueoptions[i])) break;
+  if (valueoptions[i] != NULL)
+    vs_writestringerror("'%s' needs argument\n", badoption);
+  else
+    vs_writestringerror("unrecognized option '%s'\n", badoption);
+  vs_writestringerror(
+  "usage: %s [options] [script [args]]\n"
+  "Available options are:\n"
+  "  --heapdump file     write a heap snapshot to 'file' after running\n"
+  "  --heapedges         include every object and its references in the snapshot\n"
+  "  --allocprof file    sample allocations and write their folded stacks to 'file'\n"
+  "  --allocrate n       sample once every 'n' allocated bytes (default 65536)\n"
+  "  --profile file      sample the CPU and write folded stacks to 'file'\n"
+  "  --profsummary file  write time per function and per line to 'file'\n"
+  "  --nopeephole        do not run the peephole optimizer on loaded code\n"
+  "  --                  stop handling options\n"
+  "  -                   stop handling options and execute stdin\n"
+  ,
+  progname);
+}
+
+
 /*
 ** Prints an error message, adding the program name in front of it
 ** (if present)
@@ -334,6 +394,57 @@ static int pushargs (vs_State *L) {
 }
 
 
+/*
+** Traverses all arguments from 'argv', handling the options before the
+** script name. Returns the index of the script name (or 'argc' if there
+** is no script), or -1 if there is an invalid option, in which case
+** '*first' is the index of that option.
+*/
+static int collectargs (char **argv, int argc, int *first) {
+  int i;
+  *first = argc;
+  for (i = 1; i < argc; i++) {
+    const char *opt = argv[i];
+    const char *value;
+    *first = i;
+    if (opt[0] != '-' || opt[1] == '\0')  /* script or '-'? */
+      return i;
+    else if (strcmp(opt, "--") == 0)
+      return (i + 1 < argc) ? i + 1 : argc;
+    else if (strcmp(opt, "--heapedges") == 0) {
+      heapflags |= VS_HEAPEDGES;
+      continue;
+    }
+    else if (strcmp(opt, "--nopeephole") == 0) {
+      peephole = 0;
+      continue;
+    }
+    // 其余选项都有参数, 写成"--option=value"或者"--option value"
+    value = strchr(opt, '=');
+    if (value != NULL) value++;
+    else if (i + 1 < argc) value = argv[++i];
+    if (value == NULL || *value == '\0')
+      return -1;  /* missing argument */
+    else if (isoption(opt, "--heapdump"))
+      heapfile = value;
+    else if (isoption(opt, "--allocprof"))
+      allocfile = value;
+    else if (isoption(opt, "--profile"))
+      proffile = value;
+    else if (isoption(opt, "--profsummary"))
+      summaryfile = value;
+    else if (isoption(opt, "--allocrate")) {
+      long rate = strtol(value, NULL, 10);
+      if (rate <= 0) return -1;
+      allocrate = (size_t)rate;
+    }
+    else
+      return -1;  /* invalid option */
+  }
+  return argc;
+}
+
+
 // 通过命令行参数加载被执行的文件
 static int handle_script (vs_State *L, char **argv) {
   int status;
@@ -362,17 +473,45 @@ static int pmain (vs_State *L) {
   // 取出argc和argv
   int argc = (int)vs_tointeger(L, 1);
   char **argv = (char **)vs_touserdata(L, 2);
+  int status = VS_OK;
+  int first;
+  // script是脚本名在argv中的位置,没有脚本时等于argc
+  int script = collectargs(argv, argc, &first);
   if (argv[0] && argv[0][0]) progname = argv[0];
+  if (script == -1) {  /* bad option? */
+    print_usage(argv[first]);
+    return 0;
+  }
   // 加载所有的库
   vsL_openlibs(L);  /* open standard libraries */
-  createargtable(L, argv, argc, 1);  /* create table 'arg' */
-  if (argc > 1 && handle_script(L, argv + 1) != VS_OK)
-    return 0;
-  if (argc == 1) {  /* no arguments? */
+  vs_setpeephole(L, peephole);
+  createargtable(L, argv, argc, script);  /* create table 'arg' */
+  if (allocfile != NULL)
+    vs_allocprof(L, allocrate);  /* start sampling allocations */
+  if ((proffile != NULL || summaryfile != NULL) &&
+      vs_cpuprof(L, VS_PROFINTERVAL) < 0)  /* start sampling the CPU */
+    l_message(progname, "cannot start the CPU profiler");
+  if (script < argc)
+    status = handle_script(L, argv + script);
+  else {  /* no script */
     print_version();
     doREPL(L);  /* do read-eval-print loop */
   }
-  vs_pushboolean(L, 1);  /* signal no errors */
+  // 脚本执行完后(即使出错)写出堆快照和分配采样
+  if (heapfile != NULL &&
+      report(L, vsL_heapdump(L, heapfile, VS_HEAPTOP, heapflags)) != VS_OK)
+    status = VS_ERRFILE;
+  if (allocfile != NULL &&
+      report(L, vsL_allocdump(L, allocfile, VS_PROFSTACKS)) != VS_OK)
+    status = VS_ERRFILE;
+  vs_cpuprof(L, 0);  /* stop sampling the CPU */
+  if (proffile != NULL &&
+      report(L, vsL_cpudump(L, proffile, VS_PROFSTACKS)) != VS_OK)
+    status = VS_ERRFILE;
+  if (summaryfile != NULL &&
+      report(L, vsL_cpudump(L, summaryfile, VS_PROFFUNCS|VS_PROFSITES)) != VS_OK)
+    status = VS_ERRFILE;
+  vs_pushboolean(L, status == VS_OK);  /* signal errors */
   return 1;
 }
 
@@ -67,6 +67,14 @@ typedef struct vs_State vs_State;
 #define VS_NUMTAGS		9
 
 
+/*
+** element types of typed arrays (tables with unboxed numeric elements)
+*/
+#define VS_AINT64	0
+#define VS_ADOUBLE	1
+#define VS_ABYTE	2
+
+
 
 /* minimum VS stack available to a C function */
 // 调用c函数时vs栈剩余的最小空间
@@ -157,6 +165,10 @@ VS_API vs_CFunction   (vs_tocfunction) (vs_State *L, int idx);
 VS_API void	       *(vs_touserdata) (vs_State *L, int idx);
 VS_API vs_State      *(vs_tothread) (vs_State *L, int idx);
 VS_API const void     *(vs_topointer) (vs_State *L, int idx);
+// 类型化数组的元素实际存放的位置 写入元素类型和个数
+// 不是类型化数组时返回NULL并且不修改etype和n (没有元素时也可能返回NULL)
+VS_API void	       *(vs_toarray) (vs_State *L, int idx, int *etype,
+                                      size_t *n);
 
 /* ORDER TM, ORDER OP */
 #define VS_OPADD	0    // 加法(+)
@@ -218,6 +230,8 @@ VS_API int (vs_getp) (vs_State *L, int idx, const void *p);
 VS_API void  (vs_createtable) (vs_State *L, int narr, int nrec);
 // 创建一个userdata压入栈顶 返回userdata的数据实际存放位置
 VS_API void *(vs_newuserdata) (vs_State *L, size_t sz);
+// 创建一个n个元素的类型化数组压入栈顶 元素都是0 返回元素实际存放的位置
+VS_API void *(vs_newarray) (vs_State *L, int etype, size_t n);
 // 将idx位置用户数据压入栈顶
 VS_API int  (vs_getuservalue) (vs_State *L, int idx);
 
@@ -251,6 +265,81 @@ VS_API int   (vs_load) (vs_State *L, vs_Reader reader, void *dt,
 
 VS_API int (vs_dump) (vs_State *L, vs_Writer writer, void *data, int strip);
 
+/* turn the peephole optimizer for functions loaded later on or off */
+VS_API int (vs_setpeephole) (vs_State *L, int on);
+
+/* flags for 'vs_heapdump' */
+#define VS_HEAPEDGES	1	/* also write every object and its references */
+
+VS_API int (vs_heapdump) (vs_State *L, vs_Writer writer, void *data,
+                          int ntop, int flags);
+
+
+/*
+** garbage-collection function and options
+*/
+
+#define VS_GCSTOP	0
+#define VS_GCRESTART	1
+#define VS_GCCOLLECT	2
+#define VS_GCCOUNT	3
+#define VS_GCCOUNTB	4
+#define VS_GCSTEP	5
+#define VS_GCSETPAUSE	6
+#define VS_GCSETSTEPMUL	7
+#define VS_GCISRUNNING	9
+#define VS_GCGEN	10
+#define VS_GCINC	11
+#define VS_GCPARALLEL	12
+#define VS_GCBGSWEEP	13  /* needs a thread-safe allocator */
+#define VS_GCSTATS	14
+#define VS_GCSTEPTIME	15  /* step for at most 'usec' microseconds */
+#define VS_GCSETSTEPTIME	16  /* time budget of automatic steps */
+
+/*
+** cumulative statistics of the collector (filled by 'VS_GCSTATS');
+** times are processor time, in seconds
+*/
+typedef struct vs_GCStats {
+  size_t cycles;  /* finished cycles (minor collections included) */
+  size_t freed;  /* bytes freed by the collector */
+  double propagate;  /* time spent marking */
+  double atomic;  /* time spent in atomic steps */
+  double sweep;  /* time spent sweeping */
+} vs_GCStats;
+
+VS_API int (vs_gc) (vs_State *L, int what, ...);
+
+
+/*
+** sampling profilers
+*/
+
+#define VS_PROFSTACKS	0  /* folded stacks: "frame;...;frame weight" */
+#define VS_PROFSITES	1  /* per line: "source:line [kind] weight samples" */
+#define VS_PROFFUNCS	2  /* per function: "source:linedefined [kind] ..." */
+#define VS_PROFRESET	4  /* discard the samples after writing them */
+/* VS_PROFFUNCS|VS_PROFSITES writes both, separated by an empty line */
+
+VS_API size_t (vs_allocprof) (vs_State *L, size_t rate);
+VS_API int (vs_allocdump) (vs_State *L, vs_Writer writer, void *data,
+                           int what);
+VS_API int (vs_cpuprof) (vs_State *L, int usec);
+VS_API int (vs_cpudump) (vs_State *L, vs_Writer writer, void *data,
+                         int what);
+
+
+/*
+** opcode counters (only counted in builds with VS_OPCOUNTS)
+*/
+
+#define VS_OPTFLOAT	VS_NUMTAGS  /* operand type of floats */
+#define VS_OPTNONE	(VS_NUMTAGS+1)  /* instruction has no such operand */
+
+VS_API const char *(vs_opcount) (vs_State *L, int op, size_t *count,
+                                 size_t *cycles);
+VS_API size_t (vs_optypecount) (vs_State *L, int op, int tx, int ty);
+
 
 /*
 ** miscellaneous functions
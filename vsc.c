@@ -14,12 +14,15 @@
 #include <string.h>
 
 #include "vauxlib.h"
+#include "vmem.h"
 #include "vobject.h"
 #include "vs.h"
+#include "vslib.h"
 #include "vstate.h"
 #include "vundump.h"
 
 static void PrintFunction(const Proto *f, int full);
+static void PrintCounts(const Proto *before, const Proto *after);
 #define vsU_print PrintFunction
 
 #define PROGNAME "vsc"         /* default program name */
@@ -28,6 +31,9 @@ static void PrintFunction(const Proto *f, int full);
 static int listing = 0;                 /* list bytecodes? */
 static int dumping = 1;                 /* dump bytecodes? */
 static int stripping = 0;               /* strip debug information? */
+static int optimizing = 1;              /* run the peephole optimizer? */
+static int counting = 0;                /* show optimizer instruction counts? */
+static int executing = 0;               /* run and show execution counts? */
 static char Output[] = {OUTPUT};        /* default output file name */
 static const char *output = Output;     /* actual output file name */
 static const char *progname = PROGNAME; /* actual program name */
@@ -51,11 +57,14 @@ static void usage(const char *message) {
   fprintf(stderr,
           "usage: %s [options] [filenames]\n"
           "Available options are:\n"
+          "  -c       show instruction counts before/after peephole optimization\n"
           "  -l       list (use -l -l for full listing)\n"
+          "  -O0      disable peephole optimization\n"
           "  -o name  output to file 'name' (default is \"%s\")\n"
           "  -p       parse only\n"
           "  -s       strip debug information\n"
           "  -v       show version information\n"
+          "  -x       run and list execution counts (needs VS_OPCOUNTS)\n"
           "  --       stop handling options\n"
           "  -        stop handling options and process stdin\n",
           progname, Output);
@@ -80,8 +89,12 @@ static int doargs(int argc, char *argv[]) {
       break;
     } else if (IS("-")) /* end of options; use stdin */
       break;
+    else if (IS("-c")) /* show peephole counts */
+      counting = 1;
     else if (IS("-l")) /* list */
       ++listing;
+    else if (IS("-O0")) /* no peephole optimization */
+      optimizing = 0;
     else if (IS("-o")) /* output file */
     {
       output = argv[++i];
@@ -95,10 +108,18 @@ static int doargs(int argc, char *argv[]) {
       stripping = 1;
     else if (IS("-v")) /* show version */
       ++version;
+    else if (IS("-x")) /* run and list execution counts */
+#if defined(VS_OPCOUNTS)
+      executing = 1;
+#else
+      fatal("'-x' needs a build with VS_OPCOUNTS");
+#endif
     else /* unknown option */
       usage(argv[i]);
   }
-  if (i == argc && (listing || !dumping)) {
+  if (executing && !listing)
+    listing = 1;
+  if (i == argc && (listing || counting || !dumping)) {
     dumping = 0;
     argv[--i] = Output;
   }
@@ -110,7 +131,7 @@ static int doargs(int argc, char *argv[]) {
   return i;
 }
 
-#define FUNCTION "(function()end)();"
+#define FUNCTION "(function(){})();"
 
 static const char *reader(vs_State *L, void *ud, size_t *size) {
   UNUSED(L);
@@ -139,6 +160,8 @@ static const Proto *combine(vs_State *L, int n) {
       if (f->p[i]->sizeupvalues > 0)
         f->p[i]->upvalues[0].instack = 0;
     }
+    vsM_freearray(L, f->lineinfo, f->sizelineinfo);
+    f->lineinfo = NULL;
     f->sizelineinfo = 0;
     return f;
   }
@@ -154,14 +177,33 @@ static int pmain(vs_State *L) {
   char **argv = (char **)vs_touserdata(L, 2);
   const Proto *f;
   int i;
-  if (!vs_checkstack(L, argc))
+  if (!vs_checkstack(L, 2 * argc))
     fatal("too many input files");
+  if (counting) { /* load everything once more without the optimizer */
+    vs_setpeephole(L, 0);
+    for (i = 0; i < argc; i++) {
+      const char *filename = IS("-") ? NULL : argv[i];
+      if (vsL_loadfile(L, filename) != VS_OK)
+        fatal(vs_tostring(L, -1));
+    }
+  }
+  vs_setpeephole(L, optimizing);
   for (i = 0; i < argc; i++) {
     const char *filename = IS("-") ? NULL : argv[i];
     if (vsL_loadfile(L, filename) != VS_OK)
       fatal(vs_tostring(L, -1));
   }
+  if (counting) {
+    for (i = 0; i < argc; i++)
+      PrintCounts(toproto(L, i - 2 * argc), toproto(L, i - argc));
+  }
   f = combine(L, argc);
+  if (executing) { /* run the chunk, counting its instructions */
+    vsL_openlibs(L);
+    vs_pushvalue(L, -1);
+    if (vs_pcall(L, 0, 0, 0) != VS_OK)
+      fatal(vs_tostring(L, -1));
+  }
   if (listing)
     vsU_print(f, listing > 1);
   if (dumping) {
@@ -279,6 +321,11 @@ static void PrintConstant(const Proto *f, int i) {
   case VS_TLNGSTR:
     PrintString(tsvalue(o));
     break;
+  case VS_TARRAY: {
+    static const char *const kinds[] = {"int64", "double", "byte"};
+    printf("::%s[%u]", kinds[arrvalue(o)->etype], arrvalue(o)->size);
+    break;
+  }
   default: /* cannot happen */
     printf("? type=%d", ttype(o));
     break;
@@ -287,6 +334,10 @@ static void PrintConstant(const Proto *f, int i) {
 
 #define UPVALNAME(x) ((f->upvalues[x].name) ? getstr(f->upvalues[x].name) : "-")
 #define MYK(x) (-1 - (x))
+// 参数C是有符号立即数sC的指令
+#define ISIMMC(o) ((o) == OP_ADDI || ((o) >= OP_EQI && (o) <= OP_GEI))
+// 比较跳转融合指令 参数C是条件k和跳转偏移sJ
+#define ISFUSEDJ(o) ((o) >= OP_JEQ && (o) <= OP_JTEST)
 
 static void PrintCode(const Proto *f) {
   const Instruction *code = f->code;
@@ -302,6 +353,10 @@ static void PrintCode(const Proto *f) {
     int sbx = GETARG_sBx(i);
     int line = getfuncline(f, pc);
     printf("\t%d\t", pc + 1);
+#if defined(VS_OPCOUNTS)
+    if (executing) /* times the instruction was run */
+      printf("%lu\t", f->opcount ? (unsigned long)f->opcount[pc] : 0UL);
+#endif
     if (line > 0)
       printf("[%d]\t", line);
     else
@@ -312,9 +367,19 @@ static void PrintCode(const Proto *f) {
     switch (getOpMode(o)) {
     case iABC:
       printf("%d", a);
+      if (ISFUSEDJ(o)) {
+        if (o >= OP_JEQI && o <= OP_JGEI)
+          printf(" %d", GETARG_sB(i));
+        else if (getBMode(o) != OpArgN)
+          printf(" %d", ISK(b) ? (MYK(INDEXK(b))) : b);
+        printf(" %d %d", GETARG_k(i), GETARG_sJ(i));
+        break;
+      }
       if (getBMode(o) != OpArgN)
         printf(" %d", ISK(b) ? (MYK(INDEXK(b))) : b);
-      if (getCMode(o) != OpArgN)
+      if (ISIMMC(o))
+        printf(" %d", GETARG_sC(i));
+      else if (getCMode(o) != OpArgN)
         printf(" %d", ISK(c) ? (MYK(INDEXK(c))) : c);
       break;
     case iABx:
@@ -333,6 +398,7 @@ static void PrintCode(const Proto *f) {
     }
     switch (o) {
     case OP_LOADK:
+    case OP_NEWARRAY:
       printf("\t; ");
       PrintConstant(f, bx);
       break;
@@ -393,6 +459,24 @@ static void PrintCode(const Proto *f) {
           printf("-");
       }
       break;
+    case OP_JEQ:
+    case OP_JLT:
+    case OP_JLE:
+      printf("\t; ");
+      if (ISK(b)) {
+        PrintConstant(f, INDEXK(b));
+        printf(" ");
+      }
+      printf("to %d", GETARG_sJ(i) + pc + 2);
+      break;
+    case OP_JEQI:
+    case OP_JLTI:
+    case OP_JLEI:
+    case OP_JGTI:
+    case OP_JGEI:
+    case OP_JTEST:
+      printf("\t; to %d", GETARG_sJ(i) + pc + 2);
+      break;
     case OP_JMP:
     case OP_FORLOOP:
     case OP_FORPREP:
@@ -440,6 +524,23 @@ static void PrintHeader(const Proto *f) {
          S(f->sizek), S(f->sizep));
 }
 
+static void PrintCounts(const Proto *before, const Proto *after) {
+  int i;
+  const char *s = after->source ? getstr(after->source) : "=?";
+  if (*s == '@' || *s == '=')
+    s++;
+  else if (*s == VS_SIGNATURE[0])
+    s = "(bstring)";
+  else
+    s = "(string)";
+  printf("%s <%s:%d,%d>: %d -> %d instructions\n",
+         (after->linedefined == 0) ? "main" : "function", s,
+         after->linedefined, after->lastlinedefined, before->sizecode,
+         after->sizecode);
+  for (i = 0; i < after->sizep; i++)
+    PrintCounts(before->p[i], after->p[i]);
+}
+
 static void PrintDebug(const Proto *f) {
   int i, n;
   n = f->sizek;
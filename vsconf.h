@@ -466,6 +466,20 @@
 
 #endif				/* } */
 
+
+/*
+@@ VS_NANBOXING makes a TValue a single NaN-boxed 64-bit word (see
+** 'vobject.h'). Integers then keep only 47 bits, so their limits shrink
+** accordingly; integer results outside them become floats.
+*/
+// 定义VS_NANBOXING时TValue只占8个字节, 整数范围缩小到47位
+#if defined(VS_NANBOXING)
+#undef VS_MAXINTEGER
+#undef VS_MININTEGER
+#define VS_MAXINTEGER		((VS_INTEGER)0x3FFFFFFFFFFFLL)
+#define VS_MININTEGER		(-VS_MAXINTEGER - 1)
+#endif
+
 /* }================================================================== */
 
 
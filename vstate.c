@@ -13,6 +13,7 @@
 #include "vgc.h"
 #include "vlex.h"
 #include "vmem.h"
+#include "vprof.h"
 #include "vstate.h"
 #include "vstring.h"
 #include "vtable.h"
@@ -210,9 +211,13 @@ static void f_vsopen (vs_State *L, void *ud) {
   init_registry(L, g);
   vsS_init(L);
   vsX_init(L);
+#if defined(VS_SHAPES)
+  vsH_initshapes(L);
+#endif
   // vs_newstate中最初设置gcrunning为0,这里修改为1
   g->gcrunning = 1;  /* allow gc */
   g->version = vs_version(NULL);
+  vsR_opinit(L);
 }
 
 
@@ -242,6 +247,8 @@ static void close_state (vs_State *L) {
   vsM_freearray(L, G(L)->strt.hash, G(L)->strt.size);
   freestack(L);
   vs_assert(gettotalbytes(g) == sizeof(LG));
+  vsM_freeheap(L);
+  vsR_freeprof(L);
   (*g->frealloc)(g->ud, fromstate(L), sizeof(LG), 0);  /* free main block */
 }
 
@@ -277,23 +284,45 @@ VS_API vs_State *vs_newstate (vs_Alloc f, void *ud) {
   // 生成随机种子
   g->seed = makeseed(L);
   g->gcrunning = 0;  /* no GC while building state */
+  g->peephole = 1;
   g->GCestimate = 0;
+  g->gccycles = 0;
+  g->gcfreed = 0;
+  g->gctime[GCTPROPAGATE] = g->gctime[GCTATOMIC] = g->gctime[GCTSWEEP] = 0;
   g->strt.size = g->strt.nuse = 0;
   g->strt.hash = NULL;
+  memset(&g->heap, 0, sizeof(Heap));
   setnilvalue(&g->l_registry);
   g->panic = NULL;
   g->version = NULL;
   // 初始的gcstate是GCSpause
   g->gcstate = GCSpause;
-  // 初始的gc类型是正常类型,不是紧急状态
-  g->gckind = KGC_NORMAL;
+  // 初始是增量模式,不是紧急状态
+  g->gckind = KGC_INC;
+  g->gcemergency = 0;
+  g->allgc = g->fixedgc = NULL;
+  g->survival = g->old1 = g->reallyold = g->firstold1 = NULL;
   g->sweepgc = NULL;
   g->gray = g->grayagain = NULL;
   g->twups = NULL;
+  g->gcpar = NULL;
+  g->gcsweeper = NULL;
+  g->allocprof = NULL;
+  g->cpuprof = NULL;
+  g->cpupending = 0;
+  g->opcounts = NULL;
+#if defined(VS_SHAPES)
+  g->rootshape = NULL;
+  g->shapeid = 0;
+#endif
+  g->gcdeferfree = 0;
   g->totalbytes = sizeof(LG);
   g->GCdebt = 0;
   g->gcpause = VSI_GCPAUSE;
   g->gcstepmul = VSI_GCMUL;
+  g->gcsteptime = 0;
+  setgcparam(g->genmajormul, VSI_GENMAJORMUL);
+  g->genminormul = VSI_GENMINORMUL;
   // 调用f_vsopen初始化各种必要信息
   // f_vsopen中设置了gcrunning为1
   if (vsD_rawrunprotected(L, f_vsopen, NULL) != VS_OK) {
@@ -307,6 +336,7 @@ VS_API vs_State *vs_newstate (vs_Alloc f, void *ud) {
 
 VS_API void vs_close (vs_State *L) {
   L = G(L)->mainthread;  /* only the main thread can be closed */
+  vsR_opdump(L);
   close_state(L);
 }
 
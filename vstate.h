@@ -1,5 +1,7 @@
 #ifndef vstate_h
 #define vstate_h
+#include <signal.h>
+
 #include "vs.h"
 #include "vobject.h"
 
@@ -10,9 +12,15 @@
 
 #define BASIC_STACK_SIZE        (2*VS_MINSTACK)
 
+/* phases whose time is accounted in 'gctime' */
+#define GCTPROPAGATE	0
+#define GCTATOMIC	1
+#define GCTSWEEP	2
+#define GCTPHASES	3
+
 /* kinds of Garbage Collection */
-#define KGC_NORMAL	0
-#define KGC_EMERGENCY	1	/* gc was forced by an allocation failure */
+#define KGC_INC		0	/* incremental gc */
+#define KGC_GEN		1	/* generational gc */
 
 typedef struct stringtable {
   TString **hash;
@@ -21,6 +29,22 @@ typedef struct stringtable {
 } stringtable;
 
 
+/*
+** 小内存块使用按大小分级的页堆, 每页只存放同一级别的块
+** blocks up to 'HEAPCLASSES * HEAPSTEP' bytes live in the paged heap
+*/
+#define HEAPSTEP	16  /* size difference between classes */
+#define HEAPCLASSES	16  /* number of size classes */
+
+typedef struct Heap {
+  struct HeapPage *avail[HEAPCLASSES];  /* pages with free blocks */
+  struct HeapPage *empty;  /* pages with no block in use */
+  struct HeapArena *arenas;  /* list of all arenas */
+  int narenas;  /* number of arenas */
+  int nforeign;  /* small blocks kept by 'frealloc' after a failed shrink */
+} Heap;
+
+
 typedef struct CallInfo {
   StkId func;  /* function index in the stack */
   StkId	top;  /* top for this function */
@@ -49,21 +73,46 @@ typedef struct global_State {
   l_mem GCdebt;  /* bytes allocated not yet compensated by the collector */
   lu_mem GCmemtrav;  /* memory traversed by the GC */
   lu_mem GCestimate;  /* an estimate of the non-garbage memory in use */
+  lu_mem gccycles;  /* number of finished collection cycles */
+  lu_mem gcfreed;  /* bytes freed by the collector */
+  double gctime[GCTPHASES];  /* processor time spent in each phase */
   stringtable strt;  /* hash table for strings */
+  Heap heap;  /* pages for small blocks */
   TValue l_registry;
   unsigned int seed;  /* randomized seed for hashes */
   lu_byte currentwhite;
   lu_byte gcstate;  /* state of garbage collector */
   lu_byte gckind;  /* kind of GC running */
+  lu_byte genminormul;  /* control for minor generational collections */
+  lu_byte genmajormul;  /* control for major generational collections */
   lu_byte gcrunning;  /* true if GC is running */
+  lu_byte gcemergency;  /* true if this is an emergency collection */
+  lu_byte gcdeferfree;  /* true while a sweep queues freed blocks for the sweeper */
+  lu_byte peephole;  /* run the peephole optimizer on new functions? */
   GCObject *allgc;  /* list of all collectable objects */
   GCObject **sweepgc;  /* current position of sweep in list */
   GCObject *gray;  /* list of gray objects */
   GCObject *grayagain;  /* list of objects to be traversed atomically */
   GCObject *fixedgc;  /* list of objects not to be collected */
+  /* fields for generational collector */
+  GCObject *survival;  /* start of objects that survived one GC cycle */
+  GCObject *old1;  /* start of old1 objects */
+  GCObject *reallyold;  /* objects more than one cycle old ("really old") */
+  GCObject *firstold1;  /* first OLD1 object in the list (if any) */
   struct vs_State *twups;  /* list of threads with open upvalues */
+  struct GCPar *gcpar;  /* helper threads for parallel marking (or NULL) */
+  struct GCSweeper *gcsweeper;  /* background sweeper (or NULL) */
+  struct AllocProf *allocprof;  /* allocation profiler (or NULL) */
+  struct CPUProf *cpuprof;  /* CPU profiler (or NULL) */
+  volatile sig_atomic_t cpupending;  /* CPU profiler wants a sample */
+  struct OpCounts *opcounts;  /* opcode counters (or NULL) */
+#if defined(VS_SHAPES)
+  struct Shape *rootshape;  /* shape of records without keys */
+  size_t shapeid;  /* id of the last shape created */
+#endif
   int gcpause;  /* size of pause between successive GCs */
   int gcstepmul;  /* GC 'granularity' */
+  int gcsteptime;  /* time budget (microseconds) of each step; 0 = none */
   vs_CFunction panic;  /* to be called in unprotected errors */
   struct vs_State *mainthread;
   const vs_Number *version;  /* pointer to version number */
@@ -110,10 +159,15 @@ union GCUnion {
   union Closure cl;
   // vsH_new中调用了vsC_newobj
   struct Table h;
+  // vsH_newarray中调用了vsC_newobj
+  struct TArray a;
   // vsF_newproto中调用了vsC_newobj
   struct Proto p;
   // vs_newstate中没调用vsC_newobj,但是对marked字段进行了处理
   struct vs_State th;  /* thread */
+#if defined(VS_SHAPES)
+  struct Shape sh;
+#endif
 };
 
 
@@ -130,8 +184,12 @@ union GCUnion {
 #define gco2cl(o)  \
 	check_exp(novariant((o)->tt) == VS_TFUNCTION, &((cast_u(o))->cl))
 #define gco2t(o)  check_exp((o)->tt == VS_TTABLE, &((cast_u(o))->h))
+#define gco2a(o)  check_exp((o)->tt == VS_TARRAY, &((cast_u(o))->a))
 #define gco2p(o)  check_exp((o)->tt == VS_TPROTO, &((cast_u(o))->p))
 #define gco2th(o)  check_exp((o)->tt == VS_TTHREAD, &((cast_u(o))->th))
+#if defined(VS_SHAPES)
+#define gco2sh(o)  check_exp((o)->tt == VS_TSHAPE, &((cast_u(o))->sh))
+#endif
 
 
 /* macro to convert a VS object into a GCObject */
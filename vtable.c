@@ -2,6 +2,11 @@
 
 #include <math.h>
 #include <limits.h>
+#include <string.h>
+
+#if defined(VS_SWISSTABLE) && defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 #include "vs.h"
 
@@ -35,6 +40,25 @@
 #define MAXHBITS	(MAXABITS - 1)
 
 
+/* hash parts with this many nodes get a 'Rehash' (see vtable.h) */
+#define MOVEMIN		4096
+
+/* minimum number of nodes of the hash part being moved that each new
+   key moves */
+#define MOVESTEP	4
+
+
+/* indices after 'lenhint' that '#' checks before searching a border */
+#define MAXHINTSTEPS	4
+
+// 新写入的整数键k紧接着lenhint时 把lenhint移到k
+#define updatehint(t,k) \
+	{ if (l_castS2U(k) == cast(vs_Unsigned, (t)->lenhint) + 1) \
+	    (t)->lenhint = cast(unsigned int, (k)); }
+
+
+#if !defined(VS_SWISSTABLE)
+
 // 对2的指数取余的方式计算桶位置
 // n是哈希值 通过哈希值查询表t中节点
 #define hashpow2(t,n)		(gnode(t, lmod((n), sizenode(t))))
@@ -56,6 +80,8 @@
 // 计算指针桶位置方式
 #define hashpointer(t,p)	hashmod(t, point2uint(p))
 
+#endif
+
 
 #define dummynode		(&dummynode_)
 
@@ -85,6 +111,151 @@ static int l_hashfloat (vs_Number n) {
 }
 
 
+#if defined(VS_SWISSTABLE)
+
+/*
+** {=============================================================
+** Open addressing with control bytes
+** ==============================================================
+*/
+
+/*
+** Each node of the hash part has a control byte, kept after the nodes:
+** CTRL_EMPTY for a node that never held a key, or 7 bits of the hash of
+** its key. A search compares the control bytes of a whole group of
+** CTRLGROUP nodes at once (with SSE2 when available), looks only at the
+** nodes whose byte matches and stops at the first group with an empty
+** node. A key stays in its node when its value becomes nil (as with
+** chaining, so that 'next' and dead keys keep working) until the next
+** rehash, so there are no tombstones. Hash parts smaller than a group
+** fill the rest of it with CTRL_PAD, which matches nothing.
+*/
+
+#define CTRL_EMPTY	0x80
+#define CTRL_PAD	0xFE
+
+/* hash bits kept in the control byte of a key */
+#define h2(h)		cast_byte((h) & 0x7f)
+
+/* number of groups in the hash part of 't', minus 1 */
+#define groupmask(t)	(cast(unsigned int, sizenode(t) - 1) / CTRLGROUP)
+
+/* maximum number of keys in a hash part with 'n' nodes (7/8 full) */
+#define maxload(n)	((n) < CTRLGROUP ? (n) : (n) - (n) / 8)
+
+
+// 空表共用的控制字节 不匹配任何key
+const lu_byte vsH_dummyctrl[CTRLGROUP] = {
+  CTRL_PAD, CTRL_PAD, CTRL_PAD, CTRL_PAD, CTRL_PAD, CTRL_PAD, CTRL_PAD,
+  CTRL_PAD, CTRL_PAD, CTRL_PAD, CTRL_PAD, CTRL_PAD, CTRL_PAD, CTRL_PAD,
+  CTRL_PAD, CTRL_PAD
+};
+
+
+/* bit 'i' is set when byte 'i' of group 'g' is 'b' */
+#if defined(__SSE2__)
+static unsigned int matchbyte (const lu_byte *g, lu_byte b) {
+  __m128i c = _mm_loadu_si128(cast(const __m128i *, g));
+  return cast(unsigned int,
+              _mm_movemask_epi8(_mm_cmpeq_epi8(c, _mm_set1_epi8(cast(char, b)))));
+}
+#else
+static unsigned int matchbyte (const lu_byte *g, lu_byte b) {
+  unsigned int m = 0;
+  int i;
+  for (i = 0; i < CTRLGROUP; i++)
+    if (g[i] == b) m |= 1u << i;
+  return m;
+}
+#endif
+
+
+/* index of the lowest bit set in 'm' (not 0) */
+#if defined(__GNUC__)
+#define firstbit(m)	__builtin_ctz(m)
+#else
+static int firstbit (unsigned int m) {
+  int i = 0;
+  while (!(m & 1u)) { m >>= 1; i++; }
+  return i;
+}
+#endif
+
+
+/*
+** Groups are chosen by the high bits of the hash, so it must be well
+** mixed; pointers and small integers are not (string hashes are).
+*/
+static unsigned int mixhash (unsigned int h) {
+  h ^= h >> 16;
+  h *= 0x85ebca6bu;
+  h ^= h >> 13;
+  return h;
+}
+
+
+static unsigned int hashkey (const TValue *key) {
+  switch (ttype(key)) {
+    case VS_TNUMINT:
+      return mixhash(cast(unsigned int, l_castS2U(ivalue(key))));
+    case VS_TNUMFLT:
+      return mixhash(cast(unsigned int, l_hashfloat(fltvalue(key))));
+    case VS_TSHRSTR:
+      return tsvalue(key)->hash;
+    case VS_TLNGSTR:
+      return vsS_hashlongstr(tsvalue(key));
+    case VS_TBOOLEAN:
+      return mixhash(cast(unsigned int, bvalue(key)));
+    case VS_TLIGHTUSERDATA:
+      return mixhash(point2uint(pvalue(key)));
+    case VS_TLCF:
+      return mixhash(point2uint(fvalue(key)));
+    default:
+      vs_assert(!ttisdeadkey(key));
+      return mixhash(point2uint(gcvalue(key)));
+  }
+}
+
+
+/*
+** Runs 'body' for each node 'n' of 't' whose control byte matches hash
+** 'h', group by group (triangular probing visits every group once),
+** until a group with an empty node. 'body' returns when it finds the
+** key.
+*/
+#define probe(t,h,n,body) { \
+  unsigned int mask_ = groupmask(t); \
+  unsigned int g_ = ((h) >> 7) & mask_, step_ = 0; \
+  for (;;) { \
+    const lu_byte *c_ = (t)->ctrl + g_ * CTRLGROUP; \
+    unsigned int m_ = matchbyte(c_, h2(h)); \
+    while (m_ != 0) { \
+      Node *n = gnode(t, g_ * CTRLGROUP + firstbit(m_)); \
+      body \
+      m_ &= m_ - 1; \
+    } \
+    if (matchbyte(c_, CTRL_EMPTY) != 0 || step_++ == mask_) break; \
+    g_ = (g_ + step_) & mask_; \
+  } }
+
+
+/* first empty node in the probe sequence of hash 'h' */
+static int getfreepos (Table *t, unsigned int h) {
+  unsigned int mask = groupmask(t);
+  unsigned int g = (h >> 7) & mask, step = 0;
+  for (;;) {  /* 'growthleft' > 0, so there is an empty node */
+    unsigned int m = matchbyte(t->ctrl + g * CTRLGROUP, CTRL_EMPTY);
+    if (m != 0)
+      return cast_int(g * CTRLGROUP) + firstbit(m);
+    g = (g + ++step) & mask;
+  }
+}
+
+/* }============================================================= */
+
+#else
+
+
 /*
 ** returns the 'main' position of an element in a table (that is, the index
 ** of its hash value)
@@ -112,6 +283,8 @@ static Node *mainposition (const Table *t, const TValue *key) {
   }
 }
 
+#endif
+
 
 /*
 ** returns the index for 'key' if 'key' is an appropriate key to live in
@@ -128,10 +301,175 @@ static unsigned int arrayindex (const TValue *key) {
 }
 
 
+#if defined(VS_SHAPES)
+
+/*
+** {=============================================================
+** Shapes
+** ==============================================================
+*/
+
+/*
+** A table whose keys are all short strings (besides its array part) is
+** a record: its hash part is the dummy node and its keys are given by a
+** shape, shared by all records with the same keys added in the same
+** order, which maps each key to a slot in 't->slots'. Shapes form a
+** tree rooted at 'g->rootshape'; each child has the keys of its parent
+** plus one. A child keeps its parent alive, while the list of children
+** of a shape is weak: a shape being freed unlinks itself from it. A key
+** whose value becomes nil keeps its slot. A record gets a real hash
+** part for good ('unshape') when it gets a key that is not a short
+** string and does not go to its array part, or more than MAXSHAPEKEYS
+** keys.
+*/
+
+/* index of shape 's' */
+#define shapeidx(s)	cast(lu_byte *, &(s)->keys[(s)->nkeys])
+
+
+/* slot of 'key' in shape 's', or -1 if it is not there */
+static int shapeslot (const Shape *s, TString *key) {
+  int i;
+  if (s->lsizeidx == 0) {  /* few keys: linear search */
+    for (i = s->nkeys - 1; i >= 0; i--) {
+      if (s->keys[i] == key)
+        return i;
+    }
+  }
+  else {
+    const lu_byte *idx = shapeidx(s);
+    unsigned int mask = cast(unsigned int, twoto(s->lsizeidx) - 1);
+    unsigned int h;
+    for (h = key->hash & mask; idx[h] != 0; h = (h + 1) & mask) {
+      if (s->keys[idx[h] - 1] == key)
+        return idx[h] - 1;
+    }
+  }
+  return -1;
+}
+
+
+static const TValue *getslot (Table *t, TString *key) {
+  int i = shapeslot(t->shape, key);
+  return (i < 0) ? vsO_nilobject : &t->slots[i];
+}
+
+
+/* create a shape with the keys of 'parent' plus 'key' */
+static Shape *newshape (vs_State *L, Shape *parent, TString *key) {
+  int n = (parent != NULL) ? parent->nkeys + 1 : 0;
+  int lsize = (n > SHAPELINEAR) ? vsO_ceillog2(n) + 1 : 0;
+  GCObject *o = vsC_newobj(L, VS_TSHAPE, sizeshape(n, lsize));
+  Shape *s = gco2sh(o);
+  int i;
+  s->nkeys = cast_byte(n);
+  s->lsizeidx = cast_byte(lsize);
+  s->id = ++G(L)->shapeid;
+  s->parent = parent;
+  s->child = NULL;
+  s->sibling = NULL;
+  if (parent != NULL) {
+    for (i = 0; i < n - 1; i++)
+      s->keys[i] = parent->keys[i];
+    s->keys[n - 1] = key;
+    s->sibling = parent->child;  /* link it as a child of 'parent' */
+    parent->child = s;
+  }
+  if (lsize > 0) {  /* build index */
+    lu_byte *idx = shapeidx(s);
+    unsigned int mask = cast(unsigned int, twoto(lsize) - 1);
+    memset(idx, 0, twoto(lsize));
+    for (i = 0; i < n; i++) {
+      unsigned int h = s->keys[i]->hash & mask;
+      while (idx[h] != 0)
+        h = (h + 1) & mask;
+      idx[h] = cast_byte(i + 1);
+    }
+  }
+  return s;
+}
+
+
+/* the shape with the keys of 's' plus 'key' */
+static Shape *getchild (vs_State *L, Shape *s, TString *key) {
+  Shape *c;
+  for (c = s->child; c != NULL; c = c->sibling) {
+    if (c->keys[c->nkeys - 1] == key) {
+      if (isdead(G(L), c))  /* dead (but not collected yet)? */
+        changewhite(c);  /* resurrect it */
+      return c;
+    }
+  }
+  return newshape(L, s, key);
+}
+
+
+// 创建没有key的根形状 它永远不会被回收
+void vsH_initshapes (vs_State *L) {
+  global_State *g = G(L);
+  g->rootshape = newshape(L, NULL, NULL);
+  vsC_fix(L, obj2gco(g->rootshape));
+}
+
+
+void vsH_freeshape (vs_State *L, Shape *s) {
+  Shape *c;
+  if (s->parent != NULL) {  /* unlink it from its parent */
+    Shape **p = &s->parent->child;
+    while (*p != s)
+      p = &(*p)->sibling;
+    *p = s->sibling;
+  }
+  for (c = s->child; c != NULL; c = c->sibling)
+    c->parent = NULL;  /* they cannot be alive either */
+  vsM_freemem(L, s, sizeshape(s->nkeys, s->lsizeidx));
+}
+
+/* }============================================================= */
+
+#endif
+
+
+/*
+** returns the index of the node of 'key' in the hash part of 't' (which
+** may be the part being moved), or -1 if it is not there
+*/
+#if defined(VS_SWISSTABLE)
+static int nodeindex (Table *t, const TValue *key) {
+  unsigned int h = hashkey(key);
+  probe(t, h, n, {
+    /* key may be dead already, but it is ok to use it in 'next' */
+    if (vsV_equalobj(gkey(n), key) ||
+          (ttisdeadkey(gkey(n)) && iscollectable(key) &&
+           deadvalue(gkey(n)) == gcvalue(key)))
+      return cast_int(n - gnode(t, 0));
+  });
+  return -1;  /* key not found */
+}
+#else
+static int nodeindex (Table *t, const TValue *key) {
+  Node *n = mainposition(t, key);  // 找到该key的的桶
+  for (;;) {  /* check whether 'key' is somewhere in the chain 遍历这个桶 */
+    int nx;
+    /* key may be dead already, but it is ok to use it in 'next' */
+    if (vsV_equalobj(gkey(n), key) ||
+          (ttisdeadkey(gkey(n)) && iscollectable(key) &&
+           deadvalue(gkey(n)) == gcvalue(key)))
+      return cast_int(n - gnode(t, 0));  // 得到查找结果与哈希部分开始位置的偏移
+    nx = gnext(n);  // 查询下一个元素与当前元素的偏移量
+    if (nx == 0)
+      return -1;  /* key not found */
+    n += nx;
+  }
+}
+#endif
+
+
 /*
 ** returns the index of a 'key' for table traversals. First goes all
-** elements in the array part, then elements in the hash part. The
-** beginning of a traversal is signaled by 0.
+** elements in the array part, then elements in the hash part, then the
+** ones in the hash part being moved. The beginning of a traversal is
+** signaled by 0.
 */
 // 查询表t中键key所在的位置 key是nil返回0
 // 序号从1开始,哈希部分的第一个元素是sizearray+1
@@ -142,23 +480,23 @@ static unsigned int findindex (vs_State *L, Table *t, StkId key) {
   if (i != 0 && i <= t->sizearray)  /* is 'key' inside array part? */
     // 在数组部分里 直接返回i
     return i;  /* yes; that's the index */
+#if defined(VS_SHAPES)
+  else if (t->shape != NULL) {  /* slots go after the array part */
+    int k = ttisshrstring(key) ? shapeslot(t->shape, tsvalue(key)) : -1;
+    if (k < 0)
+      vsG_runerror(L, "invalid key to 'next'");  /* key not found */
+    return cast(unsigned int, k) + 1 + t->sizearray;
+  }
+#endif
   else {  // 不在数组部分 在哈希部分 i=0
-    int nx;
-    Node *n = mainposition(t, key);  // 找到该key的的桶
-    for (;;) {  /* check whether 'key' is somewhere in the chain 遍历这个桶 */
-      /* key may be dead already, but it is ok to use it in 'next' */
-      if (vsV_equalobj(gkey(n), key) ||
-            (ttisdeadkey(gkey(n)) && iscollectable(key) &&
-             deadvalue(gkey(n)) == gcvalue(key))) {
-        i = cast_int(n - gnode(t, 0));  /* key index in hash table 得到查找结果与哈希部分开始位置的偏移 */
-        /* hash elements are numbered after array ones 哈希部分的第一个元素序号是sizearray+1 */
-        return (i + 1) + t->sizearray;  // 加上数组部分的偏移得到最终偏移
-      }
-      nx = gnext(n);  // 查询下一个元素与当前元素的偏移量
-      if (nx == 0)
-        vsG_runerror(L, "invalid key to 'next'");  /* key not found */
-      else n += nx;
-    }
+    int k = nodeindex(t, key);
+    /* hash elements are numbered after array ones 哈希部分的第一个元素序号是sizearray+1 */
+    if (k >= 0)
+      return cast(unsigned int, k + 1) + t->sizearray;
+    if (ismoving(t) && (k = nodeindex(&t->rh->old, key)) >= 0)
+      return cast(unsigned int, k + 1 + sizenode(t)) + t->sizearray;
+    vsG_runerror(L, "invalid key to 'next'");  /* key not found */
+    return 0;  /* to avoid warnings */
   }
 }
 
@@ -176,6 +514,18 @@ int vsH_next (vs_State *L, Table *t, StkId key) {
       return 1;
     }
   }
+#if defined(VS_SHAPES)
+  if (t->shape != NULL) {  /* slots of a record */
+    for (i -= t->sizearray; cast_int(i) < t->shape->nkeys; i++) {
+      if (!ttisnil(&t->slots[i])) {
+        setsvalue2s(L, key, t->shape->keys[i]);
+        setobj2s(L, key+1, &t->slots[i]);
+        return 1;
+      }
+    }
+    return 0;
+  }
+#endif
   // 序号-sizearray就代表在哈希部分的位置
   for (i -= t->sizearray; cast_int(i) < sizenode(t); i++) {  /* hash part */
     // 此时i-1就是当前的值 i就是next值
@@ -185,6 +535,16 @@ int vsH_next (vs_State *L, Table *t, StkId key) {
       return 1;
     }
   }
+  if (ismoving(t)) {  /* then the part being moved */
+    Table *o = &t->rh->old;
+    for (i -= sizenode(t); cast_int(i) < sizenode(o); i++) {
+      if (!ttisnil(gval(gnode(o, i)))) {
+        setobj2s(L, key, gkey(gnode(o, i)));
+        setobj2s(L, key+1, gval(gnode(o, i)));
+        return 1;
+      }
+    }
+  }
   return 0;  /* no more elements */
 }
 
@@ -195,6 +555,26 @@ int vsH_next (vs_State *L, Table *t, StkId key) {
 ** ==============================================================
 */
 
+/* number of nodes with a key in a full hash part */
+#if defined(VS_SWISSTABLE)
+#define nodesinuse(t)	(isdummy(t) ? 0 : maxload(sizenode(t)) - (t)->growthleft)
+#else
+#define nodesinuse(t)	allocsizenode(t)  /* 'getfreepos' found no free node */
+#endif
+
+/* number of keys that always fit in a new hash part */
+#if defined(VS_SWISSTABLE)
+#define nodecapacity(t)	(isdummy(t) ? 0 : maxload(sizenode(t)))
+#else
+#define nodecapacity(t)	allocsizenode(t)
+#endif
+
+
+static TValue *insertkey (vs_State *L, Table *t, const TValue *key);
+static const TValue *getintnode (Table *t, vs_Integer key);
+static const TValue *getgeneric (Table *t, const TValue *key);
+
+
 /*
 ** Compute the optimal size for the array part of table 't'. 'nums' is a
 ** "count array" where 'nums[i]' is the number of integers in the table
@@ -276,6 +656,24 @@ static unsigned int numusearray (const Table *t, unsigned int *nums) {
 }
 
 
+/*
+** Count keys in array part of table 't' as 'numusearray' would if it
+** had no nils, without traversing it.
+*/
+// 假设数组部分没有nil 按分段把数组部分大小加到nums上
+static unsigned int fullarray (const Table *t, unsigned int *nums) {
+  int lg;
+  unsigned int ttlg;  /* 2^lg */
+  unsigned int lim = 0;  /* keys counted so far */
+  for (lg = 0, ttlg = 1; lim < t->sizearray; lg++, ttlg *= 2) {
+    unsigned int prev = lim;
+    lim = (ttlg < t->sizearray) ? ttlg : t->sizearray;
+    nums[lg] += lim - prev;
+  }
+  return t->sizearray;
+}
+
+
 // 计算哈希部分有几个使用数字作为key的元素
 // nums加上哈希部分数字key的影响
 // pna执行结束加上哈希部分数字为key元素的个数
@@ -309,12 +707,47 @@ static void setarrayvector (vs_State *L, Table *t, unsigned int size) {
 
 // 为表t的哈希部分申请size个Node的空间
 static void setnodevector (vs_State *L, Table *t, unsigned int size) {
+  if (size >= MOVEMIN && t->rh == NULL) {  /* a large hash part? */
+    t->rh = vsM_new(L, Rehash);
+    t->rh->old.node = NULL;
+    t->rh->sparse = 0;
+  }
   if (size == 0) {  /* no elements to hash part? 哈希部分大小是0 */
     // 设置初始值
     t->node = cast(Node *, dummynode);  /* use common 'dummynode' */
     t->lsizenode = 0;
+#if defined(VS_SWISSTABLE)
+    t->ctrl = cast(lu_byte *, vsH_dummyctrl);  /* signal it */
+    t->growthleft = 0;
+#else
     t->lastfree = NULL;  /* signal that it is using dummy node */
+#endif
+  }
+#if defined(VS_SWISSTABLE)
+  else {  /* nodes and control bytes go in one block */
+    int i;
+    int lsize = vsO_ceillog2(size);
+    if (lsize < MAXHBITS && cast(unsigned int, maxload(twoto(lsize))) < size)
+      lsize++;  /* keep the new part at most 7/8 full */
+    if (lsize > MAXHBITS)
+      vsG_runerror(L, "table overflow");
+    size = twoto(lsize);
+    t->node = cast(Node *, vsM_malloc(L, sizeof(Node) * size +
+                                         sizectrl(size)));
+    t->ctrl = cast(lu_byte *, t->node + size);
+    for (i = 0; i < (int)size; i++) {
+      Node *n = gnode(t, i);
+      gnext(n) = 0;
+      setnilvalue(wgkey(n));
+      setnilvalue(gval(n));
+      t->ctrl[i] = CTRL_EMPTY;
+    }
+    for (; i < CTRLGROUP; i++)
+      t->ctrl[i] = CTRL_PAD;
+    t->lsizenode = cast_byte(lsize);
+    t->growthleft = maxload(cast_int(size));
   }
+#else
   else {
     int i;
     int lsize = vsO_ceillog2(size);
@@ -332,8 +765,85 @@ static void setnodevector (vs_State *L, Table *t, unsigned int size) {
     // lastfree是申请空间最后的位置的下一个这里不能放值
     t->lastfree = gnode(t, size);  /* all positions are free */
   }
+#endif
+  if (t->rh != NULL)  /* new part has no keys */
+    memset(t->rh->nums, 0, sizeof(t->rh->nums));
+}
+
+
+#if defined(VS_SHAPES)
+
+// 重设记录表t的槽位数组大小为size 新增部分初始化为nil
+static void setslotvector (vs_State *L, Table *t, int size) {
+  int i;
+  vsM_reallocvector(L, t->slots, t->sizeslots, size, TValue);
+  for (i = t->sizeslots; i < size; i++)
+    setnilvalue(&t->slots[i]);
+  t->sizeslots = cast_byte(size);
+}
+
+
+/* add short string 'key' to record 't'; return its (nil) slot */
+static TValue *newslot (vs_State *L, Table *t, TString *key) {
+  int n = t->shape->nkeys;
+  Shape *s;
+  vs_assert(n < MAXSHAPEKEYS);
+  if (n == t->sizeslots)  /* no room for a new slot? */
+    setslotvector(L, t, (n < 4) ? 4 : (n < MAXSHAPEKEYS / 2) ? 2 * n
+                                                           : MAXSHAPEKEYS);
+  s = getchild(L, t->shape, key);
+  t->shape = s;
+  vsC_objbarrier(L, t, s);
+  vs_assert(ttisnil(&t->slots[n]));
+  return &t->slots[n];
+}
+
+
+/*
+** Find the array slot of integer 'key' in record 't', growing its array
+** part as 'rehash' would do; return NULL if 'key' should go to a hash
+** part instead.
+*/
+static TValue *recordint (vs_State *L, Table *t, const TValue *key) {
+  unsigned int nums[MAXABITS + 1];
+  unsigned int na, asize;
+  unsigned int k = arrayindex(key);
+  int i;
+  if (k == 0) return NULL;
+  for (i = 0; i <= MAXABITS; i++) nums[i] = 0;
+  na = numusearray(t, nums);
+  na += countint(key, nums);
+  asize = computesizes(nums, &na);
+  if (k > asize) return NULL;
+  setarrayvector(L, t, asize);
+  vsC_tableresized(t);
+  return &t->array[k - 1];
+}
+
+
+/* move the keys of record 't' to a new hash part, with room for one more */
+static void unshape (vs_State *L, Table *t) {
+  Shape *s = t->shape;
+  TValue *slots = t->slots;
+  int size = t->sizeslots;
+  int i;
+  setnodevector(L, t, s->nkeys + 1);
+  t->shape = NULL;
+  t->slots = NULL;
+  t->sizeslots = 0;
+  for (i = 0; i < s->nkeys; i++) {
+    if (!ttisnil(&slots[i])) {
+      TValue k;
+      setsvalue(L, &k, s->keys[i]);
+      setobj2t(L, vsH_newkey(L, t, &k), &slots[i]);
+    }
+  }
+  vsM_freearray(L, slots, size);
+  vsC_tableresized(t);
 }
 
+#endif
+
 
 // 为表t重设数组部分大小为nasize,哈希部分大小为nhsize
 void vsH_resize (vs_State *L, Table *t, unsigned int nasize,
@@ -341,13 +851,39 @@ void vsH_resize (vs_State *L, Table *t, unsigned int nasize,
   unsigned int i;
   int j;
   // 保存更改大小前的数组部分大小和哈希部分大小
-  unsigned int oldasize = t->sizearray;
-  int oldhsize = allocsizenode(t);
-  Node *nold = t->node;  /* save old hash ... 保存更改前哈希部分的指针 */
+  unsigned int oldasize;
+  int oldhsize;
+  size_t oldhbytes;
+  Node *nold;
+  // 正在搬迁的哈希部分也一起重新插入
+  Node *nmoving = NULL;
+  int movingsize = 0;
+  size_t movingbytes = 0;
+#if defined(VS_SHAPES)
+  if (t->shape != NULL && nhsize > 0) {  /* record with room for keys? */
+    if (nhsize <= MAXSHAPEKEYS) {  /* keep it a record */
+      if (cast_int(nhsize) > t->sizeslots)
+        setslotvector(L, t, cast_int(nhsize));
+      nhsize = 0;
+    }
+    else unshape(L, t);
+  }
+#endif
+  oldasize = t->sizearray;
+  oldhsize = allocsizenode(t);
+  oldhbytes = sizehash(t);
+  nold = t->node;  /* save old hash ... 保存更改前哈希部分的指针 */
   if (nasize > oldasize)  /* array part must grow? 数组部分扩张 */
     setarrayvector(L, t, nasize);
   /* create new hash part with appropriate size 创建哈希部分的存放空间 */
   setnodevector(L, t, nhsize);  // 必须在缩小空间之前执行 因为缩小空间需要将值放进新的哈希部分
+  if (ismoving(t)) {  /* its keys go to the new part too */
+    Table *o = &t->rh->old;
+    nmoving = o->node;
+    movingsize = sizenode(o);
+    movingbytes = sizehash(o);
+    o->node = NULL;
+  }
   if (nasize < oldasize) {  /* array part must shrink? 数组部分缩小空间 */
     t->sizearray = nasize;
     /* re-insert elements from vanishing slice */
@@ -370,8 +906,16 @@ void vsH_resize (vs_State *L, Table *t, unsigned int nasize,
       setobjt2t(L, vsH_set(L, t, gkey(old)), gval(old));  // 将旧位置的值拷贝过来
     }
   }
+  for (j = movingsize - 1; j >= 0; j--) {  /* and the ones not moved yet */
+    Node *old = nmoving + j;
+    if (!ttisnil(gval(old)))
+      setobjt2t(L, vsH_set(L, t, gkey(old)), gval(old));
+  }
   if (oldhsize > 0)  /* not the dummy node? */
-    vsM_freearray(L, nold, cast(size_t, oldhsize)); /* free old hash 释放掉旧哈希部分 */
+    vsM_freemem(L, nold, oldhbytes); /* free old hash 释放掉旧哈希部分 */
+  if (nmoving != NULL)
+    vsM_freemem(L, nmoving, movingbytes);
+  vsC_tableresized(t);
 }
 
 
@@ -381,6 +925,77 @@ void vsH_resizearray (vs_State *L, Table *t, unsigned int nasize) {
   vsH_resize(L, t, nasize, nsize);
 }
 
+/*
+** Start moving the hash part of 't' to a new one with room for 'nhsize'
+** keys (counting the one being inserted), after growing its array part
+** to 'nasize'. The integer keys that go to the array part move now; the
+** other keys move a few nodes at each new key (see 'movenodes'), enough
+** to finish before the new keys fill half the room left in the new part.
+*/
+// 大表扩容时不一次性重新插入所有key 先分配新的哈希部分
+// 之后每次新建key时搬迁几个旧节点 查询时新旧两部分都要找
+static void startmove (vs_State *L, Table *t, unsigned int nasize,
+                                              unsigned int nhsize) {
+  Rehash *rh = t->rh;
+  Table old;
+  unsigned int room;  /* new keys that fit in the new part */
+  vs_assert(!ismoving(t) && nasize >= t->sizearray);
+  if (nasize > t->sizearray) {  /* array part must grow? */
+    unsigned int k = t->sizearray;
+    setarrayvector(L, t, nasize);
+    while (k++ < nasize) {  /* move keys of its new slice */
+      TValue *v = cast(TValue *, getintnode(t, k));
+      if (!ttisnil(v)) {
+        vsC_barrierback(L, t, &t->array[k - 1], v);
+        setobjt2t(L, &t->array[k - 1], v);
+        setnilvalue(v);
+      }
+    }
+  }
+  old = *t;  /* keep the current hash part */
+  setnodevector(L, t, nhsize);
+  room = cast(unsigned int, nodecapacity(t)) - nhsize + 1;  /* at least 1 */
+  rh->old = old;
+  rh->cursor = rh->used = rh->live = 0;
+  rh->step = (2 * sizenode(&old) + room - 1) / room;  /* in half of it */
+  if (rh->step < MOVESTEP) rh->step = MOVESTEP;
+  vsC_tableresized(t);
+}
+
+
+/*
+** Move up to 'n' nodes of the hash part being moved to the hash part of
+** 't'. A moved node keeps its key with a nil value, so that searches in
+** the old part do not find it. After the last node, the old part is
+** freed; 'rehash' counts the keys again if most of its nodes were dead.
+*/
+static void movenodes (vs_State *L, Table *t, unsigned int n) {
+  Rehash *rh = t->rh;
+  Table *o = &rh->old;
+  unsigned int size = sizenode(o);
+  for (; n > 0 && rh->cursor < size; n--) {
+    Node *old = gnode(o, rh->cursor);
+    if (!ttisnil(gkey(old)))
+      rh->used++;
+    if (!ttisnil(gval(old))) {
+      TValue *v = insertkey(L, t, gkey(old));
+      if (v == NULL) return;  /* no room: 'rehash' will move the rest */
+      vsC_barrierback(L, t, v, gval(old));
+      setobjt2t(L, v, gval(old));
+      setnilvalue(gval(old));
+      rh->live++;
+    }
+    rh->cursor++;
+  }
+  if (rh->cursor == size) {  /* moved all nodes? */
+    rh->sparse = (rh->live < rh->used - rh->live);
+    vsM_freemem(L, o->node, sizehash(o));
+    o->node = NULL;
+    vsC_tableresized(t);
+  }
+}
+
+
 /*
 ** nums[i] = number of keys 'k' where 2^(i - 1) < k <= 2^i
 */
@@ -390,6 +1005,10 @@ void vsH_resizearray (vs_State *L, Table *t, unsigned int nasize) {
 // 例如当前t[1]=1 t[4]=4,此时1在数组部分,4在哈希部分
 // 如果要设置t[2]=2,那么传入ek就是2
 // 执行该函数将重新分配数组部分大小为4 哈希部分大小为0
+//
+// 有Rehash的大表不需要遍历哈希部分: 其中的整数键已经按分段计数
+// 数组部分先按没有nil计算 算出来数组部分大小要变时才遍历数组部分
+// 上次搬迁时大部分节点已经死亡(计数不准)的表像小表一样遍历计数
 
 static void rehash (vs_State *L, Table *t, const TValue *ek) {
   unsigned int asize;  /* optimal size for array part 数组部分的最优大小 */
@@ -397,17 +1016,41 @@ static void rehash (vs_State *L, Table *t, const TValue *ek) {
   unsigned int nums[MAXABITS + 1];
   int i;
   int totaluse;
-  for (i = 0; i <= MAXABITS; i++) nums[i] = 0;  /* reset counts */
-  na = numusearray(t, nums);  /* count keys in array part 对nums处理数组部分 */
-  totaluse = na;  /* all those keys are integer keys */
-  totaluse += numusehash(t, nums, &na);  /* count keys in hash part 处理哈希部分 */
-  /* count extra key 处理ek */
-  na += countint(ek, nums);  // na可能加1或0 代表了ek可能放到数组部分也可能放到哈希部分
-  totaluse++;
-  /* compute new size for array part */
-  asize = computesizes(nums, &na);  // 根据nums数组和当前数组部分的大小计算出来数组部分的最优大小
+  Rehash *rh = t->rh;
+  int canmove = (rh != NULL && !ismoving(t) && !isdummy(t));
+  if (canmove && !rh->sparse) {  /* integer keys of hash part are counted? */
+    unsigned int nh = 0;  /* number of them */
+    for (i = 0; i <= MAXABITS; i++) nh += rh->nums[i];
+    memcpy(nums, rh->nums, sizeof(nums));
+    na = fullarray(t, nums) + nh + countint(ek, nums);
+    totaluse = cast_int(t->sizearray) + nodesinuse(t) + 1;
+    asize = computesizes(nums, &na);
+    if (asize != t->sizearray) {  /* array part may change? count its keys */
+      memcpy(nums, rh->nums, sizeof(nums));
+      na = numusearray(t, nums);
+      totaluse = cast_int(na) + nodesinuse(t) + 1;
+      na += nh + countint(ek, nums);
+      asize = computesizes(nums, &na);
+    }
+  }
+  else {
+    for (i = 0; i <= MAXABITS; i++) nums[i] = 0;  /* reset counts */
+    na = numusearray(t, nums);  /* count keys in array part 对nums处理数组部分 */
+    totaluse = na;  /* all those keys are integer keys */
+    totaluse += numusehash(t, nums, &na);  /* count keys in hash part 处理哈希部分 */
+    if (ismoving(t))  /* and in the part being moved */
+      totaluse += numusehash(&rh->old, nums, &na);
+    /* count extra key 处理ek */
+    na += countint(ek, nums);  // na可能加1或0 代表了ek可能放到数组部分也可能放到哈希部分
+    totaluse++;
+    /* compute new size for array part */
+    asize = computesizes(nums, &na);  // 根据nums数组和当前数组部分的大小计算出来数组部分的最优大小
+  }
   /* resize the table to new computed sizes 重新分配数组和哈希部分的空间 */
-  vsH_resize(L, t, asize, totaluse - na);
+  if (canmove && asize >= t->sizearray)
+    startmove(L, t, asize, totaluse - na);
+  else
+    vsH_resize(L, t, asize, totaluse - na);
 }
 
 
@@ -423,6 +1066,16 @@ Table *vsH_new (vs_State *L) {
   Table *t = gco2t(o);
   t->array = NULL;
   t->sizearray = 0;
+  t->lenhint = 0;
+  t->rh = NULL;
+  t->gcflags = 0;
+  t->gccursor = 0;
+  t->gcdirty = 0;
+#if defined(VS_SHAPES)
+  t->shape = G(L)->rootshape;  /* NULL while the state is being built */
+  t->slots = NULL;
+  t->sizeslots = 0;
+#endif
   setnodevector(L, t, 0);
   return t;
 }
@@ -432,14 +1085,24 @@ Table *vsH_new (vs_State *L) {
 void vsH_free (vs_State *L, Table *t) {
   // 释放哈希部分
   if (!isdummy(t))
-    vsM_freearray(L, t->node, cast(size_t, sizenode(t)));
+    vsM_freemem(L, t->node, sizehash(t));
+  if (t->rh != NULL) {  /* free its 'Rehash' and the part it moves */
+    if (ismoving(t))
+      vsM_freemem(L, t->rh->old.node, sizehash(&t->rh->old));
+    vsM_free(L, t->rh);
+  }
   // 释放数组部分
   vsM_freearray(L, t->array, t->sizearray);
+#if defined(VS_SHAPES)
+  vsM_freearray(L, t->slots, t->sizeslots);
+#endif
   // 释放表本身
   vsM_free(L, t);
 }
 
 
+#if !defined(VS_SWISSTABLE)
+
 // 从后往前找一个哈希部分的空闲位置并返回
 // 让lastfree指向返回的位置
 static Node *getfreepos (Table *t) {
@@ -453,6 +1116,8 @@ static Node *getfreepos (Table *t) {
   return NULL;  /* could not find a free place */
 }
 
+#endif
+
 
 
 /*
@@ -460,16 +1125,14 @@ static Node *getfreepos (Table *t) {
 ** position is free. If not, check whether colliding node is in its main
 ** position or not: if it is not, move colliding node to an empty place and
 ** put new key in its main position; otherwise (colliding node is in its main
-** position), new key goes to an empty position.
+** position), new key goes to an empty position. Returns NULL when there
+** is no free node.
 */
-// 在表t中新建一个key 返回该key对应的value部分
-// 如果key是可转换成整数的浮点数 key就转换成整数
+// 在表t的哈希部分插入key 返回该key对应的value部分
 // 计算key应该在哪个哈希桶中 该桶为mp
-// 如果桶的头不是nil 或者 哈希桶还没有空间
+// 如果桶的头不是nil 或者 哈希部分还没有空间
 //   找一个哈希部分的空闲位置为f
-//     f==NULL
-//       则说明哈希部分空间不够在新增key的基础上重新分配数组和哈希部分空间
-//       空间足够则调用vsH_set选择合适位置设置key
+//     f==NULL 则说明哈希部分空间不够 返回NULL
 //   如果mp位置的值的主位置不是mp
 //     调整碰撞位置所在链
 //     移动这个值到f 新key设置到mp上
@@ -477,28 +1140,25 @@ static Node *getfreepos (Table *t) {
 //     将新key插入到链上 就在碰撞元素后面
 //     设置mp=f 也就是新key设置到f上
 // 设置新key到mp
-TValue *vsH_newkey (vs_State *L, Table *t, const TValue *key) {
+static TValue *insertkey (vs_State *L, Table *t, const TValue *key) {
   Node *mp;  // mainposition主位置
-  TValue aux;
-  if (ttisnil(key)) vsG_runerror(L, "table index is nil");
-  else if (ttisfloat(key)) {  // 可转换成整数的浮点按照整数对待
-    vs_Integer k;
-    if (vsV_tointeger(key, &k, 0)) {  /* does index fit in an integer? */
-      setivalue(&aux, k);
-      key = &aux;  /* insert it as an integer */
-    }
-    else if (vsi_numisnan(fltvalue(key)))
-      vsG_runerror(L, "table index is NaN");
-  }
+#if defined(VS_SWISSTABLE)
+  unsigned int h;
+  int i;
+  if (t->growthleft == 0)  /* no room for a new key? */
+    return NULL;
+  h = hashkey(key);
+  i = getfreepos(t, h);
+  t->ctrl[i] = h2(h);
+  t->growthleft--;
+  mp = gnode(t, i);
+#else
   mp = mainposition(t, key);
   if (!ttisnil(gval(mp)) || isdummy(t)) {  /* main position is taken? */
     Node *othern;
     Node *f = getfreepos(t);  /* get a free place */
-    if (f == NULL) {  /* cannot find a free place? 空间不足需要重新分配 */
-      rehash(L, t, key);  /* grow table */
-      /* whatever called 'newkey' takes care of TM cache */
-      return vsH_set(L, t, key);  /* insert key into grown table */
-    }
+    if (f == NULL)  /* cannot find a free place? 空间不足需要重新分配 */
+      return NULL;
     vs_assert(!isdummy(t));
     othern = mainposition(t, gkey(mp));
     if (othern != mp) {  /* is colliding node out of its main position? 碰撞元素的主位置不在这里 */
@@ -514,6 +1174,9 @@ TValue *vsH_newkey (vs_State *L, Table *t, const TValue *key) {
         gnext(mp) = 0;  /* now 'mp' is free */
       }
       setnilvalue(gval(mp));
+      /* 'f' may be in a part of 't' the collector has already traversed */
+      vsC_barrierback(L, t, gval(f), gkey(f));
+      vsC_barrierback(L, t, gval(f), gval(f));
     }
     else {  /* colliding node is in its own main position 碰撞元素的主位置在这里 */
       /* new node will go into free position */
@@ -526,14 +1189,100 @@ TValue *vsH_newkey (vs_State *L, Table *t, const TValue *key) {
       mp = f;
     }
   }
+#endif
   // mp指向新节点
   setnodekey(L, &mp->i_key, key);  // 设置mp的key
-  vsC_barrierback(L, t, key);
+  vsC_barrierback(L, t, gval(mp), key);
   vs_assert(ttisnil(gval(mp)));
+  if (t->rh != NULL)  /* count it for 'rehash' */
+    countint(key, t->rh->nums);
   return gval(mp);  // 返回mp的value
 }
 
 
+// 在表t中新建一个key 返回该key对应的value部分
+// 如果key是可转换成整数的浮点数 key就转换成整数
+// 哈希部分没有空间时重新分配数组和哈希部分空间 然后调用vsH_set选择合适位置设置key
+TValue *vsH_newkey (vs_State *L, Table *t, const TValue *key) {
+  TValue *slot;
+  TValue aux;
+  if (ttisnil(key)) vsG_runerror(L, "table index is nil");
+  else if (ttisfloat(key)) {  // 可转换成整数的浮点按照整数对待
+    vs_Integer k;
+    if (vsV_tointeger(key, &k, 0)) {  /* does index fit in an integer? */
+      setivalue(&aux, k);
+      key = &aux;  /* insert it as an integer */
+    }
+    else if (vsi_numisnan(fltvalue(key)))
+      vsG_runerror(L, "table index is NaN");
+  }
+  if (ttisinteger(key))
+    updatehint(t, ivalue(key));
+#if defined(VS_SHAPES)
+  if (t->shape != NULL) {  /* a record? */
+    if (ttisshrstring(key) && t->shape->nkeys < MAXSHAPEKEYS)
+      return newslot(L, t, tsvalue(key));
+    else if ((slot = recordint(L, t, key)) != NULL)
+      return slot;
+    unshape(L, t);  /* 'key' goes to its new hash part */
+  }
+#endif
+  if (ismoving(t))  /* move some nodes of the old part first */
+    movenodes(L, t, t->rh->step);
+  slot = insertkey(L, t, key);
+  if (slot == NULL) {  /* no room for a new key? */
+    rehash(L, t, key);  /* grow table */
+    /* whatever called 'newkey' takes care of TM cache */
+    return vsH_set(L, t, key);  /* insert key into grown table */
+  }
+  return slot;
+}
+
+
+/*
+** A search that does not find its key in the hash part of a table looks
+** in the hash part being moved, where a node with a nil value does not
+** count: its key was moved or is dead.
+*/
+#define getmoving(t,f,k) \
+	(ismoving(t) ? livevalue(f(&(t)->rh->old, k)) : vsO_nilobject)
+
+static const TValue *livevalue (const TValue *v) {
+  return ttisnil(v) ? vsO_nilobject : v;
+}
+
+
+/*
+** search function for integers in the hash part
+*/
+// 在表t的哈希部分查询整数key 查询不到返回nil
+#if defined(VS_SWISSTABLE)
+static const TValue *getintnode (Table *t, vs_Integer key) {
+  unsigned int h = mixhash(cast(unsigned int, l_castS2U(key)));
+  probe(t, h, n, {
+    if (ttisinteger(gkey(n)) && ivalue(gkey(n)) == key)
+      return gval(n);  /* that's it */
+  });
+  return vsO_nilobject;
+}
+#else
+static const TValue *getintnode (Table *t, vs_Integer key) {
+  Node *n = hashint(t, key);  // 找到应该在的哈希桶
+  // 遍历哈希桶找到key一致的位置
+  for (;;) {  /* check whether 'key' is somewhere in the chain */
+    if (ttisinteger(gkey(n)) && ivalue(gkey(n)) == key)
+      return gval(n);  /* that's it */
+    else {
+      int nx = gnext(n);
+      if (nx == 0) break;
+      n += nx;
+    }
+  }
+  return vsO_nilobject;
+}
+#endif
+
+
 /*
 ** search function for integers
 */
@@ -543,30 +1292,37 @@ const TValue *vsH_getint (Table *t, vs_Integer key) {
   /* (1 <= key && key <= t->sizearray) */
   if (l_castS2U(key) - 1 < t->sizearray)  // key在数组部分
     return &t->array[key - 1];
+#if defined(VS_NANBOXING)
+  else if (!nbfitsint(key)) {  // 超出47位的整数key按浮点数保存
+    TValue k;
+    setfltvalue(&k, cast_num(key));
+    return getgeneric(t, &k);
+  }
+#endif
   else {
-    Node *n = hashint(t, key);  // 找到应该在的哈希桶
-    // 遍历哈希桶找到key一致的位置
-    for (;;) {  /* check whether 'key' is somewhere in the chain */
-      if (ttisinteger(gkey(n)) && ivalue(gkey(n)) == key)
-        return gval(n);  /* that's it */
-      else {
-        int nx = gnext(n);
-        if (nx == 0) break;
-        n += nx;
-      }
-    }
-    return vsO_nilobject;
+    const TValue *res = getintnode(t, key);
+    return (res != vsO_nilobject) ? res : getmoving(t, getintnode, key);
   }
 }
 
 
 /*
-** search function for short strings
+** search function for short strings in the hash part
 */
-// 表t中查询短字符串
-const TValue *vsH_getshortstr (Table *t, TString *key) {
+// 在表t的哈希部分查询短字符串
+#if defined(VS_SWISSTABLE)
+static const TValue *getstrnode (Table *t, TString *key) {
+  unsigned int h = key->hash;
+  probe(t, h, n, {
+    const TValue *k = gkey(n);
+    if (ttisshrstring(k) && eqshrstr(tsvalue(k), key))
+      return gval(n);  /* that's it */
+  });
+  return vsO_nilobject;  /* not found */
+}
+#else
+static const TValue *getstrnode (Table *t, TString *key) {
   Node *n = hashstr(t, key);
-  vs_assert(key->tt == VS_TSHRSTR);
   for (;;) {  /* check whether 'key' is somewhere in the chain */
     const TValue *k = gkey(n);
     if (ttisshrstring(k) && eqshrstr(tsvalue(k), key))
@@ -579,14 +1335,95 @@ const TValue *vsH_getshortstr (Table *t, TString *key) {
     }
   }
 }
+#endif
 
 
 /*
-** "Generic" get version. (Not that generic: not valid for integers,
-** which may be in array part, nor for floats with integral values.)
+** search function for short strings
 */
-// 通用的get函数 用于从表t中查询key
-static const TValue *getgeneric (Table *t, const TValue *key) {
+// 表t中查询短字符串
+const TValue *vsH_getshortstr (Table *t, TString *key) {
+  const TValue *res;
+  vs_assert(key->tt == VS_TSHRSTR);
+#if defined(VS_SHAPES)
+  if (t->shape != NULL)
+    return getslot(t, key);
+#endif
+  res = getstrnode(t, key);
+  return (res != vsO_nilobject) ? res : getmoving(t, getstrnode, key);
+}
+
+
+/*
+** search function for short strings, using an inline cache: '*hint'
+** is the index of the node where 'key' was found last time
+*/
+// 带有内联缓存的短字符串查询
+// 先检查上次查询到的位置 如果那个Node的key还是这个字符串就直接命中
+// hint只是一个下标 每次都会检查范围和key 所以哈希部分重新分配后也不会出错
+const TValue *vsH_getshortstrcached (Table *t, TString *key, int *hint) {
+  const TValue *res;
+  int idx = *hint;
+#if defined(VS_SHAPES)
+  if (t->shape != NULL) {  /* for a record, the hint is a slot */
+    if (idx < t->shape->nkeys && t->shape->keys[idx] == key)
+      return &t->slots[idx];  /* cache hit */
+    idx = shapeslot(t->shape, key);
+    if (idx < 0) return vsO_nilobject;
+    *hint = idx;
+    return &t->slots[idx];
+  }
+#endif
+  if (idx < allocsizenode(t)) {
+    Node *n = gnode(t, idx);
+    if (ttisshrstring(gkey(n)) && tsvalue(gkey(n)) == key)
+      return gval(n);  /* cache hit */
+  }
+  res = vsH_getshortstr(t, key);
+  if (res != vsO_nilobject &&  /* found in the hash part? remember its node */
+      cast(const Node *, res) >= t->node &&
+      cast(const Node *, res) < t->node + allocsizenode(t))
+    *hint = cast_int(cast(const Node *, res) - t->node);
+  return res;
+}
+
+
+#if defined(VS_SHAPES)
+/*
+** search function for the constant short-string key of an instruction
+** with inline cache 'c': if 't' is a record, the cache gets its shape
+** and the slot of 'key'
+*/
+const TValue *vsH_getfield (Table *t, TString *key, ShapeCache *c) {
+  if (t->shape != NULL) {
+    int i = shapeslot(t->shape, key);
+    if (i < 0) return vsO_nilobject;
+    c->id = t->shape->id;
+    c->slot = i;
+    return &t->slots[i];
+  }
+  return vsH_getshortstr(t, key);
+}
+#endif
+
+
+/*
+** "Generic" search in the hash part. (Not that generic: not valid for
+** integers, which may be in array part, nor for floats with integral
+** values.)
+*/
+// 通用的查询函数 用于从表t的哈希部分中查询key
+#if defined(VS_SWISSTABLE)
+static const TValue *getnode (Table *t, const TValue *key) {
+  unsigned int h = hashkey(key);
+  probe(t, h, n, {
+    if (vsV_equalobj(gkey(n), key))
+      return gval(n);  /* that's it */
+  });
+  return vsO_nilobject;  /* not found */
+}
+#else
+static const TValue *getnode (Table *t, const TValue *key) {
   Node *n = mainposition(t, key);
   for (;;) {  /* check whether 'key' is somewhere in the chain */
     if (vsV_equalobj(gkey(n), key))
@@ -599,6 +1436,17 @@ static const TValue *getgeneric (Table *t, const TValue *key) {
     }
   }
 }
+#endif
+
+
+/*
+** "Generic" get version, for the same keys as 'getnode'
+*/
+// 通用的get函数 用于从表t中查询key
+static const TValue *getgeneric (Table *t, const TValue *key) {
+  const TValue *res = getnode(t, key);
+  return (res != vsO_nilobject) ? res : getmoving(t, getnode, key);
+}
 
 
 // 从表t中查询字符串类型的key
@@ -693,9 +1541,8 @@ static int unbound_search (Table *t, unsigned int j) {
 ** Try to find a boundary in table 't'. A 'boundary' is an integer index
 ** such that t[i] is non-nil and t[i+1] is nil (and 0 if t[1] is nil).
 */
-// 用于计算#t的函数
 // 如果有数组部分计算数组部分 没有数组部分查询哈希部分
-int vsH_getn (Table *t) {
+static unsigned int getborder (Table *t) {
   unsigned int j = t->sizearray;
   if (j > 0 && ttisnil(&t->array[j - 1])) {
     /* there is a boundary in the array part: (binary) search for it */
@@ -712,3 +1559,144 @@ int vsH_getn (Table *t) {
     return j;  /* that is easy... */
   else return unbound_search(t, j);
 }
+
+
+// t[j]是否是nil
+static int isnilat (Table *t, unsigned int j) {
+  if (j - 1 < t->sizearray)  /* in the array part? */
+    return ttisnil(&t->array[j - 1]);
+  else
+    return ttisnil(vsH_getint(t, j));
+}
+
+
+/*
+** '#t' first checks 'lenhint', the border it found last time, and up to
+** MAXHINTSTEPS indices after it, or the index before it; appending to
+** the table or removing its last element keeps it constant time. Only
+** when there is no hint or the border moved further does it search.
+*/
+// 用于计算#t的函数
+int vsH_getn (Table *t) {
+  unsigned int j = t->lenhint;
+  if (j == 0)  /* no hint yet? */
+    ;  /* search it */
+  else if (!isnilat(t, j)) {  /* t[j] present? */
+    int i;
+    for (i = 0; i < MAXHINTSTEPS; i++, j++) {  /* try to extend it */
+      if (isnilat(t, j + 1))
+        return cast_int(t->lenhint = j);
+    }
+  }
+  else if (j == 1 || !isnilat(t, j - 1))  /* last element removed? */
+    return cast_int(t->lenhint = j - 1);
+  t->lenhint = getborder(t);
+  return cast_int(t->lenhint);
+}
+
+
+
+/*
+** {=============================================================
+** Typed arrays
+** ==============================================================
+*/
+
+/*
+** A typed array keeps elements 1..'size' unboxed, all of type 'etype'.
+** Reading an index outside them gives nil, as an absent key would.
+** Writing index 'size'+1 appends an element and writing nil to index
+** 'size' removes the last one, so 't[#t+1] = v', 't[#t] = nil' and
+** 'table.insert'/'table.remove' keep working; other writes outside the
+** elements, and values that do not fit 'etype', are errors.
+*/
+
+// 创建一个没有元素的类型化数组
+TArray *vsH_newarray (vs_State *L, int etype) {
+  GCObject *o = vsC_newobj(L, VS_TARRAY, sizeof(TArray));
+  TArray *a = gco2a(o);
+  a->etype = cast_byte(etype);
+  a->size = a->sizealloc = 0;
+  a->u.b = NULL;
+  return a;
+}
+
+
+// 重新分配元素的空间 可以放下n个元素
+static void reallocelems (vs_State *L, TArray *a, unsigned int n) {
+  a->u.b = cast(lu_byte *, vsM_reallocv(L, a->u.b, a->sizealloc, n,
+                                         elemsize(a->etype)));
+  a->sizealloc = n;
+}
+
+
+// 修改元素个数为n 新增的元素都是0
+void vsH_setlength (vs_State *L, TArray *a, unsigned int n) {
+  size_t es = elemsize(a->etype);
+  if (n > MAXASIZE)
+    vsG_runerror(L, "typed array overflow");
+  if (n > a->sizealloc)
+    reallocelems(L, a, n);
+  if (n > a->size)
+    memset(a->u.b + a->size * es, 0, (n - a->size) * es);
+  a->size = n;
+}
+
+
+// a[k] = v
+void vsH_setelem (vs_State *L, TArray *a, vs_Integer k, const TValue *v) {
+  vs_Unsigned i = l_castS2U(k) - 1;
+  vs_Integer n = 0;
+  if (ttisnil(v)) {  /* remove last element? */
+    if (a->size == 0 || i != a->size - 1)
+      vsG_runerror(L, "only the last element of a typed array can be nil");
+    a->size--;
+    return;
+  }
+  if (i > a->size)
+    vsG_runerror(L, "typed array index out of range");
+  if (!ttisnumber(v))
+    vsG_runerror(L, "number expected as typed array element, got %s",
+                    vs_typename(L, ttnov(v)));
+  if (a->etype != VS_ADOUBLE) {
+    if (!vsV_tointeger(v, &n, 0))
+      vsG_runerror(L, "number has no integer representation");
+    if (a->etype == VS_ABYTE && l_castS2U(n) > UCHAR_MAX)
+      vsG_runerror(L, "value out of range for a byte array");
+  }
+  if (i == a->size) {  /* append */
+    if (a->size == a->sizealloc) {
+      if (a->sizealloc >= MAXASIZE)
+        vsG_runerror(L, "typed array overflow");
+      reallocelems(L, a, a->sizealloc < 4 ? 4 : a->sizealloc * 2);
+    }
+    a->size++;
+  }
+  switch (a->etype) {
+    case VS_AINT64: a->u.i[i] = n; break;
+    case VS_ADOUBLE: a->u.n[i] = nvalue(v); break;
+    default: a->u.b[i] = cast_byte(n); break;
+  }
+}
+
+
+// 类型化数组的vsH_next 键就是下标
+int vsH_nextelem (vs_State *L, TArray *a, StkId key) {
+  vs_Integer k = 0;
+  if (!ttisnil(key) &&
+      !(ttisnumber(key) && vsV_tointeger(key, &k, 0) && k > 0))
+    vsG_runerror(L, "invalid key to 'next'");
+  if (l_castS2U(k) >= a->size)
+    return 0;  /* no more elements */
+  setivalue(key, k + 1);
+  vsH_getelem(a, k + 1, key + 1);
+  return 1;
+}
+
+
+void vsH_freearray (vs_State *L, TArray *a) {
+  vsM_freemem(L, a->u.b, a->sizealloc * elemsize(a->etype));
+  vsM_free(L, a);
+}
+
+/* }============================================================= */
@@ -22,7 +22,11 @@
 
 /* true when 't' is using 'dummynode' as its hash part */
 // 判断表t的哈希部分是不是dummynode
+#if defined(VS_SWISSTABLE)
+#define isdummy(t)		((t)->ctrl == vsH_dummyctrl)
+#else
 #define isdummy(t)		((t)->lastfree == NULL)
+#endif
 
 
 /* allocated size for hash nodes */
@@ -31,6 +35,88 @@
 #define allocsizenode(t)	(isdummy(t) ? 0 : sizenode(t))
 
 
+#if defined(VS_SWISSTABLE)
+
+/* number of control bytes compared at once */
+#define CTRLGROUP	16
+
+/* number of control bytes of a hash part with 'n' nodes */
+#define sizectrl(n)	((n) < CTRLGROUP ? CTRLGROUP : (n))
+
+/* memory used by the hash part (nodes followed by control bytes) */
+#define sizehash(t)	(isdummy(t) ? 0 : \
+	sizeof(Node) * cast(size_t, sizenode(t)) + sizectrl(sizenode(t)))
+
+VSI_DDEC const lu_byte vsH_dummyctrl[CTRLGROUP];
+
+#else
+
+/* memory used by the hash part */
+#define sizehash(t)	(sizeof(Node) * cast(size_t, allocsizenode(t)))
+
+#endif
+
+
+/*
+** A table whose hash part once had MOVEMIN nodes (see vtable.c) counts
+** the integer keys of its hash part by slice, so that growing it does
+** not count its keys again, and moves the nodes of a full hash part to
+** the grown one a few at a time. Until then, 'old' is the part being
+** moved; only its node vector and the fields that locate a key in it
+** are used.
+*/
+typedef struct Rehash {
+  Table old;  /* hash part being moved ('old.node' is NULL if none) */
+  unsigned int cursor;  /* next node of 'old' to move */
+  unsigned int step;  /* nodes of 'old' moved at each new key */
+  unsigned int used;  /* nodes of 'old' with a key, up to 'cursor' */
+  unsigned int live;  /* nodes of 'old' with a value, up to 'cursor' */
+  lu_byte sparse;  /* most nodes of the last moved part were dead */
+  // nums[i]是哈希部分在2^(i-1)和2^i之间的整数键个数(包括值为nil的)
+  unsigned int nums[sizeof(int) * CHAR_BIT];  /* integer keys by slice */
+} Rehash;
+
+/* true while the hash part of 't' is being moved */
+#define ismoving(t)	((t)->rh != NULL && (t)->rh->old.node != NULL)
+
+/* number of nodes of the hash part being moved */
+#define sizemoving(t)	(ismoving(t) ? sizenode(&(t)->rh->old) : 0)
+
+/* memory used by the 'Rehash' of 't' and the hash part it moves */
+#define sizerehash(t)	((t)->rh == NULL ? 0 : sizeof(Rehash) + \
+	(ismoving(t) ? sizehash(&(t)->rh->old) : 0))
+
+
+#if defined(VS_SHAPES)
+
+/* maximum number of keys of a record table (see vtable.c) */
+#define MAXSHAPEKEYS	32
+
+/* shapes with more keys than this have an index */
+#define SHAPELINEAR	8
+
+/* memory used by a shape with 'n' keys and an index of 2^'l' bytes */
+#define sizeshape(n,l)	(offsetof(Shape, keys) + sizeof(TString *) * (n) + \
+			 ((l) > 0 ? cast(size_t, twoto(l)) : 0))
+
+#endif
+
+
+/* size of an element of a typed array with elements of type 'e' */
+#define elemsize(e) \
+	((e) == VS_AINT64 ? sizeof(vs_Integer) : \
+	 (e) == VS_ADOUBLE ? sizeof(vs_Number) : sizeof(lu_byte))
+
+/* v = element 'k' of typed array 'a' (nil when 'k' is out of range) */
+// 解释器的快速路径也要用 所以定义成宏
+#define vsH_getelem(a,k,v) \
+  { const TArray *a_ = (a); vs_Unsigned i_ = l_castS2U(k) - 1; \
+    if (i_ >= a_->size) { setnilvalue(v); } \
+    else if (a_->etype == VS_AINT64) { setivalue(v, a_->u.i[i_]); } \
+    else if (a_->etype == VS_ADOUBLE) { setfltvalue(v, a_->u.n[i_]); } \
+    else { setivalue(v, a_->u.b[i_]); } }
+
+
 /* returns the key, given the value of a table entry */
 // 通过Node对象中的i_val字段,查询i_key字段的地址
 // offsetof用于计算结构体内某一字段与该结构体开头的偏移量
@@ -43,6 +129,12 @@ VSI_FUNC const TValue *vsH_getint (Table *t, vs_Integer key);
 VSI_FUNC void vsH_setint (vs_State *L, Table *t, vs_Integer key,
                                                     TValue *value);
 VSI_FUNC const TValue *vsH_getshortstr (Table *t, TString *key);
+VSI_FUNC const TValue *vsH_getshortstrcached (Table *t, TString *key,
+                                                            int *hint);
+#if defined(VS_SHAPES)
+VSI_FUNC const TValue *vsH_getfield (Table *t, TString *key,
+                                                ShapeCache *c);
+#endif
 VSI_FUNC const TValue *vsH_getstr (Table *t, TString *key);
 VSI_FUNC const TValue *vsH_get (Table *t, const TValue *key);
 VSI_FUNC TValue *vsH_newkey (vs_State *L, Table *t, const TValue *key);
@@ -54,6 +146,16 @@ VSI_FUNC void vsH_resizearray (vs_State *L, Table *t, unsigned int nasize);
 VSI_FUNC void vsH_free (vs_State *L, Table *t);
 VSI_FUNC int vsH_next (vs_State *L, Table *t, StkId key);
 VSI_FUNC int vsH_getn (Table *t);
+VSI_FUNC TArray *vsH_newarray (vs_State *L, int etype);
+VSI_FUNC void vsH_setlength (vs_State *L, TArray *a, unsigned int n);
+VSI_FUNC void vsH_setelem (vs_State *L, TArray *a, vs_Integer k,
+                                                    const TValue *v);
+VSI_FUNC int vsH_nextelem (vs_State *L, TArray *a, StkId key);
+VSI_FUNC void vsH_freearray (vs_State *L, TArray *a);
+#if defined(VS_SHAPES)
+VSI_FUNC void vsH_initshapes (vs_State *L);
+VSI_FUNC void vsH_freeshape (vs_State *L, Shape *s);
+#endif
 
 
 #endif
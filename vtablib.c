@@ -8,6 +8,7 @@
 
 #include <limits.h>
 #include <stddef.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "vs.h"
@@ -74,6 +75,103 @@ static int tremove (vs_State *L) {
 }
 
 
+/*
+** {======================================================
+** Typed arrays
+** =======================================================
+*/
+
+static const char *const arraykinds[] = {"int64", "double", "byte", NULL};
+
+/* size of the elements of each kind of typed array */
+static const size_t elemsizes[] = {
+  sizeof(vs_Integer), sizeof(vs_Number), sizeof(unsigned char)
+};
+
+
+// table.newarray(kind [, n | t]) 创建n个0 或者复制表t的1..#t元素
+static int newarray (vs_State *L) {
+  int etype = vsL_checkoption(L, 1, NULL, arraykinds);
+  if (vs_type(L, 2) == VS_TTABLE) {  /* copy a sequence */
+    vs_Integer i, n = vsL_len(L, 2);
+    vs_newarray(L, etype, 0);
+    for (i = 1; i <= n; i++) {
+      vs_geti(L, 2, i);
+      vs_seti(L, -2, i);
+    }
+  }
+  else {
+    vs_Integer n = vsL_optinteger(L, 2, 0);
+    vsL_argcheck(L, 0 <= n && n < INT_MAX, 2, "invalid size");
+    vs_newarray(L, etype, (size_t)n);
+  }
+  return 1;
+}
+
+
+/*
+** 'table.move' between typed arrays of the same kind: grows the
+** destination with zeros if needed and moves the raw elements. Returns
+** 0 if it does not apply.
+*/
+static int movearray (vs_State *L, vs_Integer f, vs_Integer n,
+                                   vs_Integer t, int tt) {
+  int st = -1, dt = -1;
+  size_t sn, dn, es;
+  char *src, *dst;
+  vs_toarray(L, 1, &st, &sn);
+  vs_toarray(L, tt, &dt, &dn);
+  if (st < 0 || st != dt || f < 1 || (vs_Unsigned)(f - 1 + n) > sn ||
+      t < 1 || (vs_Unsigned)(t - 1) > dn)
+    return 0;
+  for (; (vs_Unsigned)(t - 1 + n) > dn; dn++) {  /* grow destination */
+    vs_pushinteger(L, 0);
+    vs_seti(L, tt, (vs_Integer)dn + 1);
+  }
+  es = elemsizes[st];
+  src = (char *)vs_toarray(L, 1, NULL, NULL);
+  dst = (char *)vs_toarray(L, tt, NULL, NULL);
+  memmove(dst + (t - 1) * es, src + (f - 1) * es, (size_t)n * es);
+  return 1;
+}
+
+
+static int cmpint64 (const void *a, const void *b) {
+  vs_Integer x = *(const vs_Integer *)a, y = *(const vs_Integer *)b;
+  return (x > y) - (x < y);
+}
+
+static int cmpdouble (const void *a, const void *b) {
+  vs_Number x = *(const vs_Number *)a, y = *(const vs_Number *)b;
+  return (x > y) - (x < y);
+}
+
+static int cmpbyte (const void *a, const void *b) {
+  return *(const unsigned char *)a - *(const unsigned char *)b;
+}
+
+
+/*
+** 'table.sort' of a typed array without an order function sorts the
+** raw elements. Returns 0 if it does not apply.
+*/
+static int sortarray (vs_State *L) {
+  static int (*const cmps[])(const void *, const void *) = {
+    cmpint64, cmpdouble, cmpbyte
+  };
+  int etype = -1;
+  size_t n;
+  void *e = vs_toarray(L, 1, &etype, &n);
+  if (etype < 0 || !vs_isnoneornil(L, 2))
+    return 0;
+  if (n > 1)
+    qsort(e, n, elemsizes[etype], cmps[etype]);
+  return 1;
+}
+
+/* }====================================================== */
+
+
 /*
 ** Copy elements (1[f], ..., 1[e]) into (tt[t], tt[t+1], ...). Whenever
 ** possible, copy in increasing order, which is better for rehashing.
@@ -94,7 +192,10 @@ static int tmove (vs_State *L) {
     n = e - f + 1;  /* number of elements to move */
     vsL_argcheck(L, t <= VS_MAXINTEGER - n + 1, 4,
                   "destination wrap around");
-    if (t > e || t <= f || (tt != 1 && !vs_compare(L, 1, tt, VS_OPEQ))) {
+    if (movearray(L, f, n, t, tt)) {
+      /* moved the raw elements of typed arrays */
+    }
+    else if (t > e || t <= f || (tt != 1 && !vs_compare(L, 1, tt, VS_OPEQ))) {
       for (i = 0; i < n; i++) {
         vs_geti(L, 1, f + i);
         vs_seti(L, tt, t + i);
@@ -365,6 +466,8 @@ static void auxsort (vs_State *L, IdxT lo, IdxT up,
 
 static int sort (vs_State *L) {
   vs_Integer n = aux_getn(L, 1);
+  if (sortarray(L))
+    return 0;  /* sorted a typed array */
   if (n > 1) {  /* non-trivial interval? */
     vsL_argcheck(L, n < INT_MAX, 1, "array too big");
     if (!vs_isnoneornil(L, 2))  /* is there a 2nd argument? */
@@ -386,6 +489,7 @@ static const vsL_Reg tab_funcs[] = {
   {"remove", tremove},
   {"move", tmove},
   {"sort", sort},
+  {"newarray", newarray},
   {NULL, NULL}
 };
 
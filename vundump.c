@@ -11,6 +11,7 @@
 #include "vmem.h"
 #include "vobject.h"
 #include "vstring.h"
+#include "vtable.h"
 #include "vundump.h"
 #include "vzio.h"
 
@@ -133,6 +134,17 @@ static void LoadConstants (LoadState *S, Proto *f) {
     case VS_TLNGSTR:
       setsvalue2n(S->L, o, LoadString(S));
       break;
+    case VS_TARRAY: {
+      TArray *a;
+      int etype = LoadByte(S);
+      int size = LoadInt(S);
+      if (etype > VS_ABYTE || size < 0) error(S, "bad typed array");
+      a = vsH_newarray(S->L, etype);
+      setarrvalue(S->L, o, a);
+      vsH_setlength(S->L, a, cast(unsigned int, size));
+      LoadBlock(S, a->u.b, a->size * elemsize(etype));
+      break;
+    }
     default:
       vs_assert(0);
     }
@@ -200,6 +212,7 @@ static void LoadFunction (LoadState *S, Proto *f, TString *psource) {
   f->is_vararg = LoadByte(S);
   f->maxstacksize = LoadByte(S);
   LoadCode(S, f);
+  vsF_inittcache(S->L, f);
   LoadConstants(S, f);
   LoadUpvalues(S, f);
   LoadProtos(S, f);
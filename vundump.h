@@ -14,7 +14,8 @@
 
 #define MYINT(s)	(s[0]-'0')
 #define VSC_VERSION	(MYINT(VS_VERSION_MAJOR)*16+MYINT(VS_VERSION_MINOR))
-#define VSC_FORMAT	0	/* this is the official format */
+#define VSC_FORMAT	2	/* this is the official format */
+// 指令集或常量类型改变时(例如新增融合跳转指令, OP_NEWARRAY)需要增加VSC_FORMAT
 
 /* load one chunk; from lundump.c */
 VSI_FUNC LClosure* vsU_undump (vs_State* L, ZIO* Z, const char* name);
@@ -6,14 +6,20 @@
 #include <stdlib.h>
 #include <string.h>
 
+#if defined(VS_OPCOUNTS) && defined(VS_OPCYCLES)
+#include <x86intrin.h>  /* for '__rdtsc' */
+#endif
+
 #include "vs.h"
 
 #include "vdebug.h"
 #include "vdo.h"
 #include "vfunc.h"
 #include "vgc.h"
+#include "vmem.h"
 #include "vobject.h"
 #include "vopcodes.h"
+#include "vprof.h"
 #include "vstate.h"
 #include "vstring.h"
 #include "vtable.h"
@@ -94,20 +100,43 @@ static int forlimit (const TValue *obj, vs_Integer *p, vs_Integer step,
 }
 
 
+// 类型化数组的下标必须能转换成整数 返回0说明不能转换
+#define arraykey(k,i)	(ttisnumber(k) && vsV_tointeger(k, i, 0))
+
+
+// val = t[key], t不是表时使用
+// 类型化数组用整数下标访问 其他的键都是nil, 其他类型的值不能索引
+void vsV_finishget (vs_State *L, const TValue *t, TValue *key, StkId val) {
+  vs_Integer k;
+  if (!ttisarray(t))
+    vsG_typeerror(L, t, "index");
+  else if (arraykey(key, &k))
+    vsH_getelem(arrvalue(t), k, val)
+  else
+    setnilvalue(val);
+}
+
+
 // t[key] = val
 // slot的意义与上面函数一致
 // 查询__newindex元方法, 如果是
 void vsV_finishset (vs_State *L, const TValue *t, TValue *key,
                      StkId val, const TValue *slot) {
-  if (slot == NULL)
-    vsG_typeerror(L, t, "index");
+  if (slot == NULL) {  /* not a table */
+    vs_Integer k;
+    if (!ttisarray(t))
+      vsG_typeerror(L, t, "index");
+    else if (!arraykey(key, &k))
+      vsG_runerror(L, "typed array index must be an integer");
+    vsH_setelem(L, arrvalue(t), k, val);
+  }
   else {
     Table *h = hvalue(t);  /* save 't' table */
     vs_assert(ttisnil(slot));  /* old value must be nil */
     if (slot == vsO_nilobject)  // 是nilobject说明key还没创建过
       slot = vsH_newkey(L, h, key);  /* create one 返回的新Node的val字段 */
     setobj2t(L, cast(TValue *, slot), val);  /* set its new value 直接往新Node上赋值 */
-    vsC_barrierback(L, h, val);
+    vsC_barrierback(L, h, slot, val);
   }
 }
 
@@ -326,6 +355,10 @@ void vsV_objlen (vs_State *L, StkId ra, const TValue *rb) {
       setivalue(ra, vsH_getn(h));  /* else primitive len */
       return;
     }
+    case VS_TARRAY: {
+      setivalue(ra, arrvalue(rb)->size);
+      return;
+    }
     case VS_TSHRSTR: {
       setivalue(ra, tsvalue(rb)->shrlen);
       return;
@@ -480,7 +513,14 @@ static void pushclosure (vs_State *L, Proto *p, UpVal **encup, StkId base,
     ci->savedpc += GETARG_sBx(i) + e; }
 
 /* for test instructions, execute the jump instruction that follows it */
-#define donextjump(ci)	{ i = *ci->savedpc; dojump(ci, i, 1); }
+#define donextjump(ci)	{ i = *ci->savedpc; \
+  if (GETARG_sBx(i) < 0) vsR_cpucheck(L); dojump(ci, i, 1); }
+
+/* jump of a fused test; a backward one closes a loop like OP_JMP */
+#define dosJ(ci,i) \
+  { int sj = GETARG_sJ(i); \
+    if (sj < 0) vsR_cpucheck(L); \
+    ci->savedpc += sj; }
 
 
 #define Protect(x)	{ {x;}; base = ci->base; }
@@ -493,16 +533,95 @@ static void pushclosure (vs_State *L, Proto *p, UpVal **encup, StkId base,
 /* fetch an instruction and prepare its execution */
 #define vmfetch()	{ \
   i = *(ci->savedpc++); \
+  vmcount(); \
   ra = RA(i); /* WARNING: any stack reallocation invalidates 'ra' */ \
   vs_assert(base == ci->base); \
   vs_assert(base <= L->top && L->top < L->stack + L->stacksize); \
 }
 
+/*
+** VS_USE_JUMPTABLE为1时使用线程化分派(computed goto), 见vjumptab.h
+** 否则使用下面基于switch的分派, 用于不支持"labels as values"的编译器
+*/
+#if !defined(VS_USE_JUMPTABLE)
+#if defined(__GNUC__)
+#define VS_USE_JUMPTABLE	1
+#else
+#define VS_USE_JUMPTABLE	0
+#endif
+#endif
+
+
 #define vmdispatch(o)	switch(o)
 #define vmcase(l)	case l:
 #define vmbreak		break
 
 
+/*
+** fast paths for the most common operand types, tried before the
+** generic code: an integer key inside the array part of a table, and
+** two integers or two floats in a comparison
+*/
+// 如果t是表并且k是在数组部分范围内的整数 slot指向数组部分对应的位置
+#define fastgeti(t,k,slot) \
+  (ttistable(t) && ttisinteger(k) && \
+   l_castS2U(ivalue(k)) - 1 < hvalue(t)->sizearray && \
+   (slot = &hvalue(t)->array[ivalue(k) - 1], 1))
+
+/*
+** if 't' is a typed array, 'k' an integer in its range and 'v' a number
+** stored without conversion, writes the element; returns 0 otherwise
+*/
+#define fastseta(t,k,v) \
+  (ttisarray(t) && ttisinteger(k) && ttisnumber(v) && \
+   l_castS2U(ivalue(k)) - 1 < arrvalue(t)->size && \
+   setelem(arrvalue(t), ivalue(k) - 1, v))
+
+// a[j] = v (j从0开始) 需要转换或者检查失败时返回0
+#define setelem(a,j,v) \
+  ((a)->etype == VS_AINT64 && ttisinteger(v) \
+   ? ((a)->u.i[j] = ivalue(v), 1) \
+   : (a)->etype == VS_ADOUBLE ? ((a)->u.n[j] = nvalue(v), 1) \
+   : (a)->etype == VS_ABYTE && ttisinteger(v) && \
+     l_castS2U(ivalue(v)) <= UCHAR_MAX \
+   ? ((a)->u.b[j] = cast_byte(ivalue(v)), 1) \
+   : 0)
+
+// 两个整数或者两个浮点数直接比较 结果写入res 返回0说明需要走通用的比较
+#define fastcmp(rb,rc,op,res) \
+  (ttisinteger(rb) && ttisinteger(rc) ? (res = (ivalue(rb) op ivalue(rc)), 1) \
+   : ttisfloat(rb) && ttisfloat(rc) ? (res = (fltvalue(rb) op fltvalue(rc)), 1) \
+   : 0)
+
+// 与立即数ic比较的快速路径 只需要检查rb的类型
+#define fastcmpi(rb,ic,op,res) \
+  (ttisinteger(rb) ? (res = (ivalue(rb) op (ic)), 1) \
+   : ttisfloat(rb) ? (res = (fltvalue(rb) op cast_num(ic)), 1) \
+   : 0)
+
+
+// 当前指令(OP_GETTABUP/OP_SETTABUP)在函数原型p中的内联缓存
+#define tcacheslot(p,ci)	(&(p)->tcache[(ci)->savedpc - (p)->code - 1])
+
+#if defined(VS_SHAPES)
+// 当前指令(OP_GETTABLE/OP_SETTABLE/OP_SELF)的形状内联缓存
+#define scacheslot(p,ci)	(&(p)->scache[(ci)->savedpc - (p)->code - 1])
+
+/*
+** if 't' is a record with the shape in inline cache 'c', 'res' points
+** to the cached slot. Only instructions with a constant short-string key
+** fill their caches (see 'vsH_getfield'), so a hit means the same key.
+*/
+#define fastgetfield(t,c,res) \
+  (ttistable(t) && hvalue(t)->shape != NULL && \
+   hvalue(t)->shape->id == (c)->id && \
+   (res = &hvalue(t)->slots[(c)->slot], 1))
+
+// 键是短字符串常量的字段访问
+#define isfield(t,k,rk)	(ttistable(t) && ISK(rk) && ttisshrstring(k))
+#endif
+
+
 /*
 ** copy of 'vsV_gettable', but protecting the call to potential
 ** metamethod (which can reallocate the stack)
@@ -510,7 +629,7 @@ static void pushclosure (vs_State *L, Proto *p, UpVal **encup, StkId base,
 // 传入表t和键k,将查询结果写入v
 #define gettableProtected(L,t,k,v)  { const TValue *slot; \
   if (vsV_fastget(L,t,k,slot,vsH_get)) { setobj2s(L, v, slot); } \
-  else vsG_typeerror(L, t, "index"); }
+  else vsV_finishget(L,t,k,v); }
 
 
 /* same for 'vsV_settable' */
@@ -520,11 +639,97 @@ static void pushclosure (vs_State *L, Proto *p, UpVal **encup, StkId base,
 
 
 
+#if defined(VS_OPCOUNTS)
+
+static int optype (const TValue *o) {
+  if (o == NULL) return VS_OPTNONE;
+  else if (ttisfloat(o)) return VS_OPTFLOAT;
+  else return ttnov(o);  /* integers are VS_TNUMBER */
+}
+
+
+/*
+** Counts instruction 'i', just fetched by 'vsV_execute'. The operand
+** types recorded are those an opcode could be specialized on: the
+** source of moves and unary operations, both operands of arithmetic
+** and comparisons, the table and key of indexing, the function being
+** called and the control variable of loops. Cycles (VS_OPCYCLES) go
+** to the previous instruction and include the time of its calls.
+*/
+static void countop (vs_State *L, CallInfo *ci, LClosure *cl, TValue *k,
+                     StkId base, Instruction i) {
+  OpCounts *oc = G(L)->opcounts;
+  Proto *p = cl->p;
+  OpCode op = GET_OPCODE(i);
+  const TValue *x = NULL, *y = NULL;
+  if (oc == NULL) return;
+#if defined(VS_OPCYCLES)
+  {
+    unsigned long long now = __rdtsc();
+    if (oc->lastop >= 0) oc->cycles[oc->lastop] += now - oc->tsc;
+    oc->tsc = now;
+    oc->lastop = op;
+  }
+#endif
+  if (p->opcount == NULL) {  /* first instruction run in 'p'? */
+    p->opcount = vsM_newvector(L, p->sizecode, lu_mem);
+    memset(p->opcount, 0, p->sizecode * sizeof(lu_mem));
+  }
+  p->opcount[ci->savedpc - p->code - 1]++;
+  switch (op) {
+    case OP_MOVE: case OP_ADDI: case OP_UNM: case OP_BNOT: case OP_NOT:
+    case OP_LEN: case OP_EQI: case OP_LTI: case OP_LEI: case OP_GTI:
+    case OP_GEI: case OP_TESTSET:
+      x = RB(i);
+      break;
+    case OP_GETTABUP:
+      x = cl->upvals[GETARG_B(i)]->v; y = RKC(i);
+      break;
+    case OP_GETTABLE: case OP_SELF:
+      x = RB(i); y = RKC(i);
+      break;
+    case OP_SETTABUP:
+      x = cl->upvals[GETARG_A(i)]->v; y = RKB(i);
+      break;
+    case OP_SETTABLE:
+      x = RA(i); y = RKB(i);
+      break;
+    case OP_ADD: case OP_SUB: case OP_MUL: case OP_MOD: case OP_POW:
+    case OP_DIV: case OP_IDIV: case OP_BAND: case OP_BOR: case OP_BXOR:
+    case OP_SHL: case OP_SHR: case OP_EQ: case OP_LT: case OP_LE:
+      x = RKB(i); y = RKC(i);
+      break;
+    case OP_JEQ: case OP_JLT: case OP_JLE:
+      x = RA(i); y = RKB(i);
+      break;
+    case OP_TEST: case OP_JEQI: case OP_JLTI: case OP_JLEI: case OP_JGTI:
+    case OP_JGEI: case OP_JTEST: case OP_CALL: case OP_TAILCALL:
+    case OP_FORLOOP: case OP_FORPREP: case OP_TFORCALL: case OP_TFORLOOP:
+      x = RA(i);
+      break;
+    default: break;
+  }
+  oc->count[op]++;
+  oc->types[op][optype(x)][optype(y)]++;
+}
+
+#define vmcount()	countop(L, ci, cl, k, base, i)
+
+#else
+
+#define vmcount()	((void)0)
+
+#endif
+
+
 void vsV_execute (vs_State *L) {
   CallInfo *ci = L->ci;
   LClosure *cl;
   TValue *k;
   StkId base;
+#if VS_USE_JUMPTABLE
+#include "vjumptab.h"
+#endif
   // 进入vsV_execute函数的CallInfo被标记CIST_FRESH
   // 用来识别当前CallInfo是不是进入时的那一个
   ci->callstatus |= CIST_FRESH;  /* fresh invocation of 'vsV_execute" */
@@ -578,20 +783,50 @@ void vsV_execute (vs_State *L) {
       vmcase(OP_GETTABUP) {
         TValue *upval = cl->upvals[GETARG_B(i)]->v;
         TValue *rc = RKC(i);
-        gettableProtected(L, upval, rc, ra);
+        if (ttistable(upval) && ttisshrstring(rc)) {  /* global access? */
+          const TValue *slot = vsH_getshortstrcached(hvalue(upval),
+                                 tsvalue(rc), tcacheslot(cl->p, ci));
+          setobj2s(L, ra, slot);
+        }
+        else gettableProtected(L, upval, rc, ra);
         vmbreak;
       }
       vmcase(OP_GETTABLE) {
         StkId rb = RB(i);
         TValue *rc = RKC(i);
-        gettableProtected(L, rb, rc, ra);
+        const TValue *slot;
+        if (fastgeti(rb, rc, slot)) {
+          setobj2s(L, ra, slot);
+        }
+        else if (ttisarray(rb) && ttisinteger(rc)) {  /* typed array */
+          vsH_getelem(arrvalue(rb), ivalue(rc), ra);
+        }
+#if defined(VS_SHAPES)
+        else if (fastgetfield(rb, scacheslot(cl->p, ci), slot)) {
+          setobj2s(L, ra, slot);
+        }
+        else if (isfield(rb, rc, GETARG_C(i))) {
+          slot = vsH_getfield(hvalue(rb), tsvalue(rc), scacheslot(cl->p, ci));
+          setobj2s(L, ra, slot);
+        }
+#endif
+        else gettableProtected(L, rb, rc, ra);
         vmbreak;
       }
       vmcase(OP_SETTABUP) {
         TValue *upval = cl->upvals[GETARG_A(i)]->v;
         TValue *rb = RKB(i);
         TValue *rc = RKC(i);
-        settableProtected(L, upval, rb, rc);
+        if (ttistable(upval) && ttisshrstring(rb)) {  /* global access? */
+          const TValue *slot = vsH_getshortstrcached(hvalue(upval),
+                                 tsvalue(rb), tcacheslot(cl->p, ci));
+          if (!ttisnil(slot)) {
+            vsC_barrierback(L, hvalue(upval), slot, rc);
+            setobj2t(L, cast(TValue *, slot), rc);
+          }
+          else Protect(vsV_finishset(L, upval, rb, rc, slot));
+        }
+        else settableProtected(L, upval, rb, rc);
         vmbreak;
       }
       vmcase(OP_SETUPVAL) {
@@ -603,7 +838,30 @@ void vsV_execute (vs_State *L) {
       vmcase(OP_SETTABLE) {
         TValue *rb = RKB(i);
         TValue *rc = RKC(i);
-        settableProtected(L, ra, rb, rc);
+        const TValue *slot;
+        // 数组部分的位置一定存在 即使现在是nil也可以直接写入
+        if (fastgeti(ra, rb, slot)) {
+          vsC_barrierback(L, hvalue(ra), slot, rc);
+          setobj2t(L, cast(TValue *, slot), rc);
+        }
+        // 类型化数组的其他情况由vsV_finishset处理
+        else if (fastseta(ra, rb, rc)) {}  /* typed array */
+#if defined(VS_SHAPES)
+        // 记录表的槽位也一定存在 即使现在是nil也可以直接写入
+        else if (fastgetfield(ra, scacheslot(cl->p, ci), slot)) {
+          vsC_barrierback(L, hvalue(ra), slot, rc);
+          setobj2t(L, cast(TValue *, slot), rc);
+        }
+        else if (isfield(ra, rb, GETARG_B(i))) {
+          slot = vsH_getfield(hvalue(ra), tsvalue(rb), scacheslot(cl->p, ci));
+          if (!ttisnil(slot)) {
+            vsC_barrierback(L, hvalue(ra), slot, rc);
+            setobj2t(L, cast(TValue *, slot), rc);
+          }
+          else Protect(vsV_finishset(L, ra, rb, rc, slot));
+        }
+#endif
+        else settableProtected(L, ra, rb, rc);
         vmbreak;
       }
       vmcase(OP_NEWTABLE) {
@@ -616,6 +874,17 @@ void vsV_execute (vs_State *L) {
         checkGC(L, ra + 1);
         vmbreak;
       }
+      vmcase(OP_NEWARRAY) {
+        TArray *c = arrvalue(k + GETARG_Bx(i));  /* constant to copy */
+        TArray *a = vsH_newarray(L, c->etype);
+        setarrvalue(L, ra, a);
+        if (c->size > 0) {
+          vsH_setlength(L, a, c->size);
+          memcpy(a->u.b, c->u.b, c->size * elemsize(c->etype));
+        }
+        checkGC(L, ra + 1);
+        vmbreak;
+      }
       vmcase(OP_SELF) {
         // 让B位置赋值到A
         // 查询B.C放到A+1位置
@@ -624,10 +893,20 @@ void vsV_execute (vs_State *L) {
         TValue *rc = RKC(i);
         TString *key = tsvalue(rc);  /* key must be a string */
         setobjs2s(L, ra + 1, rb);
+#if defined(VS_SHAPES)
+        if (fastgetfield(rb, scacheslot(cl->p, ci), aux)) {
+          setobj2s(L, ra, aux);
+        }
+        else if (isfield(rb, rc, GETARG_C(i))) {
+          aux = vsH_getfield(hvalue(rb), key, scacheslot(cl->p, ci));
+          setobj2s(L, ra, aux);
+        }
+        else
+#endif
         if (vsV_fastget(L, rb, key, aux, vsH_getstr)) {
           setobj2s(L, ra, aux);
         }
-        else Protect(vsG_typeerror(L, rb, "index"););
+        else Protect(vsV_finishget(L, rb, rc, ra));
         vmbreak;
       }
       vmcase(OP_ADD) {
@@ -741,6 +1020,23 @@ void vsV_execute (vs_State *L) {
           vsG_opinterror(L, rb, rc, "perform bitwise operation on");
         vmbreak;
       }
+      vmcase(OP_ADDI) {
+        TValue *rb = RB(i);
+        int ic = GETARG_sC(i);
+        vs_Number nb;
+        if (ttisinteger(rb)) {
+          setivalue(ra, intop(+, ivalue(rb), ic));
+        }
+        else if (tonumber(rb, &nb)) {
+          setfltvalue(ra, vsi_numadd(L, nb, cast_num(ic)));
+        }
+        else {
+          TValue rc;
+          setivalue(&rc, ic);
+          vsG_opinterror(L, rb, &rc, "perform arithmetic on");
+        }
+        vmbreak;
+      }
       vmcase(OP_MOD) {
         TValue *rb = RKB(i);
         TValue *rc = RKC(i);
@@ -832,36 +1128,116 @@ void vsV_execute (vs_State *L) {
         vmbreak;
       }
       vmcase(OP_JMP) {
+        vsR_cpucheck(L);
         dojump(ci, i, 0);
         vmbreak;
       }
       vmcase(OP_EQ) {
         TValue *rb = RKB(i);
         TValue *rc = RKC(i);
-        Protect(
-          if (vsV_equalobj(rb, rc) != GETARG_A(i))
-            ci->savedpc++;
-          else
-            donextjump(ci);
-        )
+        int res;
+        if (!fastcmp(rb, rc, ==, res))
+          Protect(res = vsV_equalobj(rb, rc));
+        if (res != GETARG_A(i))
+          ci->savedpc++;
+        else
+          donextjump(ci);
         vmbreak;
       }
       vmcase(OP_LT) {
-        Protect(
-          if (vsV_lessthan(L, RKB(i), RKC(i)) != GETARG_A(i))
-            ci->savedpc++;
-          else
-            donextjump(ci);
-        )
+        TValue *rb = RKB(i);
+        TValue *rc = RKC(i);
+        int res;
+        if (!fastcmp(rb, rc, <, res))
+          Protect(res = vsV_lessthan(L, rb, rc));
+        if (res != GETARG_A(i))
+          ci->savedpc++;
+        else
+          donextjump(ci);
         vmbreak;
       }
       vmcase(OP_LE) {
-        Protect(
-          if (vsV_lessequal(L, RKB(i), RKC(i)) != GETARG_A(i))
-            ci->savedpc++;
-          else
-            donextjump(ci);
-        )
+        TValue *rb = RKB(i);
+        TValue *rc = RKC(i);
+        int res;
+        if (!fastcmp(rb, rc, <=, res))
+          Protect(res = vsV_lessequal(L, rb, rc));
+        if (res != GETARG_A(i))
+          ci->savedpc++;
+        else
+          donextjump(ci);
+        vmbreak;
+      }
+      vmcase(OP_EQI) {
+        TValue *rb = RB(i);
+        int ic = GETARG_sC(i);
+        int res;
+        if (!fastcmpi(rb, ic, ==, res))
+          res = 0;  /* no other type is equal to a number */
+        if (res != GETARG_A(i))
+          ci->savedpc++;
+        else
+          donextjump(ci);
+        vmbreak;
+      }
+      vmcase(OP_LTI) {
+        TValue *rb = RB(i);
+        int ic = GETARG_sC(i);
+        int res;
+        if (!fastcmpi(rb, ic, <, res)) {
+          TValue rc;
+          setivalue(&rc, ic);
+          Protect(res = vsV_lessthan(L, rb, &rc));
+        }
+        if (res != GETARG_A(i))
+          ci->savedpc++;
+        else
+          donextjump(ci);
+        vmbreak;
+      }
+      vmcase(OP_LEI) {
+        TValue *rb = RB(i);
+        int ic = GETARG_sC(i);
+        int res;
+        if (!fastcmpi(rb, ic, <=, res)) {
+          TValue rc;
+          setivalue(&rc, ic);
+          Protect(res = vsV_lessequal(L, rb, &rc));
+        }
+        if (res != GETARG_A(i))
+          ci->savedpc++;
+        else
+          donextjump(ci);
+        vmbreak;
+      }
+      vmcase(OP_GTI) {
+        TValue *rb = RB(i);
+        int ic = GETARG_sC(i);
+        int res;
+        if (!fastcmpi(rb, ic, >, res)) {
+          TValue rc;
+          setivalue(&rc, ic);
+          Protect(res = vsV_lessthan(L, &rc, rb));
+        }
+        if (res != GETARG_A(i))
+          ci->savedpc++;
+        else
+          donextjump(ci);
+        vmbreak;
+      }
+      vmcase(OP_GEI) {
+        TValue *rb = RB(i);
+        int ic = GETARG_sC(i);
+        int res;
+        if (!fastcmpi(rb, ic, >=, res)) {
+          TValue rc;
+          setivalue(&rc, ic);
+          Protect(res = vsV_lessequal(L, &rc, rb));
+        }
+        if (res != GETARG_A(i))
+          ci->savedpc++;
+        else
+          donextjump(ci);
         vmbreak;
       }
       vmcase(OP_TEST) {
@@ -881,9 +1257,99 @@ void vsV_execute (vs_State *L) {
         }
         vmbreak;
       }
+      vmcase(OP_JEQ) {
+        TValue *rb = RKB(i);
+        int res;
+        if (!fastcmp(ra, rb, ==, res))
+          Protect(res = vsV_equalobj(ra, rb));
+        if (res == GETARG_k(i))
+          dosJ(ci, i);
+        vmbreak;
+      }
+      vmcase(OP_JLT) {
+        TValue *rb = RKB(i);
+        int res;
+        if (!fastcmp(ra, rb, <, res))
+          Protect(res = vsV_lessthan(L, ra, rb));
+        if (res == GETARG_k(i))
+          dosJ(ci, i);
+        vmbreak;
+      }
+      vmcase(OP_JLE) {
+        TValue *rb = RKB(i);
+        int res;
+        if (!fastcmp(ra, rb, <=, res))
+          Protect(res = vsV_lessequal(L, ra, rb));
+        if (res == GETARG_k(i))
+          dosJ(ci, i);
+        vmbreak;
+      }
+      vmcase(OP_JEQI) {
+        int ib = GETARG_sB(i);
+        int res;
+        if (!fastcmpi(ra, ib, ==, res))
+          res = 0;  /* no other type is equal to a number */
+        if (res == GETARG_k(i))
+          dosJ(ci, i);
+        vmbreak;
+      }
+      vmcase(OP_JLTI) {
+        int ib = GETARG_sB(i);
+        int res;
+        if (!fastcmpi(ra, ib, <, res)) {
+          TValue rb;
+          setivalue(&rb, ib);
+          Protect(res = vsV_lessthan(L, ra, &rb));
+        }
+        if (res == GETARG_k(i))
+          dosJ(ci, i);
+        vmbreak;
+      }
+      vmcase(OP_JLEI) {
+        int ib = GETARG_sB(i);
+        int res;
+        if (!fastcmpi(ra, ib, <=, res)) {
+          TValue rb;
+          setivalue(&rb, ib);
+          Protect(res = vsV_lessequal(L, ra, &rb));
+        }
+        if (res == GETARG_k(i))
+          dosJ(ci, i);
+        vmbreak;
+      }
+      vmcase(OP_JGTI) {
+        int ib = GETARG_sB(i);
+        int res;
+        if (!fastcmpi(ra, ib, >, res)) {
+          TValue rb;
+          setivalue(&rb, ib);
+          Protect(res = vsV_lessthan(L, &rb, ra));
+        }
+        if (res == GETARG_k(i))
+          dosJ(ci, i);
+        vmbreak;
+      }
+      vmcase(OP_JGEI) {
+        int ib = GETARG_sB(i);
+        int res;
+        if (!fastcmpi(ra, ib, >=, res)) {
+          TValue rb;
+          setivalue(&rb, ib);
+          Protect(res = vsV_lessequal(L, &rb, ra));
+        }
+        if (res == GETARG_k(i))
+          dosJ(ci, i);
+        vmbreak;
+      }
+      vmcase(OP_JTEST) {
+        if (l_isfalse(ra) != GETARG_k(i))
+          dosJ(ci, i);
+        vmbreak;
+      }
       vmcase(OP_CALL) {
         int b = GETARG_B(i);
         int nresults = GETARG_C(i) - 1;
+        vsR_cpucheck(L);
         if (b != 0) L->top = ra+b;  /* else previous instruction set top */
         if (vsD_precall(L, ra, nresults)) {  /* C function? */
           if (nresults >= 0)
@@ -950,11 +1416,13 @@ void vsV_execute (vs_State *L) {
         }
       }
       vmcase(OP_FORLOOP) {
+        vsR_cpucheck(L);
         if (ttisinteger(ra)) {  /* integer loop? */
-          vs_Integer step = ivalue(ra + 2);
-          vs_Integer idx = intop(+, ivalue(ra), step); /* increment index */
-          vs_Integer limit = ivalue(ra + 1);
-          if ((0 < step) ? (idx <= limit) : (limit <= idx)) {
+          // 整数循环的R(A+1)保存的是剩余的迭代次数, 见OP_FORPREP
+          vs_Integer count = ivalue(ra + 1);
+          if (count > 0) {  /* still more iterations? */
+            vs_Integer idx = intop(+, ivalue(ra), ivalue(ra + 2));
+            chgivalue(ra + 1, count - 1);  /* update counter */
             ci->savedpc += GETARG_sBx(i);  /* jump back */
             chgivalue(ra, idx);  /* update internal index... */
             setivalue(ra + 3, idx);  /* ...and external index */
@@ -982,9 +1450,30 @@ void vsV_execute (vs_State *L) {
         if (ttisinteger(init) && ttisinteger(pstep) &&
             forlimit(plimit, &ilimit, ivalue(pstep), &stopnow)) {
           /* all values are integer */
-          vs_Integer initv = (stopnow ? 0 : ivalue(init));
-          setivalue(plimit, ilimit);
-          setivalue(init, intop(-, initv, ivalue(pstep)));
+          vs_Integer initv = ivalue(init);
+          vs_Integer step = ivalue(pstep);
+          if (stopnow || (step > 0 ? initv > ilimit : initv < ilimit)) {
+            ci->savedpc += GETARG_sBx(i) + 1;  /* skip the loop */
+            vmbreak;
+          }
+          else {
+            // 预先算出第一次之后还要迭代的次数 写入R(A+1)
+            // OP_FORLOOP只需要递减计数, 不再比较index和limit
+            // 次数超过VS_MAXINTEGER的循环(包括步长为0)按VS_MAXINTEGER次处理
+            vs_Unsigned count;
+            if (step > 0)
+              count = (l_castS2U(ilimit) - l_castS2U(initv)) / l_castS2U(step);
+            else if (step < 0)
+              count = (l_castS2U(initv) - l_castS2U(ilimit)) /
+                      (l_castS2U(-(step + 1)) + 1u);
+            else  /* step == 0: loop "forever" */
+              count = l_castS2U(VS_MAXINTEGER);
+            if (count > l_castS2U(VS_MAXINTEGER))
+              count = l_castS2U(VS_MAXINTEGER);
+            setivalue(plimit, l_castU2S(count));
+            setivalue(ra + 3, initv);  /* external index */
+            vmbreak;  /* run the first iteration, which follows 'prep' */
+          }
         }
         else {  /* try making all values floats */
           vs_Number ninit; vs_Number nlimit; vs_Number nstep;
@@ -1016,6 +1505,7 @@ void vsV_execute (vs_State *L) {
       }
       vmcase(OP_TFORLOOP) {
         l_tforloop:
+        vsR_cpucheck(L);
         if (!ttisnil(ra + 1)) {  /* continue loop? */
           setobjs2s(L, ra, ra + 1);  /* save control variable */
            ci->savedpc += GETARG_sBx(i);  /* jump back */
@@ -1038,8 +1528,9 @@ void vsV_execute (vs_State *L) {
           vsH_resizearray(L, h, last);  /* preallocate it at once */
         for (; n > 0; n--) {
           TValue *val = ra+n;
-          vsH_setint(L, h, last--, val);
-          vsC_barrierback(L, h, val);
+          vsH_setint(L, h, last, val);
+          vsC_barrierback(L, h, &h->array[last - 1], val);
+          last--;
         }
         L->top = ci->top;  /* correct top (in case of previous open call) */
         vmbreak;
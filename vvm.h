@@ -49,7 +49,7 @@
 // 查询t[k]写入v中
 #define vsV_gettable(L,t,k,v) { const TValue *slot; \
   if (vsV_fastget(L,t,k,slot,vsH_get)) { setobj2s(L, v, slot); } \
-  else vsG_typeerror(L, t, "index"); }
+  else vsV_finishget(L,t,k,v); }
 
 
 // t是表且t[k]不是nil 进行GC处理 让t[k]直接等于v
@@ -58,7 +58,7 @@
    ? (slot = NULL, 0) \
    : (slot = f(hvalue(t), k), \
      ttisnil(slot) ? 0 \
-     : (vsC_barrierback(L, hvalue(t), v), \
+     : (vsC_barrierback(L, hvalue(t), slot, v), \
         setobj2t(L, cast(TValue *,slot), v), \
         1)))
 
@@ -74,6 +74,8 @@ VSI_FUNC int vsV_lessequal (vs_State *L, const TValue *l, const TValue *r);
 VSI_FUNC int vsV_tonumber_ (const TValue *obj, vs_Number *n);
 VSI_FUNC int vsV_tointeger (const TValue *obj, vs_Integer *p, int mode);
 
+VSI_FUNC void vsV_finishget (vs_State *L, const TValue *t, TValue *key,
+                               StkId val);
 VSI_FUNC void vsV_finishset (vs_State *L, const TValue *t, TValue *key,
                                StkId val, const TValue *slot);
 